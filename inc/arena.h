@@ -0,0 +1,21 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+
+/*
+* Chunked bump allocator, all memory is released at once with arena_del
+* All functions accept NULL arena and fall back to heap allocation
+*/
+struct arena;
+
+struct arena* arena_new(size_t size);
+void arena_del(struct arena *arena);
+void* arena_alloc(struct arena *arena, size_t size);
+void* arena_realloc(struct arena *arena, void *ptr, size_t old, size_t size);
+void arena_free(struct arena *arena, void *ptr);
+char* arena_strndup(struct arena *arena, const char *str, size_t len);
+void arena_merge(struct arena *arena, struct arena *other);
+size_t arena_used(const struct arena *arena);
+size_t arena_reserved(const struct arena *arena);
+#endif
@@ -1,18 +1,26 @@
 #ifndef __DICT_H__
 #define __DICT_H__  
 
+#include <stddef.h>
+#include <stdbool.h>
+
 struct dict;
 struct iter;
+struct arena;
 
 typedef int(*dict_print_t)(const void* stream, unsigned int index, const char *key, const void* val);
 typedef void(*dict_free_t)(void* val);
 typedef int(*dict_cmp_t)(const void* data1, const void* data2);
 struct dict* dict_new(dict_free_t f, dict_cmp_t cmp, dict_print_t print);
+struct dict* dict_new_arena(struct arena *arena, dict_free_t f, dict_cmp_t cmp, dict_print_t print);
 
 int dict_set(struct dict *dict, const char* key, const void* val);
+int dict_add(struct dict *dict, const char* key, size_t len, const void* val, bool replace, void** old);
+int dict_add_ref(struct dict *dict, const char* key, size_t len, const void* val, bool replace, void** old);
 void* dict_get(const struct dict* dict, const char* key);
 void dict_del(struct dict* dict);
 int dict_print(const struct dict* dict, const void* stream);
 struct iter* dict_iter(const struct dict* dict);
 int dict_size(const struct dict *dict);
+struct arena* dict_arena(const struct dict *dict);
 #endif
\ No newline at end of file
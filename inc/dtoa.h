@@ -0,0 +1,16 @@
+#ifndef __DTOA_H__
+#define __DTOA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest double printed by format_double, "-2.2250738585072014e-308" is 24 bytes */
+#define DTOA_SIZE       32
+
+int format_double(double value, char *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
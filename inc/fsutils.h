@@ -12,7 +12,9 @@ extern "C" {
 FILE *fmemopen(void *buf, size_t size, const char *mode);
 #endif
 FILE *fdmemopen(char ***buf, size_t **size);
-char* readall(const char *fname, unsigned int *len);
+char* readall(const char *fname, size_t *len);
+char* mapall(const char *fname, size_t *len, bool *mapped);
+void unmapall(char *buffer, size_t len, bool mapped);
 
 #ifdef __cplusplus
 }
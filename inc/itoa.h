@@ -0,0 +1,132 @@
+#ifndef __ITOA_H__
+#define __ITOA_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest number printed, "-9223372036854775808" or 22 octal digits with prefix */
+#define ITOA_SIZE       24
+
+/* "00" to "99" */
+extern const char itoa_digits[200];
+/* 10^0 to 10^19 */
+extern const uint64_t itoa_pow10[20];
+
+/*
+* @brief Number of decimal digits
+* Bit length gives the digits up to one, which is fixed with a table of powers of 10.
+* Zero is taken as one, so that it has a digit.
+* @param val number
+* @return digits, 1 to 20
+*/
+static inline int decimal_len(uint64_t val)
+{
+    int len = ((64 - __builtin_clzll(val | 1)) * 1233) >> 12;
+
+    return len - ((val | 1) < itoa_pow10[len]) + 1;
+}
+
+/*
+* @brief Print 8 digits of number, with leading zeros
+* Digits are taken two at a time from table, using 32 bit arithmetic.
+* @param val number, less than 10^8
+* @param end end of placeholder for digits
+*/
+static inline void format_8digits(uint32_t val, char *end)
+{
+    uint32_t high = val / 10000, low = val % 10000;
+
+    memcpy(end - 2, itoa_digits + (low % 100) * 2, 2);
+    memcpy(end - 4, itoa_digits + (low / 100) * 2, 2);
+    memcpy(end - 6, itoa_digits + (high % 100) * 2, 2);
+    memcpy(end - 8, itoa_digits + (high / 100) * 2, 2);
+}
+
+/*
+* @brief Print unsigned number
+* Length is known up front, so digits are written in place from the end.
+* Groups of 8 digits are split with 64 bit division, rest is done two digits at a time.
+* @param val number
+* @param buffer placeholder for digits, at least 20 bytes, not null terminated
+* @return length of output
+*/
+static inline int format_uint(uint64_t val, char *buffer)
+{
+    int len = decimal_len(val);
+    char *pos = buffer + len;
+    uint32_t small;
+
+    for(; val >= 100000000; pos -= 8){
+        format_8digits(val % 100000000, pos);
+        val /= 100000000;
+    }
+    for(small = val; small >= 100; small /= 100){
+        pos -= 2;
+        memcpy(pos, itoa_digits + (small % 100) * 2, 2);
+    }
+    if(small >= 10)
+        memcpy(pos - 2, itoa_digits + small * 2, 2);
+    else
+        pos[-1] = '0' + small;
+    return len;
+}
+
+/*
+* @brief Print signed number
+* @param val number
+* @param buffer placeholder for output, at least 21 bytes, not null terminated
+* @return length of output
+*/
+static inline int format_int(int64_t val, char *buffer)
+{
+    if(val < 0){
+        *buffer = '-';
+        return format_uint(-(uint64_t)val, buffer + 1) + 1;
+    }
+    return format_uint(val, buffer);
+}
+
+/*
+* @brief Print lower case hex digits of number, without prefix
+* @param val number
+* @param buffer placeholder for digits, at least 16 bytes, not null terminated
+* @return length of output
+*/
+static inline int format_hex(uint64_t val, char *buffer)
+{
+    int len = (64 - __builtin_clzll(val | 1) + 3) / 4;
+    char *pos = buffer + len;
+
+    do {
+        *--pos = "0123456789abcdef"[val & 0xF];
+        val >>= 4;
+    } while(pos > buffer);
+    return len;
+}
+
+/*
+* @brief Print octal digits of number, without prefix
+* @param val number
+* @param buffer placeholder for digits, at least 22 bytes, not null terminated
+* @return length of output
+*/
+static inline int format_octal(uint64_t val, char *buffer)
+{
+    int len = (64 - __builtin_clzll(val | 1) + 2) / 3;
+    char *pos = buffer + len;
+
+    do {
+        *--pos = '0' + (val & 7);
+        val >>= 3;
+    } while(pos > buffer);
+    return len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,6 +1,7 @@
 #ifndef __JSON_H__
 #define __JSON_H__
 
+#include <stdio.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -18,6 +19,7 @@ enum json_err
     JSON_ERR_PARSE,
     JSON_ERR_OVERFLOW,
     JSON_ERR_SYS,
+    JSON_ERR_DEPTH,
     JSON_ERR_LAST,
 };
 
@@ -37,6 +39,90 @@ enum json_type
     JSON_TYPE_OBJ,
     JSON_TYPE_ITER,
 };
+/* Policy for repeated keys in a json object while parsing */
+enum json_dup
+{
+    JSON_DUP_ERROR,     /* Fail with JSON_ERR_KEY_REPEAT */
+    JSON_DUP_LAST,      /* Keep last value */
+    JSON_DUP_FIRST,     /* Keep first value */
+};
+
+/* Parser option flags */
+enum json_opt_flags
+{
+    JSON_OPT_ARENA = 0x01,      /* Allocate document from an arena, release with json_doc_del */
+    JSON_OPT_INSITU = 0x02,     /* Strings and keys reference input buffer, see below */
+};
+
+/*
+* In situ parsing (JSON_OPT_INSITU) does not copy strings and keys,
+* escapes are decoded in place and strings are null terminated inside the input buffer.
+* Input buffer is modified, also when parsing fails, and must stay valid and unchanged
+* until the document is deleted. Ignored by json_loads_const and json_load_opts.
+*/
+
+/*
+* Default limit for nesting of objects and lists.
+* Parser itself does not recurse, but deleting, cloning and printing a heap document
+* recurse once per level, so keep the limit reasonable for such documents.
+*/
+#define JSON_DEPTH_MAX  1024
+
+/* Parser options */
+struct json_opts
+{
+    unsigned int flags; /* enum json_opt_flags */
+    int dup;            /* Duplicate key policy, enum json_dup */
+    unsigned int max_depth; /* Maximum nesting depth, 0 for JSON_DEPTH_MAX */
+};
+
+/*
+* Printer flags, combined with indentation in indent argument of print functions,
+* like json_str(json, &len, 2 | JSON_PRINT_ASCII)
+*/
+enum json_print_flags
+{
+    JSON_PRINT_ASCII = 0x10000,     /* Escape non ASCII characters as \uXXXX, invalid UTF-8 as \ufffd */
+};
+
+/* Indentation part of indent argument of print functions */
+#define JSON_PRINT_INDENT_MASK      0xFFFF
+
+/*
+* Callbacks of event parser, see json_sax. Any callback can be NULL to ignore the event.
+* Strings and keys are decoded but not null terminated, and are valid only during the call
+* unless parsed in situ. Callback returns 0 to continue or a negative JSON_ERR value
+* to stop parsing, which is then returned by json_sax.
+*/
+struct json_handler
+{
+    int (*start_object)(void *ctx);
+    int (*end_object)(void *ctx);
+    int (*start_list)(void *ctx);
+    int (*end_list)(void *ctx);
+    int (*key)(void *ctx, const char *key, size_t len);
+    int (*string)(void *ctx, const char *str, size_t len);
+    /* JSON_TYPE_INT, JSON_TYPE_UINT with bits of unsigned long, JSON_TYPE_HEX or JSON_TYPE_OCTAL */
+    int (*integer)(void *ctx, int type, long val);
+    int (*double_number)(void *ctx, double val);
+    int (*boolean)(void *ctx, int val);
+    int (*null)(void *ctx);
+};
+
+/*
+* Lazy cursor at a value inside json buffer, see json_cursor.
+* Nothing is parsed or allocated until it is asked for, values passed on the way
+* are only skipped, so errors in them are not reported.
+*/
+struct json_cursor
+{
+    char *start;        /* First character of value */
+    char *end;          /* End of buffer */
+    int parent;         /* JSON_TYPE_DICT or JSON_TYPE_LIST containing value, JSON_TYPE_INVALID at root */
+    char *key;          /* Key of object member as in buffer, escapes not decoded, NULL in list */
+    int len;            /* Length of key */
+};
+
 #ifndef inRange
 #define inRange(a,x,y)  (((a)>=(x)) && ((a) <= (y)))
 #endif
@@ -45,19 +131,65 @@ enum json_type
 
 struct json;
 struct json_iter;
+struct json_stream;
+struct json_writer;
+
+/*
+* Callback for each record of JSON Lines, see json_lines.
+* Offset is position of record in buffer, json is NULL and err is set if record fails to parse.
+* Return 0 to continue or a negative JSON_ERR value to stop parsing.
+*/
+typedef int (*json_line_cb)(void *ctx, size_t offset, struct json *json, int err);
 
 struct json* json_new(void);
 void json_del(struct json* json);
 struct json* json_loads(char *start, char* end, int *err);
 struct json* json_load(char* fname, int *err);
+struct json* json_loads_opts(char *start, char* end, const struct json_opts *opts, int *err);
+struct json* json_load_opts(char* fname, const struct json_opts *opts, int *err);
+struct json* json_loads_index(char *start, char* end, const struct json_opts *opts, int *err);
+struct json* json_loads_const(const char *start, const char *end, const struct json_opts *opts, int *err);
+struct json* json_loads_parallel(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, int *err);
+int json_sax(char *start, char *end, const struct json_handler *handler, void *ctx, const struct json_opts *opts);
+struct json_stream* json_stream_new(const struct json_handler *handler, void *ctx, const struct json_opts *opts);
+int json_stream_feed(struct json_stream *js, const char *chunk, size_t len);
+struct json* json_stream_end(struct json_stream *js, int *err);
+void json_stream_del(struct json_stream *js);
+int json_lines(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, json_line_cb cb, void *ctx);
+struct json** json_loads_lines(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, size_t *count, int *err);
+struct json** json_load_lines(char *fname, const struct json_opts *opts, unsigned int threads, size_t *count, int *err);
+void json_lines_del(struct json **json, size_t count);
+struct json* json_loads_arena(char *start, char* end, int *err);
+void json_doc_del(struct json *json);
+int json_doc_stats(const struct json *json, size_t *used, size_t *reserved);
 char* json_get_err(int err);
 void* json_get(struct json *json, char *key);
 int json_set(struct json *json, int type, char *key, void *val);
 void* json_iter_next(struct json_iter *iter,  int *type);
 int json_print(struct json *json, unsigned int indent);
 int json_printf(struct json *json, char *fname, unsigned int indent);
+int json_printfp(struct json *json, FILE *fp, unsigned int indent);
+int json_printfd(struct json *json, int fd, unsigned int indent);
 int json_prints(struct json *json, char *buffer, unsigned int size, unsigned int indent);
 char* json_str(struct json *json, int *len, unsigned int indent);
+int json_serialized_size(struct json *json, unsigned int indent);
+struct json_writer* json_writer_new(char *buffer, size_t size, unsigned int indent);
+struct json_writer* json_writer_fd(int fd, unsigned int indent);
+struct json_writer* json_writer_fp(FILE *fp, unsigned int indent);
+int json_write_start_object(struct json_writer *jw);
+int json_write_end_object(struct json_writer *jw);
+int json_write_start_list(struct json_writer *jw);
+int json_write_end_list(struct json_writer *jw);
+int json_write_key(struct json_writer *jw, const char *key, size_t len);
+int json_write_str(struct json_writer *jw, const char *str, size_t len);
+int json_write_int(struct json_writer *jw, long val);
+int json_write_uint(struct json_writer *jw, unsigned long val);
+int json_write_double(struct json_writer *jw, double val);
+int json_write_bool(struct json_writer *jw, int val);
+int json_write_null(struct json_writer *jw);
+int json_writer_end(struct json_writer *jw);
+char* json_writer_str(struct json_writer *jw, int *len);
+void json_writer_del(struct json_writer *jw);
 struct json* json_clone(struct json* json, int *err);
 void json_iter_del(struct json_iter *iter);
 char* json_sterror(int err);
@@ -65,6 +197,12 @@ int json_type(struct json* json);
 size_t json_size(struct json* json);
 int json_val(struct json* json, void* buffer, size_t size);
 struct iter* json_iter(struct json* json);
+int json_cursor(struct json_cursor *cur, char *start, char *end);
+int json_cursor_type(const struct json_cursor *cur);
+int json_cursor_get(const struct json_cursor *cur, const char *key, struct json_cursor *child);
+int json_cursor_index(const struct json_cursor *cur, unsigned int index, struct json_cursor *child);
+int json_cursor_next(struct json_cursor *cur);
+struct json* json_cursor_json(const struct json_cursor *cur, const struct json_opts *opts, int *err);
 #ifdef __cplusplus
 }
 #endif
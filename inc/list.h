@@ -7,9 +7,13 @@ typedef int(*list_cmp_t)(const void* data1, const void* data2);
 typedef int(*list_print_t)(const void* stream, unsigned int index, const void* data);
 struct list;
 struct iter;
+struct arena;
 
 struct list* list_new(list_free_t f, list_cmp_t cmp, list_print_t print);
+struct list* list_new_arena(struct arena *arena, list_free_t f, list_cmp_t cmp, list_print_t print);
 int list_add(struct list* list, const void* data);
+int list_append(struct list* list, struct list* other);
+int list_reserve(struct list* list, unsigned int size);
 int list_add_sorted(struct list* list, const void* data);
 void* list_get(const struct list* list, unsigned int index);
 int list_remove(struct list* list, unsigned int index);
@@ -19,4 +23,5 @@ int list_size(const struct list *list);
 struct iter* list_iter(struct list* list);
 int list_find(const struct list *list, const void* data);
 int list_print(const struct list *list, const void *stream);
+struct arena* list_arena(const struct list *list);
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest number of threads started by pool */
+#define POOL_THREADS_MAX    64
+
+/*
+* Job of worker pool, index is number of job
+* Returns 0 or negative error, which stops pool
+*/
+typedef int (*pool_job_t)(void *arg, size_t index);
+
+unsigned int pool_threads(unsigned int threads);
+int pool_run(unsigned int threads, size_t jobs, pool_job_t job, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,40 @@
+#ifndef __POW5_H__
+#define __POW5_H__
+
+#include <stdint.h>
+
+/* Range of decimal exponents in 128 bit power of 5 table */
+#define POW5_128_MIN    (-342)
+#define POW5_128_MAX    325
+
+/*
+* Normalized 128 bit approximations of 5^q for q in [POW5_128_MIN, POW5_128_MAX]
+* Entry is {high, low}, most significant bit of high is always set.
+*/
+extern const uint64_t pow5_128[POW5_128_MAX - POW5_128_MIN + 1][2];
+
+/*
+* @brief Full 64 x 64 bit multiplication
+* @param a first number
+* @param b second number
+* @param high placeholder for upper 64 bits
+* @return lower 64 bits
+*/
+static inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t *high)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128)a * b;
+    *high = (uint64_t)(r >> 64);
+    return (uint64_t)r;
+#else
+    uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+    uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+    *high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+    return (cross << 32) | (uint32_t)lo_lo;
+#endif
+}
+
+#endif
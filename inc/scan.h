@@ -0,0 +1,73 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Scanning kernels used by parser and printer
+* Each kernel has scalar, SSE2 and AVX2 variant, best one is selected at runtime.
+* On other architectures SIMD variants fall back to scalar code.
+*/
+enum scan_level
+{
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2,
+};
+
+/* Character classes */
+enum scan_class
+{
+    SCAN_CLASS_WS = 0x01,       /* Whitespace, including null character */
+    SCAN_CLASS_STR = 0x02,      /* Ends run of plain string characters */
+};
+
+extern const unsigned char scan_class[256];
+
+/* Masks of 64 byte block, bit per byte, least significant bit is first byte */
+struct scan_block
+{
+    uint64_t quote;         /* " */
+    uint64_t backslash;     /* \ */
+    uint64_t ws;            /* Whitespace, same as scan_is_ws */
+    uint64_t op;            /* { } [ ] : , */
+    uint64_t ctrl;          /* Control characters */
+};
+
+#define SCAN_BLOCK_SIZE     64
+
+#define scan_is_ws(ch)          (scan_class[(unsigned char)(ch)] & SCAN_CLASS_WS)
+#define scan_is_str(ch)         (scan_class[(unsigned char)(ch)] & SCAN_CLASS_STR)
+
+int scan_level(void);
+int scan_set_level(int level);
+
+const char* scan_ws(const char *start, const char *end);
+const char* scan_ws_scalar(const char *start, const char *end);
+const char* scan_ws_sse2(const char *start, const char *end);
+const char* scan_ws_avx2(const char *start, const char *end);
+
+const char* scan_str(const char *start, const char *end);
+const char* scan_str_scalar(const char *start, const char *end);
+const char* scan_str_sse2(const char *start, const char *end);
+const char* scan_str_avx2(const char *start, const char *end);
+
+const char* scan_ascii(const char *start, const char *end);
+const char* scan_ascii_scalar(const char *start, const char *end);
+const char* scan_ascii_sse2(const char *start, const char *end);
+const char* scan_ascii_avx2(const char *start, const char *end);
+
+void scan_block(const char *start, size_t count, struct scan_block *masks);
+void scan_block_scalar(const char *start, size_t count, struct scan_block *masks);
+void scan_block_sse2(const char *start, size_t count, struct scan_block *masks);
+void scan_block_avx2(const char *start, size_t count, struct scan_block *masks);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,87 @@
+#ifndef __STRUCTURAL_H__
+#define __STRUCTURAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+* Structural index of json buffer
+* First stage of indexed parsing, buffer is classified 64 bytes at a time with scan kernels.
+* Index has offsets of { } [ ] : , outside strings, opening and closing quotes of strings
+* and first character of other values, last offset is length of buffer.
+* Buffer is indexed a window at a time while second stage consumes offsets,
+* so that index stays small and buffer is still in cache when it is parsed.
+* Bitmap marks backslash and control characters inside strings,
+* string without any of them can be used without scanning it again.
+*/
+struct structural
+{
+    const char *start;      /* Buffer */
+    size_t len;
+    size_t offset;          /* Start of next block to index */
+    uint64_t escaped;       /* Next block starts with escaped character */
+    uint64_t in_str;        /* All ones if next block starts inside string */
+    uint64_t scalar;        /* Last byte indexed is part of a value */
+    uint32_t *pos;          /* Offsets of current window */
+    size_t count;           /* Number of offsets */
+    uint64_t *attention;    /* Bit per byte of buffer */
+};
+
+/* Largest buffer which can be indexed */
+#define STRUCTURAL_MAX      (UINT32_MAX - 1)
+/* Bytes indexed at once */
+#define STRUCTURAL_WINDOW   (16 * 1024)
+
+int structural_init(struct structural *s, const char *start, const char *end);
+const uint32_t* structural_fill(struct structural *s, const uint32_t *pos);
+void structural_free(struct structural *s);
+const char* structural_skip(const char *start, const char *end);
+const char* structural_split(const char *start, const char *end, size_t step, const char **splits, size_t *count);
+
+/*
+* @brief Move to next offset
+* Offset after the returned one is also available, unless returned one is length of buffer.
+* @param s structural index
+* @param pos current offset
+* @return next offset
+*/
+static inline const uint32_t* structural_next(struct structural *s, const uint32_t *pos)
+{
+    if(((pos + 2) >= (s->pos + s->count)) && (s->offset < s->len))
+        return structural_fill(s, pos + 1);
+    return pos + 1;
+}
+
+/*
+* @brief Check that bytes of buffer need no attention
+* @param s structural index
+* @param from offset of first byte
+* @param to offset after last byte
+* @return true if there is no backslash or control character in range
+*/
+static inline bool structural_plain(const struct structural *s, size_t from, size_t to)
+{
+    uint64_t word;
+    size_t n;
+    for(; from < to; from += n){
+        n = 64 - (from & 63);
+        if(n > (to - from))
+            n = to - from;
+        word = s->attention[from >> 6] >> (from & 63);
+        if(n < 64)
+            word &= (1ULL << n) - 1;
+        if(word)
+            return false;
+    }
+    return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
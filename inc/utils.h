@@ -4,19 +4,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-char* trim(char *start, char *end);
-unsigned int parse_hex(char *start, char *end, char ** raw, bool *overflow);
-unsigned int parse_octal(char *start, char *end, char ** raw, bool *overflow);
-bool parse_boolean(char *start, char *end, char ** raw);
-double parse_float(char *start, char *end, char ** raw);
-char* parse_str(char *start, char *end, char ** raw, int *len);
-long parse_int(char *start, char *end, char** raw, bool *overflow, bool *unsigned_flag);
-bool is_hex(char *start, char *end);
-bool is_octal(char *start, char *end);
+char* trim(const char *start, const char *end);
+uint64_t parse_hex(const char *start, const char *end, char ** raw, bool *overflow);
+uint64_t parse_octal(const char *start, const char *end, char ** raw, bool *overflow);
+bool parse_boolean(const char *start, const char *end, char ** raw);
+double parse_float(const char *start, const char *end, char ** raw);
+char* parse_str(const char *start, const char *end, char ** raw, int *len, bool *escaped);
+int unescape_str(char *dst, const char *src, int len);
+uint64_t parse_int(const char *start, const char *end, char** raw, bool *overflow, bool *unsigned_flag);
+bool is_hex(const char *start, const char *end);
+bool is_octal(const char *start, const char *end);
+bool is_float(const char *start, const char *end);
 
 #ifdef __cplusplus
 }
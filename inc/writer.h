@@ -0,0 +1,140 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes collected before they are flushed to fd or stream */
+#define WRITER_BUFFER       (16 * 1024)
+/* Buffer parts and referenced strings written with one writev */
+#define WRITER_IOV          128
+/* Shorter strings are copied to buffer, referencing them costs more than copying */
+#define WRITER_REF_MIN      1024
+/* Unused bytes kept at end of buffer taken with writer_take */
+#define WRITER_SLACK        4096
+
+enum writer_sink
+{
+    WRITER_MEM,         /* Buffer of caller, output which does not fit is only counted */
+    WRITER_ALLOC,       /* Growing buffer, caller frees it */
+    WRITER_FD,          /* File descriptor */
+    WRITER_FILE,        /* Stream */
+    WRITER_COUNT,       /* Output is only counted, buffer is reused as scratch space */
+    WRITER_FDV,         /* File descriptor, long strings are written from where they are with writev */
+};
+
+/*
+* Output of serializer
+* Bytes are appended to buffer with memcpy, buffer is flushed to sink when it is full.
+* First failure is kept, later output is only counted.
+* For WRITER_FDV strings given to writer_ref are not copied, iov collects them between
+* parts of buffer and they must stay valid until writer_flush.
+*/
+struct writer
+{
+    char *buffer;
+    size_t size;            /* Bytes available in buffer */
+    size_t used;            /* Bytes in buffer */
+    size_t total;           /* Bytes written, including flushed and dropped ones */
+    int sink;               /* enum writer_sink */
+    int fd;
+    FILE *fp;
+    int err;                /* First failure, 0 or negative JSON_ERR value */
+    unsigned int flags;     /* Printer flags, enum json_print_flags */
+    size_t mark;            /* Start of buffer bytes which are not in iov yet */
+    int iovcnt;
+    char local[WRITER_BUFFER];
+    struct iovec iov[WRITER_IOV];   /* First iovcnt entries are used, after buffer so init does not clear it */
+};
+
+void writer_mem(struct writer *w, char *buffer, size_t size);
+int writer_alloc(struct writer *w, size_t size);
+void writer_fd(struct writer *w, int fd);
+void writer_fdv(struct writer *w, int fd);
+void writer_file(struct writer *w, FILE *fp);
+void writer_count(struct writer *w);
+int writer_flush(struct writer *w);
+int writer_slow(struct writer *w, const char *data, size_t len);
+void writer_iov(struct writer *w, const char *data, size_t len);
+void writer_spaces(struct writer *w, size_t count);
+char* writer_take(struct writer *w);
+void writer_free(struct writer *w);
+
+/*
+* @brief Append bytes
+* @param w writer
+* @param data bytes
+* @param len number of bytes
+*/
+static inline void writer_write(struct writer *w, const char *data, size_t len)
+{
+    if((w->size - w->used) >= len){
+        memcpy(w->buffer + w->used, data, len);
+        w->used += len;
+        w->total += len;
+    } else {
+        writer_slow(w, data, len);
+    }
+}
+
+/*
+* @brief Append one byte
+* @param w writer
+* @param ch byte
+*/
+static inline void writer_char(struct writer *w, char ch)
+{
+    if(w->used < w->size){
+        w->buffer[w->used++] = ch;
+        w->total++;
+    } else {
+        writer_slow(w, &ch, 1);
+    }
+}
+
+/*
+* @brief Append bytes which stay valid until writer_flush, long ones are referenced instead of copied
+* @param w writer
+* @param data bytes
+* @param len number of bytes
+*/
+static inline void writer_ref(struct writer *w, const char *data, size_t len)
+{
+    if((len >= WRITER_REF_MIN) && (w->sink == WRITER_FDV))
+        writer_iov(w, data, len);
+    else
+        writer_write(w, data, len);
+}
+
+/*
+* @brief Space at end of buffer for formatting directly into it
+* @param w writer
+* @param len bytes needed
+* @return start of space, NULL if buffer does not have len bytes left
+*/
+static inline char* writer_room(struct writer *w, size_t len)
+{
+    return ((w->size - w->used) >= len) ? w->buffer + w->used : NULL;
+}
+
+/*
+* @brief Take bytes formatted into space from writer_room
+* @param w writer
+* @param len number of bytes
+*/
+static inline void writer_advance(struct writer *w, size_t len)
+{
+    w->used += len;
+    w->total += len;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define MODULE "Arena"
+#include "trace.h"
+
+/* Smallest chunk size */
+#define ARENA_CHUNK_MIN     4096
+/* Chunks keep doubling upto this size */
+#define ARENA_CHUNK_MAX     (64 * 1024 * 1024)
+/* Alignment of returned memory, enough for pointers and doubles */
+#define ARENA_ALIGN         8
+#define ArenaAlign(x)       (((x) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+struct chunk
+{
+    struct chunk *next;
+    size_t size;
+    size_t used;
+    size_t last;            /* Offset of last allocation, it can be resized in place */
+    char data[];
+};
+
+struct arena
+{
+    struct chunk *chunk;    /* Current chunk, older chunks are linked to it */
+    size_t next;            /* Size of next chunk */
+    size_t used;            /* Bytes handed out */
+    size_t reserved;        /* Bytes allocated from heap */
+};
+
+/*
+* @brief Allocate new chunk and make it current
+* @param arena arena
+* @param size minimum space needed in chunk
+* @return chunk or NULL
+*/
+static struct chunk* chunk_new(struct arena *arena, size_t size)
+{
+    struct chunk *chunk = NULL;
+    size_t len = arena->next;
+
+    /* Big allocations get a chunk of their own */
+    if(size > len)
+        len = ArenaAlign(size);
+
+    if((chunk = malloc(sizeof(struct chunk) + len))){
+        chunk->size = len;
+        chunk->used = 0;
+        chunk->last = 0;
+        chunk->next = arena->chunk;
+        arena->chunk = chunk;
+        arena->reserved += sizeof(struct chunk) + len;
+        if(arena->next < ARENA_CHUNK_MAX)
+            arena->next *= 2;
+    } else {
+        TRACE(ERROR, "Failed to allocate arena chunk");
+    }
+    return chunk;
+}
+
+/*
+* @brief Create new arena
+* @param size size of first chunk, 0 for default
+* @return arena
+*/
+struct arena* arena_new(size_t size)
+{
+    struct arena *arena = NULL;
+    struct arena temp = {0};
+
+    temp.next = ArenaAlign(size < ARENA_CHUNK_MIN ? ARENA_CHUNK_MIN : size);
+    /* Arena itself lives in its first chunk */
+    if(chunk_new(&temp, sizeof(struct arena))){
+        arena = (struct arena*)temp.chunk->data;
+        temp.chunk->used = ArenaAlign(sizeof(struct arena));
+        temp.chunk->last = temp.chunk->used;
+        *arena = temp;
+    }
+    return arena;
+}
+
+/*
+* @brief Release arena and all memory allocated from it
+* @param arena arena
+*/
+void arena_del(struct arena *arena)
+{
+    struct chunk *chunk = NULL;
+    struct chunk *next = NULL;
+    if(arena){
+        /* Arena is in the oldest chunk, so it is released last */
+        for(chunk = arena->chunk; chunk; chunk = next){
+            next = chunk->next;
+            free(chunk);
+        }
+    } else {
+        TRACE(ERROR, "Invalid arguments");
+    }
+}
+
+/*
+* @brief Allocate memory
+* @param arena arena, NULL for heap
+* @param size size of memory
+* @return pointer to memory
+*/
+void* arena_alloc(struct arena *arena, size_t size)
+{
+    struct chunk *chunk = NULL;
+    void *ptr = NULL;
+
+    if(!arena)
+        return malloc(size);
+
+    size = ArenaAlign(size ? size : 1);
+    chunk = arena->chunk;
+    if((chunk->size - chunk->used < size) && !(chunk = chunk_new(arena, size))){
+        return NULL;
+    }
+
+    ptr = chunk->data + chunk->used;
+    chunk->last = chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    return ptr;
+}
+
+/*
+* @brief Resize memory, last allocation is resized in place
+* @param arena arena, NULL for heap
+* @param ptr memory to resize
+* @param old current size of memory
+* @param size new size
+* @return pointer to memory
+*/
+void* arena_realloc(struct arena *arena, void *ptr, size_t old, size_t size)
+{
+    struct chunk *chunk = NULL;
+    void *data = NULL;
+
+    if(!arena)
+        return realloc(ptr, size);
+
+    if(!ptr)
+        return arena_alloc(arena, size);
+
+    chunk = arena->chunk;
+    old = ArenaAlign(old);
+    if((ptr == chunk->data + chunk->last) && (chunk->last + ArenaAlign(size) <= chunk->size)){
+        /* Extend or shrink in place */
+        arena->used += ArenaAlign(size) - old;
+        chunk->used = chunk->last + ArenaAlign(size);
+        return ptr;
+    }
+
+    if((data = arena_alloc(arena, size))){
+        memcpy(data, ptr, old < size ? old : size);
+    }
+    return data;
+}
+
+/*
+* @brief Free memory, memory from arena is only released with arena
+* @param arena arena, NULL for heap
+* @param ptr memory
+*/
+void arena_free(struct arena *arena, void *ptr)
+{
+    if(!arena)
+        free(ptr);
+}
+
+/*
+* @brief Duplicate string
+* @param arena arena, NULL for heap
+* @param str string, does not need to be null terminated
+* @param len length of string
+* @return null terminated copy of string
+*/
+char* arena_strndup(struct arena *arena, const char *str, size_t len)
+{
+    char *dup = NULL;
+    if((dup = arena_alloc(arena, len + 1))){
+        memcpy(dup, str, len);
+        dup[len] = '\0';
+    }
+    return dup;
+}
+
+/*
+* @brief Take over all memory of other arena, it is released with arena
+* Allocations keep going to current chunk of arena, other arena can not be used anymore.
+* @param arena arena
+* @param other arena to merge, not released separately
+*/
+void arena_merge(struct arena *arena, struct arena *other)
+{
+    struct chunk *last = NULL;
+
+    if(!arena || !other || (arena == other)){
+        TRACE(ERROR, "Invalid arguments");
+        return;
+    }
+    /* Oldest chunk holds arena itself, it has to stay last */
+    for(last = other->chunk; last->next; last = last->next);
+    last->next = arena->chunk->next;
+    arena->chunk->next = other->chunk;
+    arena->used += other->used;
+    arena->reserved += other->reserved;
+}
+
+size_t arena_used(const struct arena *arena)
+{
+    return arena ? arena->used : 0;
+}
+
+size_t arena_reserved(const struct arena *arena)
+{
+    return arena ? arena->reserved : 0;
+}
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "utils.h"
+#include "scan.h"
+#include "structural.h"
+
+#define MODULE "Cursor"
+#include "trace.h"
+
+#define JsonErr(x)          (-(JSON_ERR_BEGIN + (x)))
+#define CURSOR_KEY_SIZE     256     /* Escaped keys up to this length are decoded on stack */
+
+/*
+* @brief Skip value without parsing it
+* Strings are scanned for closing quote, containers for matching bracket
+* and anything else runs till whitespace or structural character.
+* @param start first character of value
+* @param end end of buffer
+* @return pointer after value, NULL if it is not complete
+*/
+static char* skip_value(char *start, char *end)
+{
+    char *temp = NULL;
+
+    if(start >= end)
+        return NULL;
+    switch(*start){
+        case '"':
+            if(!parse_str(start, end, &temp, NULL, NULL))
+                return NULL;
+            return temp;
+        case '{': case '[':
+            return (char*)structural_skip(start, end);
+        case ',': case ':': case '}': case ']':
+            return NULL;
+        default:
+            for(temp = start; (temp < end) && !scan_is_ws(*temp); temp++){
+                if((*temp == ',') || (*temp == '}') || (*temp == ']'))
+                    break;
+            }
+            return temp;
+    }
+}
+
+/*
+* @brief Set cursor at member of container
+* @param start first character of member, key for json object
+* @param end end of buffer
+* @param parent JSON_TYPE_DICT or JSON_TYPE_LIST
+* @param cur cursor to set
+* @return JSON_ERR Value
+*/
+static int cursor_member(char *start, char *end, int parent, struct json_cursor *cur)
+{
+    char *key = NULL;
+    char *temp = NULL;
+    int len = 0;
+
+    if(parent == JSON_TYPE_DICT){
+        if(!(key = parse_str(start, end, &temp, &len, NULL))){
+            TRACE(ERROR, "Missing Key, should start with \"");
+            return JsonErr(JSON_ERR_PARSE);
+        } else if(((start = trim(temp, end)) >= end) || (*start != ':')){
+            TRACE(ERROR, "Missing :");
+            return JsonErr(JSON_ERR_PARSE);
+        }
+        start = trim(start + 1, end);
+    }
+    if((start >= end) || (*start == ',') || (*start == '}') || (*start == ']')){
+        TRACE(ERROR, "Missing Value");
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    cur->start = start;
+    cur->end = end;
+    cur->parent = parent;
+    cur->key = key;
+    cur->len = len;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Compare key of member with a key
+* Escaped key is decoded first, on stack unless it is long.
+* @param cur cursor at member of json object
+* @param key key to compare
+* @param len length of key
+* @return true if keys are same
+*/
+static bool key_equal(const struct json_cursor *cur, const char *key, size_t len)
+{
+    char local[CURSOR_KEY_SIZE];
+    char *buffer = local;
+    bool equal = false;
+    int decoded = 0;
+
+    if(!memchr(cur->key, '\\', cur->len))
+        return ((size_t)cur->len == len) && !memcmp(cur->key, key, len);
+
+    /* Decoded key is never longer than escaped one */
+    if((size_t)cur->len < len)
+        return false;
+    if((cur->len > CURSOR_KEY_SIZE) && !(buffer = malloc(cur->len))){
+        TRACE(ERROR, "Failed to allocate key");
+        return false;
+    }
+    decoded = unescape_str(buffer, cur->key, cur->len);
+    equal = (decoded >= 0) && ((size_t)decoded == len) && !memcmp(buffer, key, len);
+    if(buffer != local)
+        free(buffer);
+    return equal;
+}
+
+/*
+* @brief Set cursor at root of json buffer
+* Buffer is not parsed, values are located when cursor moves to them.
+* Buffer must stay valid while cursors into it are used.
+* @param cur cursor to set
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @return JSON_ERR Value
+*/
+int json_cursor(struct json_cursor *cur, char *start, char *end)
+{
+    if(!cur || !start || !end || (start > end)){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    /* Object should start with { or [ */
+    start = trim(start, end);
+    if((start >= end) || ((*start != '{') && (*start != '['))){
+        TRACE(ERROR, "Failed to parse JSON Object Invalid character %c", (start < end) ? *start : ' ');
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    cur->start = start;
+    cur->end = end;
+    cur->parent = JSON_TYPE_INVALID;
+    cur->key = NULL;
+    cur->len = 0;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Get type of value at cursor from its first character
+* Number is reported as written, integer too large for long becomes
+* JSON_TYPE_UINT or JSON_TYPE_DOUBLE once it is parsed.
+* @param cur cursor
+* @return json type, JSON_TYPE_INVALID if value is not valid
+*/
+int json_cursor_type(const struct json_cursor *cur)
+{
+    char *start = NULL;
+
+    if(!cur || !cur->start || (cur->start >= cur->end)){
+        TRACE(ERROR, "Invalid arguments");
+        return JSON_TYPE_INVALID;
+    }
+    switch(*cur->start){
+        case '{':
+            return JSON_TYPE_DICT;
+        case '[':
+            return JSON_TYPE_LIST;
+        case '"':
+            return JSON_TYPE_STR;
+        case 't': case 'f':
+            return JSON_TYPE_BOOL;
+        case 'n': case 'N':
+            return JSON_TYPE_NULL;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+        case '.': case '+':case '-':
+            start = cur->start + ((*cur->start == '-') || (*cur->start == '+'));
+            if(start >= cur->end)
+                return JSON_TYPE_INVALID;
+            else if(is_float(start, cur->end))
+                return JSON_TYPE_DOUBLE;
+            else if(is_hex(start, cur->end))
+                return JSON_TYPE_HEX;
+            else if(is_octal(start, cur->end))
+                return JSON_TYPE_OCTAL;
+            return JSON_TYPE_INT;
+        default:
+            return JSON_TYPE_INVALID;
+    }
+}
+
+/*
+* @brief Move cursor to next member of its container
+* Value at cursor is skipped, not parsed.
+* @param cur cursor at member of container, unchanged if there is no next member
+* @return JSON_ERR Value, JSON_ERR_KEY_NOT_FOUND at end of container
+*/
+int json_cursor_next(struct json_cursor *cur)
+{
+    char *start = NULL;
+
+    if(!cur || !cur->start || ((cur->parent != JSON_TYPE_DICT) && (cur->parent != JSON_TYPE_LIST))){
+        TRACE(ERROR, "Cursor is not in a container");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    if(!(start = skip_value(cur->start, cur->end))){
+        TRACE(ERROR, "Failed to skip value");
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    if((start = trim(start, cur->end)) >= cur->end){
+        TRACE(ERROR, "Missing %c", (cur->parent == JSON_TYPE_DICT) ? '}' : ']');
+        return JsonErr(JSON_ERR_PARSE);
+    } else if(*start == ','){
+        return cursor_member(trim(start + 1, cur->end), cur->end, cur->parent, cur);
+    } else if(*start == ((cur->parent == JSON_TYPE_DICT) ? '}' : ']')){
+        TRACE(DEBUG, "End of container");
+        return JsonErr(JSON_ERR_KEY_NOT_FOUND);
+    }
+    TRACE(ERROR, "Missing ,");
+    return JsonErr(JSON_ERR_PARSE);
+}
+
+/*
+* @brief Get cursor at member of json object or list by position
+* Members before it are skipped, not parsed.
+* @param cur cursor at json object or list
+* @param index position of member
+* @param child cursor to set at member
+* @return JSON_ERR Value, JSON_ERR_KEY_NOT_FOUND if container has fewer members
+*/
+int json_cursor_index(const struct json_cursor *cur, unsigned int index, struct json_cursor *child)
+{
+    struct json_cursor member;
+    char *start = NULL;
+    int type = JSON_TYPE_INVALID;
+    int status;
+
+    if(!cur || !child || !cur->start || (cur->start >= cur->end)){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    } else if((*cur->start != '{') && (*cur->start != '[')){
+        TRACE(ERROR, "Cursor is not at json object or list");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    type = (*cur->start == '{') ? JSON_TYPE_DICT : JSON_TYPE_LIST;
+    if((start = trim(cur->start + 1, cur->end)) >= cur->end){
+        TRACE(ERROR, "Missing %c", (type == JSON_TYPE_DICT) ? '}' : ']');
+        return JsonErr(JSON_ERR_PARSE);
+    } else if(*start == ((type == JSON_TYPE_DICT) ? '}' : ']')){
+        TRACE(DEBUG, "Empty container");
+        return JsonErr(JSON_ERR_KEY_NOT_FOUND);
+    }
+    if((status = cursor_member(start, cur->end, type, &member)) < 0)
+        return status;
+    for(; index; index--){
+        if((status = json_cursor_next(&member)) < 0)
+            return status;
+    }
+    *child = member;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Get cursor at value for key of json object
+* Members are compared in order, values of other members are skipped, not parsed.
+* First member with the key is found, repeated keys are not checked.
+* @param cur cursor at json object
+* @param key key to find
+* @param child cursor to set at value
+* @return JSON_ERR Value
+*/
+int json_cursor_get(const struct json_cursor *cur, const char *key, struct json_cursor *child)
+{
+    struct json_cursor member;
+    size_t len = 0;
+    int status;
+
+    if(!cur || !key || !child || !cur->start || (cur->start >= cur->end)){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    } else if(*cur->start != '{'){
+        TRACE(ERROR, "Get operation not supported on this json value");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    len = strlen(key);
+    for(status = json_cursor_index(cur, 0, &member); status >= 0; status = json_cursor_next(&member)){
+        if(key_equal(&member, key, len)){
+            *child = member;
+            return JsonErr(JSON_ERR_SUCCESS);
+        }
+    }
+    return status;
+}
@@ -1,137 +1,361 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "dict.h"
-#include "list.h"
 #include "iter.h"
+#include "arena.h"
 
 #define MODULE "Dict"
 #include "trace.h"
 
+/* Initial number of slots in hash index, must be power of 2 */
+#define DICT_INDEX_MIN      8
+/* Initial number of entries */
+#define DICT_ENTRIES_MIN    4
+/* Index slot states, other values are entry position + 1 */
+#define DICT_SLOT_EMPTY     0
+#define DICT_SLOT_DELETED   UINT32_MAX
+/* Key length is stored in 31 bits */
+#define DICT_KEY_MAX        0x80000000UL
+
+/*
+* Entries are kept in insertion order in a contiguous array,
+* the hash index maps key hash to position in the entries array.
+* Deleted entries have NULL key and are skipped until the table is compacted.
+*/
 struct node
 {
-    struct dict *dict;
-    unsigned int flags;
     const char* key;
     const void* val;
+    uint32_t hash;
+    uint32_t len:31;
+    uint32_t ref:1;         /* Key is referenced, not owned by dict */
 };
 
 struct dict
 {
     unsigned int flags;
-    struct list *list;
+    uint32_t count;         /* Live entries */
+    uint32_t used;          /* Entries in use, including deleted */
+    uint32_t size;          /* Allocated entries */
+    uint32_t dead;          /* Deleted index slots */
+    uint32_t mask;          /* Number of index slots - 1 */
+    uint32_t *index;
+    struct node *entries;
+    struct arena *arena;    /* Allocator, NULL for heap */
     dict_cmp_t cmp;
-    dict_free_t free; 
+    dict_free_t free;
     dict_print_t print;
 };
 
 static void* dict_iter_next(const void* data, void* current);
 static void* dict_iter_get(const void* data, void* current);
+static int dict_iter_size(const void* data);
 
-static struct node* node_new(struct dict *dict, const char* key, const void* val)
+/*
+* @brief Hash key, processes 8 bytes at a time
+* @param key key data
+* @param len length of key
+* @return hash value
+*/
+static uint32_t key_hash(const char *key, size_t len)
 {
-    struct node* node = NULL;
-    if( key && val ){
-        if((node = malloc(sizeof(struct node)))){
-            node->key = strdup(key);
-            node->val = val;
-            node->dict = dict;
-            node->flags = 0;
-        } else {
-        TRACE(ERROR,"Failed to allocate dict node");
+    const uint64_t k = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = len * k;
+    uint64_t word = 0;
+
+    for(; len >= sizeof(word); key += sizeof(word), len -= sizeof(word)){
+        memcpy(&word, key, sizeof(word));
+        h = (((h << 5) | (h >> 59)) ^ word) * k;
     }
-    } else {
-        TRACE(ERROR,"Invalid arguments");
+
+    if(len){
+        word = 0;
+        memcpy(&word, key, len);
+        h = (((h << 5) | (h >> 59)) ^ word) * k;
     }
 
-    return node;
+    /* Fold high bits, they are better mixed */
+    return (uint32_t)(h >> 32) ^ (uint32_t)h;
 }
 
-static void node_del(void *data)
+/*
+* @brief Find index slot for key
+* @param dict dictionary
+* @param key key to find
+* @param len length of key
+* @param hash hash of key
+* @param free_slot place holder for first reusable slot if key is not found
+* @return index slot containing the key or -1 if not found
+*/
+static long slot_find(const struct dict *dict, const char *key, uint32_t len, uint32_t hash, long *free_slot)
 {
-    struct node *node = (struct node *)data;
-    if(node){
-        if(node->dict && node->dict->free){
-            node->dict->free((void*)node->val);
+    uint32_t i;
+    uint32_t slot;
+    struct node *node;
+    long reuse = -1;
+
+    if(dict->index){
+        for(i = hash & dict->mask;; i = (i + 1) & dict->mask){
+            slot = dict->index[i];
+            if(slot == DICT_SLOT_EMPTY){
+                if(reuse < 0)
+                    reuse = i;
+                break;
+            } else if(slot == DICT_SLOT_DELETED){
+                if(reuse < 0)
+                    reuse = i;
+            } else {
+                node = &dict->entries[slot - 1];
+                if((node->hash == hash) && (node->len == len) && (memcmp(node->key, key, len) == 0)){
+                    return i;
+                }
+            }
         }
-        free((void*)node->key);
-        free(node);
-    } else {
-        TRACE(ERROR,"Invalid arguments");
     }
+
+    if(free_slot)
+        *free_slot = reuse;
+    return -1;
 }
 
-static int node_print(const void* stream, unsigned int index, const void *data)
+/*
+* @brief Rebuild index with given number of slots, dropping deleted entries
+* @param dict dictionary
+* @param slots number of slots, power of 2
+* @return 0 on success
+*/
+static int dict_rehash(struct dict *dict, uint32_t slots)
 {
-    struct node *node = (struct node *)data;
-    int ret = 0;
-    if(node && node->dict){
-        ret = node->dict->print(stream, index, node->key, node->val);
-    } else {
-        TRACE(ERROR,"Invalid arguments");
+    uint32_t *index = NULL;
+    uint32_t i, j, n;
+    struct node *node;
+
+    if(!(index = arena_alloc(dict->arena, slots * sizeof(uint32_t)))){
+        TRACE(ERROR,"Failed to allocate dict index");
+        return -1;
     }
+    memset(index, 0, slots * sizeof(uint32_t));
 
-    return ret;
+    /* Compact entries, keeping insertion order */
+    for(i = 0, n = 0; i < dict->used; i++){
+        node = &dict->entries[i];
+        if(!node->key)
+            continue;
+        if(n != i)
+            dict->entries[n] = *node;
+        for(j = node->hash & (slots - 1); index[j] != DICT_SLOT_EMPTY; j = (j + 1) & (slots - 1));
+        index[j] = n + 1;
+        n++;
+    }
+
+    arena_free(dict->arena, dict->index);
+    dict->index = index;
+    dict->mask = slots - 1;
+    dict->used = n;
+    dict->dead = 0;
+    return 0;
 }
 
-static int node_cmp(const void* data1, const void* data2)
+/*
+* @brief Make room for one more entry
+* @param dict dictionary
+* @return 0 on success
+*/
+static int dict_reserve(struct dict *dict)
 {
-    struct node *node1 = (struct node *)data1;
-    struct node *node2 = (struct node *)data2;
-    return strcmp(node1->key, node2->key);
+    struct node *entries = NULL;
+    uint32_t size;
+    uint32_t slots;
+
+    /* Grow entries */
+    if(dict->used >= dict->size){
+        if(dict->count < dict->used / 2){
+            /* Mostly deleted entries, compact instead of growing */
+            return dict_rehash(dict, dict->mask + 1);
+        }
+        size = dict->size ? dict->size * 2 : DICT_ENTRIES_MIN;
+        if(!(entries = arena_realloc(dict->arena, dict->entries, dict->size * sizeof(struct node), size * sizeof(struct node)))){
+            TRACE(ERROR,"Failed to allocate dict entries");
+            return -1;
+        }
+        dict->entries = entries;
+        dict->size = size;
+    }
+
+    /* Keep load factor of index below 3/4, deleted slots still count */
+    slots = dict->index ? dict->mask + 1 : DICT_INDEX_MIN;
+    if(!dict->index || ((dict->count + dict->dead + 1) * 4 > slots * 3)){
+        /* Size for live entries only, rehash drops deleted slots */
+        for(; (dict->count + 1) * 4 > slots * 3; slots *= 2);
+        return dict_rehash(dict, slots);
+    }
+    return 0;
+}
+
+/*
+* @brief Remove entry at given index slot
+* @param dict dictionary
+* @param slot index slot
+*/
+static void dict_remove(struct dict *dict, long slot)
+{
+    struct node *node = &dict->entries[dict->index[slot] - 1];
+    if(dict->free){
+        dict->free((void*)node->val);
+    }
+    if(!node->ref)
+        arena_free(dict->arena, (void*)node->key);
+    node->key = NULL;
+    node->val = NULL;
+    dict->index[slot] = DICT_SLOT_DELETED;
+    dict->dead++;
+    dict->count--;
+
+    /* Trailing deleted entries can be reused right away */
+    while(dict->used && !dict->entries[dict->used - 1].key){
+        dict->used--;
+    }
 }
 
 struct dict* dict_new(dict_free_t f, dict_cmp_t cmp, dict_print_t print)
+{
+    return dict_new_arena(NULL, f, cmp, print);
+}
+
+/*
+* @brief Create dict which allocates all its memory from arena
+* @param arena arena, NULL for heap
+* @param f function to free values
+* @param cmp function to compare values
+* @param print function to print key value pair
+* @return dict
+*/
+struct dict* dict_new_arena(struct arena *arena, dict_free_t f, dict_cmp_t cmp, dict_print_t print)
 {
     struct dict* dict = NULL;
-    if((dict = malloc(sizeof(struct dict)))){
+    if((dict = arena_alloc(arena, sizeof(struct dict)))){
+        memset(dict, 0, sizeof(struct dict));
+        dict->arena = arena;
         dict->print = print;
         dict->free = f;
         dict->cmp = cmp;
-        dict->list = list_new((list_free_t)node_del, (list_cmp_t)node_cmp, (list_print_t)node_print);
     } else {
         TRACE(ERROR,"Failed to allocate dict");
     }
     return dict;
 }
 
-int dict_set(struct dict *dict, const char* key, const void* val)
+/*
+* @brief Insert key in dict with a single lookup
+* @param dict dictionary
+* @param key key
+* @param len length of key
+* @param val value for key
+* @param replace replace value of existing key
+* @param old place holder for existing value of key
+* @param ref keep reference to key instead of copying it
+* @return size of dict or -1 for error
+*/
+static int dict_insert(struct dict *dict, const char* key, size_t len, const void* val, bool replace, void** old, bool ref)
 {
     int ret = -1;
     struct node *node = NULL;
-    struct node temp = {0};
-    temp.key = key;
-    temp.val = val;
-    temp.dict = dict;
-    int index = 0;
+    char *dup = NULL;
+    uint32_t hash;
+    long slot, free_slot = -1;
 
-    if(dict && key){
-        if((index = list_find(dict->list, &temp)) >= 0){
-            TRACE(INFO, "Found entry @%d", index);
-            if(val){
-                if((node = (struct node*)list_get(dict->list, index))){
-                    if(dict->free){
-                        TRACE(DEBUG, "Free Previous Value %p", node->val);
-                        dict->free((void*)node->val);
-                    }
-                    node->val = val;
-                    ret = list_size(dict->list);
-                } else {
-                    TRACE(ERROR, "Internal error dict entry at %d got deleted", index);
-                }
-            } else {
-                TRACE(INFO, "Delete Key:%s", key);
-                list_remove(dict->list, index);
-                ret = list_size(dict->list);
+    if(old)
+        *old = NULL;
+
+    if(dict && key && val && (len < DICT_KEY_MAX)){
+        hash = key_hash(key, len);
+        /* Reserve first, so that the lookup below also gives the insertion slot */
+        if((dict_reserve(dict)) < 0){
+            TRACE(ERROR, "Insertion failed");
+        } else if((slot = slot_find(dict, key, len, hash, &free_slot)) >= 0){
+            node = &dict->entries[dict->index[slot] - 1];
+            if(old)
+                *old = (void*)node->val;
+            if(replace)
+                node->val = val;
+            ret = dict->count;
+        } else if(!ref && !(dup = arena_alloc(dict->arena, len + 1))){
+            TRACE(ERROR, "Insertion failed");
+        } else {
+            if(dup){
+                memcpy(dup, key, len);
+                dup[len] = '\0';
             }
-        } else if( val && ((node = node_new(dict, key, val)))){
-            if((list_add(dict->list, node)) < 0){
-                TRACE(ERROR, "Insertion failed");
-                node_del(node);
-            } else {
-                ret = list_size(dict->list);
+            node = &dict->entries[dict->used];
+            node->key = dup ? dup : key;
+            node->val = val;
+            node->hash = hash;
+            node->len = len;
+            node->ref = ref;
+            if(dict->index[free_slot] == DICT_SLOT_DELETED)
+                dict->dead--;
+            dict->index[free_slot] = ++dict->used;
+            ret = ++dict->count;
+        }
+    } else {
+        TRACE(ERROR,"Invalid arguments");
+    }
+    return ret;
+}
+
+/*
+* @brief Add key to dict with a single lookup
+* If key is already present, nothing is inserted and existing value is returned in old,
+* existing value is replaced only when replace is set, replaced value is not freed.
+* @param dict dictionary
+* @param key key, does not need to be null terminated
+* @param len length of key
+* @param val value for key
+* @param replace replace value of existing key
+* @param old place holder for existing value of key, NULL if key was inserted
+* @return size of dict or -1 for error
+*/
+int dict_add(struct dict *dict, const char* key, size_t len, const void* val, bool replace, void** old)
+{
+    return dict_insert(dict, key, len, val, replace, old, false);
+}
+
+/*
+* @brief Add key to dict without copying it, same as dict_add otherwise
+* @param dict dictionary
+* @param key key, must be null terminated at len and outlive the dict
+* @param len length of key
+* @param val value for key
+* @param replace replace value of existing key
+* @param old place holder for existing value of key, NULL if key was inserted
+* @return size of dict or -1 for error
+*/
+int dict_add_ref(struct dict *dict, const char* key, size_t len, const void* val, bool replace, void** old)
+{
+    return dict_insert(dict, key, len, val, replace, old, true);
+}
+
+int dict_set(struct dict *dict, const char* key, const void* val)
+{
+    int ret = -1;
+    void *old = NULL;
+    size_t len;
+    long slot;
+
+    if(dict && key){
+        len = strlen(key);
+        if(val){
+            if(((ret = dict_add(dict, key, len, val, true, &old)) >= 0) && old && dict->free){
+                TRACE(DEBUG, "Free Previous Value %p", old);
+                dict->free(old);
             }
-        } else if(!val){
+        } else if((slot = slot_find(dict, key, len, key_hash(key, len), NULL)) >= 0){
+            TRACE(INFO, "Delete Key:%s", key);
+            dict_remove(dict, slot);
+            ret = dict->count;
+        } else {
             TRACE(WARN, "Key Not Found : %s", key);
         }
     } else {
@@ -143,21 +367,12 @@ int dict_set(struct dict *dict, const char* key, const void* val)
 void* dict_get(const struct dict* dict, const char* key)
 {
     void *data = NULL;
-    struct node *node = NULL;
-    struct node temp = {0};
-    temp.key = (char*)key;
-    temp.val = NULL;
-    temp.dict = (struct dict*)dict;
-    int index = 0;
+    size_t len;
+    long slot;
     if(dict && key){
-         if((index = list_find(dict->list, &temp)) >= 0){
-             if((node = list_get(dict->list, index))){
-                data = (void*)node->val;
-             } else {
-                 TRACE(ERROR, "Internal error dict entry at %d got deleted", index);
-             }
-         } else {
-            //TRACE(INFO,"Failed to find key:%s", key);
+        len = strlen(key);
+        if((slot = slot_find(dict, key, len, key_hash(key, len), NULL)) >= 0){
+            data = (void*)dict->entries[dict->index[slot] - 1].val;
         }
     } else {
         TRACE(ERROR,"Invalid arguments");
@@ -167,9 +382,20 @@ void* dict_get(const struct dict* dict, const char* key)
 
 void dict_del(struct dict* dict)
 {
+    uint32_t i;
     if(dict){
-        list_del(dict->list);
-        free(dict);
+        for(i = 0; i < dict->used; i++){
+            if(dict->entries[i].key){
+                if(dict->free){
+                    dict->free((void*)dict->entries[i].val);
+                }
+                if(!dict->entries[i].ref)
+                    arena_free(dict->arena, (void*)dict->entries[i].key);
+            }
+        }
+        arena_free(dict->arena, dict->entries);
+        arena_free(dict->arena, dict->index);
+        arena_free(dict->arena, dict);
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
@@ -178,8 +404,13 @@ void dict_del(struct dict* dict)
 int dict_print(const struct dict* dict, const void* stream)
 {
     int ret = 0;
-    if(dict){
-        ret = list_print(dict->list, stream);
+    uint32_t i, n;
+    if(dict && dict->print){
+        for(i = 0, n = 0; i < dict->used; i++){
+            if(dict->entries[i].key){
+                ret += dict->print(stream, n++, dict->entries[i].key, dict->entries[i].val);
+            }
+        }
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
@@ -188,26 +419,27 @@ int dict_print(const struct dict* dict, const void* stream)
 
 static void* dict_iter_next(const void* data, void* current)
 {
-    struct iter *iter = (struct iter*)data;
-    if(iter){
-        if(!current){
-            /* Make Sure to reset*/
-            iter_reset(iter);
-        }
-        return iter_next(iter);
+    const struct dict *dict = (const struct dict*)data;
+    struct node *node = (struct node*)current;
+    struct node *last = NULL;
+    if(dict){
+        if(!dict->entries)
+            return NULL;
+        last = &dict->entries[dict->used];
+        /* Start from beginning when there is no current entry */
+        for(node = node ? node + 1 : dict->entries; (node < last) && !node->key; node++);
+        return (node < last) ? node : NULL;
     } else {
-        TRACE(ERROR,"Null iter");
+        TRACE(ERROR,"Null Dict");
     }
     return NULL;
 }
 
 static void* dict_iter_get(const void* data, void* current)
 {
-    struct iter *iter = (struct iter*)data;
-    struct node *node = NULL;
-    if(iter){
-        if((node = iter_get(iter)))
-            return (void*)node->key;
+    struct node *node = (struct node*)current;
+    if(data && node){
+        return (void*)node->key;
     } else {
         TRACE(ERROR,"Null Dict");
     }
@@ -216,9 +448,9 @@ static void* dict_iter_get(const void* data, void* current)
 
 static int dict_iter_size(const void* data)
 {
-    struct iter *iter = (struct iter*)data;
-    if(iter){
-        return iter_size(iter);
+    const struct dict *dict = (const struct dict*)data;
+    if(dict){
+        return dict->count;
     } else {
         TRACE(ERROR, "Invalid argumets");
     }
@@ -227,30 +459,32 @@ static int dict_iter_size(const void* data)
 
 struct iter* dict_iter(const struct dict* dict)
 {
-    struct iter* l_iter = NULL;
-    struct iter* d_iter = NULL;
+    struct iter* iter = NULL;
     if(dict){
-        if((l_iter = list_iter(dict->list))){
-            if((d_iter = iter_new(l_iter, (iter_free_t)iter_del, dict_iter_get, dict_iter_next, dict_iter_size))){
-                return d_iter;
-            } else {
-                 TRACE(ERROR, "Failed to create iter");
-                 iter_del(l_iter);
-            }
-        } else {
+        if(!(iter = iter_new(dict, NULL, dict_iter_get, dict_iter_next, dict_iter_size))){
             TRACE(ERROR, "Failed to create iter");
         }
     } else {
         TRACE(ERROR,"Null Dict");
     }
-    return NULL;
+    return iter;
+}
+
+/*
+* @brief Get arena used by dict
+* @param dict dict
+* @return arena or NULL for heap
+*/
+struct arena* dict_arena(const struct dict *dict)
+{
+    return dict ? dict->arena : NULL;
 }
 
 int dict_size(const struct dict *dict)
 {
     int len = -1;
     if(dict){
-        len = list_size(dict->list);
+        len = dict->count;
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
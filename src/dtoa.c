@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "pow5.h"
+#include "dtoa.h"
+#include "itoa.h"
+
+#define DOUBLE_MANTISSA_BITS    52
+#define DOUBLE_EXP_BIAS         1023
+#define DOUBLE_EXP_INF          0x7FF
+/* Precision of powers of 5 used by Ryu */
+#define RYU_POW5_BITS           125
+/* Largest q for which pow5_128 entry of 5^-q is rounded up instead of truncated */
+#define POW5_ROUNDED_MAX        27
+/* Decimal exponents printed without exponent, same as repr of Python */
+#define FIXED_POINT_MIN         (-3)
+#define FIXED_POINT_MAX         16
+
+/*
+* @brief ceil(log2(5^e)), 1 for e = 0
+* @param e exponent, at most 3528
+* @return bits
+*/
+static inline int pow5_bits(int e)
+{
+    return (int)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+/*
+* @brief floor(log10(2^e))
+* @param e exponent, at most 1650
+* @return decimal exponent
+*/
+static inline int log10_pow2(int e)
+{
+    return (int)(((uint32_t)e * 78913) >> 18);
+}
+
+/*
+* @brief floor(log10(5^e))
+* @param e exponent, at most 2620
+* @return decimal exponent
+*/
+static inline int log10_pow5(int e)
+{
+    return (int)(((uint32_t)e * 732923) >> 20);
+}
+
+/*
+* @brief Check if 5^p divides value
+* @param value number, not zero
+* @param p power
+* @return true if value is multiple of 5^p
+*/
+static inline bool multiple_of_pow5(uint64_t value, int p)
+{
+    int count = 0;
+
+    for(; !(value % 5); value /= 5)
+        count++;
+    return count >= p;
+}
+
+/*
+* @brief Check if 2^p divides value
+* @param value number
+* @param p power, less than 64
+* @return true if value is multiple of 2^p
+*/
+static inline bool multiple_of_pow2(uint64_t value, int p)
+{
+    return !(value & ((1ULL << p) - 1));
+}
+
+/*
+* @brief 5^i truncated to 125 bits
+* Taken from 128 bit table, shift of a truncated value is still truncated.
+* @param i power, 0 to POW5_128_MAX
+* @param mul placeholder for {low, high}
+*/
+static inline void ryu_pow5(int i, uint64_t mul[2])
+{
+    const uint64_t *pow5 = pow5_128[i - POW5_128_MIN];
+
+    mul[0] = (pow5[1] >> 3) | (pow5[0] << 61);
+    mul[1] = pow5[0] >> 3;
+}
+
+/*
+* @brief floor(2^(pow5_bits(q) - 1 + 125) / 5^q) + 1
+* Taken from 128 bit table of 2^b / 5^q, after removing its rounding.
+* @param q power, 0 to -POW5_128_MIN
+* @param mul placeholder for {low, high}
+*/
+static inline void ryu_pow5_inv(int q, uint64_t mul[2])
+{
+    const uint64_t *pow5 = pow5_128[-q - POW5_128_MIN];
+    uint64_t high = pow5[0], low = pow5[1];
+
+    if(!q){
+        /* 2^125 + 1, table has 5^0 exactly */
+        mul[0] = 1;
+        mul[1] = 1ULL << 61;
+        return;
+    }
+    if((q <= POW5_ROUNDED_MAX) && !low--)
+        high--;
+    mul[0] = ((low >> 3) | (high << 61)) + 1;
+    mul[1] = (high >> 3) + !mul[0];
+}
+
+/*
+* @brief (m * mul) >> j
+* @param m number, at most 55 bits
+* @param mul 125 bit {low, high}
+* @param j shift, 64 < j < 128
+* @return lower 64 bits of result
+*/
+static inline uint64_t mul_shift(uint64_t m, const uint64_t mul[2], int j)
+{
+    uint64_t high0, high1, low1, mid;
+
+    mul128(m, mul[0], &high0);
+    low1 = mul128(m, mul[1], &high1);
+    mid = high0 + low1;
+    high1 += (mid < high0);
+    j -= 64;
+    return (high1 << (64 - j)) | (mid >> j);
+}
+
+/*
+* @brief Shortest decimal which rounds to the double, Ryu algorithm by Ulf Adams
+* Interval of decimals which round to the double is computed with 125 bit powers of 5,
+* digits are then removed while both ends of the interval still differ.
+* @param mantissa stored mantissa bits
+* @param exponent stored exponent bits, double is finite and not zero
+* @param exp10 placeholder for decimal exponent
+* @return decimal mantissa, at most 17 digits
+*/
+static uint64_t ryu(uint64_t mantissa, int exponent, int *exp10)
+{
+    uint64_t mul[2];
+    uint64_t m2, mv, vr, vp, vm, output;
+    bool even, vm_zeros = false, vr_zeros = false, round_up = false;
+    int e2, q, k, i, mm_shift, removed = 0, last = 0;
+
+    if(exponent){
+        e2 = exponent - DOUBLE_EXP_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = (1ULL << DOUBLE_MANTISSA_BITS) | mantissa;
+    } else {
+        e2 = 1 - DOUBLE_EXP_BIAS - DOUBLE_MANTISSA_BITS - 2;
+        m2 = mantissa;
+    }
+    /* Ends of interval are included when mantissa is even, ties round to even */
+    even = !(m2 & 1);
+    mv = 4 * m2;
+    /* Lower end is closer when mantissa is power of 2 */
+    mm_shift = (mantissa || (exponent <= 1));
+
+    /* Interval scaled by power of 10, vm < vr < vp */
+    if(e2 >= 0){
+        q = log10_pow2(e2) - (e2 > 3);
+        *exp10 = q;
+        k = RYU_POW5_BITS + pow5_bits(q) - 1;
+        i = -e2 + q + k;
+        ryu_pow5_inv(q, mul);
+        vr = mul_shift(mv, mul, i);
+        vp = mul_shift(mv + 2, mul, i);
+        vm = mul_shift(mv - 1 - mm_shift, mul, i);
+        if(q <= 21){
+            /* Only one of mv, mv - 1 and mv + 2 can be multiple of 5 */
+            if(!(mv % 5))
+                vr_zeros = multiple_of_pow5(mv, q);
+            else if(even)
+                vm_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+            else
+                vp -= multiple_of_pow5(mv + 2, q);
+        }
+    } else {
+        q = log10_pow5(-e2) - (-e2 > 1);
+        *exp10 = q + e2;
+        i = -e2 - q;
+        k = pow5_bits(i) - RYU_POW5_BITS;
+        ryu_pow5(i, mul);
+        vr = mul_shift(mv, mul, q - k);
+        vp = mul_shift(mv + 2, mul, q - k);
+        vm = mul_shift(mv - 1 - mm_shift, mul, q - k);
+        if(q <= 1){
+            /* mv has at least q trailing zero bits */
+            vr_zeros = true;
+            if(even)
+                vm_zeros = (mm_shift == 1);
+            else
+                vp--;
+        } else if(q < 63){
+            vr_zeros = multiple_of_pow2(mv, q);
+        }
+    }
+
+    /* Remove digits while interval still holds a shorter decimal */
+    if(vm_zeros || vr_zeros){
+        /* Rare case, exact ends and ties need care */
+        while(vp / 10 > vm / 10){
+            vm_zeros &= !(vm % 10);
+            vr_zeros &= !last;
+            last = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if(vm_zeros){
+            while(!(vm % 10)){
+                vr_zeros &= !last;
+                last = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        /* Exactly halfway, round to even */
+        if(vr_zeros && (last == 5) && !(vr & 1))
+            last = 4;
+        output = vr + (((vr == vm) && (!even || !vm_zeros)) || (last >= 5));
+    } else {
+        if(vp / 100 > vm / 100){
+            round_up = (vr % 100) >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while(vp / 10 > vm / 10){
+            round_up = (vr % 10) >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + ((vr == vm) || round_up);
+    }
+    *exp10 += removed;
+    return output;
+}
+
+/*
+* @brief Print double with fewest digits which parse back to the same double
+* Output is same as repr of Python, it does not depend on locale and always has
+* a fraction or exponent so that it is parsed back as double.
+* Fixed notation is used for decimal exponents from -4 to 15, like 0.001 and 12.5,
+* others use exponent, like 1e+16 and 2.5e-05. Not finite values are printed as nan and inf.
+* @param value double
+* @param buffer Placeholder for output, at least DTOA_SIZE bytes, not null terminated
+* @return length of output
+*/
+int format_double(double value, char *buffer)
+{
+    char digits[24];
+    char *pos = buffer;
+    uint64_t bits, mantissa, output;
+    int exponent, exp10 = 0, len, point;
+
+    memcpy(&bits, &value, sizeof(bits));
+    mantissa = bits & ((1ULL << DOUBLE_MANTISSA_BITS) - 1);
+    exponent = (int)((bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_EXP_INF);
+
+    if(exponent == DOUBLE_EXP_INF){
+        if(mantissa){
+            memcpy(pos, "nan", 3);
+            return 3;
+        }
+        if(bits >> 63)
+            *pos++ = '-';
+        memcpy(pos, "inf", 3);
+        return pos + 3 - buffer;
+    }
+    if(bits >> 63)
+        *pos++ = '-';
+    if(!exponent && !mantissa){
+        memcpy(pos, "0.0", 3);
+        return pos + 3 - buffer;
+    }
+
+    output = ryu(mantissa, exponent, &exp10);
+    len = format_uint(output, digits);
+    /* Position of decimal point from first digit */
+    point = len + exp10;
+
+    if((point >= FIXED_POINT_MIN) && (point <= FIXED_POINT_MAX)){
+        if(point <= 0){
+            /* 0.000ddd */
+            memcpy(pos, "0.000", 2 - point);
+            memcpy(pos + 2 - point, digits, len);
+            pos += 2 - point + len;
+        } else if(point >= len){
+            /* ddd000.0 */
+            memcpy(pos, digits, len);
+            memset(pos + len, '0', point - len);
+            memcpy(pos + point, ".0", 2);
+            pos += point + 2;
+        } else {
+            /* dd.ddd */
+            memcpy(pos, digits, point);
+            pos[point] = '.';
+            memcpy(pos + point + 1, digits + point, len - point);
+            pos += len + 1;
+        }
+        return pos - buffer;
+    }
+
+    /* d.ddde+xx */
+    *pos++ = digits[0];
+    if(len > 1){
+        *pos++ = '.';
+        memcpy(pos, digits + 1, len - 1);
+        pos += len - 1;
+    }
+    *pos++ = 'e';
+    exp10 = point - 1;
+    if(exp10 < 0){
+        *pos++ = '-';
+        exp10 = -exp10;
+    } else {
+        *pos++ = '+';
+    }
+    if(exp10 >= 100){
+        *pos++ = '0' + exp10 / 100;
+        exp10 %= 100;
+    }
+    memcpy(pos, itoa_digits + exp10 * 2, 2);
+    return pos + 2 - buffer;
+}
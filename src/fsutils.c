@@ -6,7 +6,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <errno.h>
+#include <stdint.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include "fsutils.h"
 
 #define BUFFER_SIZE 1024
@@ -261,74 +264,131 @@ FILE *fdmemopen(char ***buffer, size_t **size)
     return funopen(mem, read_buffer, write_buffer, seek_buffer, close_buffer);
 }
 
+/*
+* @brief Read all data from file descriptor till end of file
+* Buffer grows as data arrives, so that pipes and files without size can be read.
+* @param fd File descriptor
+* @param size Expected size of data, 0 if unknown
+* @param len Pointer where length of read data will be saved
+* @return NULL terminated buffer where data is read
+*/
+static char* readfd(int fd, size_t size, size_t *len)
+{
+    char *buffer = NULL;
+    char *temp = NULL;
+    size_t index = 0;
+    ssize_t rlen;
+
+    size = size ? size + 1 : BUFFER_SIZE;
+    if(!(buffer = malloc(size))){
+        fprintf(stderr, "%s:%d>Failed to allocate memeory", __func__, __LINE__);
+        return NULL;
+    }
+    for(;;){
+        /* Keep room for NULL termination */
+        if(index + 1 >= size){
+            if(!(temp = realloc(buffer, size * 2))){
+                fprintf(stderr, "%s:%d>Failed to allocate memeory", __func__, __LINE__);
+                free(buffer);
+                return NULL;
+            }
+            buffer = temp;
+            size *= 2;
+        }
+        if((rlen = read(fd, &buffer[index], size - index - 1)) > 0){
+            index += rlen;
+        } else if(!rlen){
+            break;
+        } else if(errno != EINTR){
+            fprintf(stderr, "%s:%d>Failed to read file", __func__, __LINE__);
+            free(buffer);
+            return NULL;
+        }
+    }
+    /* Make sure to NULL terminate */
+    buffer[index] = '\0';
+    if(len)
+        *len = index;
+    return buffer;
+}
+
 /*
 * @brief Open a file in read mode and read all data in buffer
 * @param fname filename 
 * @param len Pointer where length of read data will be saved
 * @return Buffer where data is read
 */
-char* readall(const char *fname, unsigned int *len)
+char* readall(const char *fname, size_t *len)
 {
-    int fd, rlen;
-    char *buffer;
-    off_t size = 0;
-    int index = 0;
+    struct stat st;
+    char *buffer = NULL;
+    int fd;
 
     /* Check data */
-    if(fname){
-        /* Open File */
-        if((fd = open(fname, O_RDONLY)) >= 0){
-            /* Goto end of file */
-            if((size = lseek(fd, 0, SEEK_END)) > 0){
-                /* Retrun to beginning */
-                lseek(fd, 0, SEEK_SET);
-
-                /* File needs to be in memeory */
-                /* Allocate buffer for file data */
-                if((buffer = malloc(size + 1))){
-                    
-                    /* Read entire file in buffer */
-                    for(index = 0; index < size; index += rlen){
-                        /* Read data from file */
-                        rlen = read(fd, &buffer[index], size - index);
-                        if(rlen < 0){
-                            /* Dara read error */
-                            fprintf(stderr, "%s:%d>Failed to read file : %s", __func__, __LINE__, fname);
-                            /* Free buffer */
-                            free(buffer);
-                            break;
-                        }
-                    }
-                    
-                    /* Check if all data was read, do not process incomplete data */
-                    if(index == size ){  
-                      /* Make sure to NULL terminate */
-                      buffer[index] = '\0';  
-                        if(len)
-                            *len = (unsigned int)size;
-                        close(fd);
-                        return buffer;
-                    } else {
-                        /* Free Buffer */
-                        free(buffer);
-                    }
-                } else {
-                    /* Memory allocation failure */
-                    fprintf(stderr, "%s:%d>Failed to allocate memeory", __func__, __LINE__);
-                }
-            } else {
-                /* Seek Fail, might have holes */
-                fprintf(stderr, "%s:%d>Failed to seek in file", __func__, __LINE__);
-            }
-            close(fd);
-        } else {   
-            /* File open fail*/          
-            fprintf(stderr, "%s:%d>Failed to open file : %s", __func__, __LINE__,fname);
-        } 
-    } else {
-        /* Invalid parameters */
+    if(!fname){
         fprintf(stderr, "%s:%d>Invalid params", __func__, __LINE__);
+        return NULL;
     }
-    return NULL;
+    if((fd = open(fname, O_RDONLY)) < 0){
+        fprintf(stderr, "%s:%d>Failed to open file : %s", __func__, __LINE__, fname);
+        return NULL;
+    }
+    /* Size is only a hint, file may change while it is read */
+    buffer = readfd(fd, (!fstat(fd, &st) && S_ISREG(st.st_mode)) ? (size_t)st.st_size : 0, len);
+    close(fd);
+    return buffer;
+}
+
+/*
+* @brief Map a file read only, or read it in buffer if it can not be mapped
+* Regular files are mapped for sequential access without copying them,
+* pipes and other files are read till end of file.
+* Buffer is released with unmapall, it is not NULL terminated when mapped.
+* @param fname filename
+* @param len Pointer where length of data will be saved
+* @param mapped Pointer where true is saved if file is mapped
+* @return Buffer with file data
+*/
+char* mapall(const char *fname, size_t *len, bool *mapped)
+{
+    struct stat st;
+    char *buffer = NULL;
+    int fd;
+
+    if(!fname || !len || !mapped){
+        fprintf(stderr, "%s:%d>Invalid params", __func__, __LINE__);
+        return NULL;
+    }
+    *mapped = false;
+    if((fd = open(fname, O_RDONLY)) < 0){
+        fprintf(stderr, "%s:%d>Failed to open file : %s", __func__, __LINE__, fname);
+        return NULL;
+    }
+    if(fstat(fd, &st) || !S_ISREG(st.st_mode) || (st.st_size <= 0) || ((uint64_t)st.st_size > SIZE_MAX)){
+        /* Pipe, device or file which reports no size */
+        buffer = readfd(fd, 0, len);
+    } else if((buffer = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED){
+        /* Pages are read ahead and can be dropped once they are parsed */
+        madvise(buffer, st.st_size, MADV_SEQUENTIAL);
+        *len = st.st_size;
+        *mapped = true;
+    } else {
+        buffer = readfd(fd, st.st_size, len);
+    }
+    close(fd);
+    return buffer;
 }
 
+/*
+* @brief Release buffer returned by mapall
+* @param buffer Buffer with file data
+* @param len Length of data
+* @param mapped true if file was mapped
+*/
+void unmapall(char *buffer, size_t len, bool mapped)
+{
+    if(mapped)
+        munmap(buffer, len);
+    else
+        free(buffer);
+}
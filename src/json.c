@@ -2,12 +2,23 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "json.h"
 #include "fsutils.h"
 #include "utils.h"
 #include "list.h"
 #include "dict.h"
 #include "iter.h"
+#include "arena.h"
+#include "structural.h"
+#include "scan.h"
+#include "pool.h"
+#include "writer.h"
+#include "dtoa.h"
+#include "itoa.h"
 #define MODULE "JSON"
 #include "trace.h"
 
@@ -15,11 +26,26 @@
 #define JsonErr(x)          (-(JSON_ERR_BEGIN + (x)))
 #define JSON_MAX_VAL_SIZE   (sizeof(double))
 #define MIN2(x,y)           ((x)<(y)?(x):(y))
+#define MAX2(x,y)           ((x)>(y)?(x):(y))
+#define PARSER_STACK_INIT   32
+#define PARALLEL_MIN        (1024 * 1024)   /* Smaller buffers are parsed by one thread */
+#define PARALLEL_PARTS      4               /* Parts of list for each thread, to balance load */
+#define PARALLEL_PARTS_MAX  256
+
+/* Json value flags */
+enum json_flags
+{
+    JSON_FLAG_ARENA = 0x01,     /* Memory is owned by an arena */
+    JSON_FLAG_DOC   = 0x02,     /* Root of a document, owns the arena */
+    JSON_FLAG_REF   = 0x04,     /* String references input buffer */
+};
 
 /*  Json Value */
 struct json
 {
-    int type;
+    uint16_t type;
+    uint16_t flags;
+    uint32_t len;               /* Length of string value */
     union
     {
         bool boolean;
@@ -34,37 +60,166 @@ struct json
     };
 };
 
+/* Document root, allocated from its own arena */
+struct json_doc
+{
+    struct json json;
+    struct arena *arena;
+};
+
+/* Container being parsed */
+struct frame
+{
+    int type;                   /* JSON_TYPE_DICT or JSON_TYPE_LIST */
+    void *obj;                  /* Dict or list being built */
+    char *key;                  /* Key of member being parsed, NULL if it is on key stack */
+    int len;
+    size_t mark;                /* Offset of key on key stack */
+};
+
+/* Value other than object or list, as found by tokenizer */
+struct token
+{
+    int type;
+    int len;                    /* Length of string */
+    union
+    {
+        bool boolean;
+        unsigned int uint_number;
+        long long_number;
+        double double_number;
+        char *str;
+    };
+};
+
+/* Parser states */
+enum parse_state
+{
+    PARSE_OPEN,                 /* At { or [ */
+    PARSE_MEMBER,               /* At next member of container */
+    PARSE_VALUE,                /* At value */
+    PARSE_NEXT,                 /* Value reported, at , or end of container */
+    PARSE_CLOSE,                /* At } or ] */
+    PARSE_DONE,
+    PARSE_ERROR,
+};
+
+/* Parser context */
+struct parser
+{
+    const struct json_opts *opts;
+    struct arena *arena;        /* Arena for document, NULL for heap */
+    char *scratch;              /* Buffer to decode escaped strings and keys */
+    size_t scratch_size;
+    char *keys;                 /* Decoded keys of open objects */
+    size_t keys_size;
+    size_t keys_used;
+    struct json *root;          /* Document once it is complete */
+    struct frame *stack;        /* Open containers, innermost last */
+    struct frame local[PARSER_STACK_INIT];  /* Initial stack, enough for most documents */
+    unsigned int depth;
+    unsigned int stack_size;
+    unsigned int max_depth;
+};
+
+/* Push parser states, each of them starts between tokens */
+enum stream_state
+{
+    STREAM_ROOT,                /* Before document */
+    STREAM_FIRST,               /* After { or [, at first member or end of container */
+    STREAM_MEMBER,              /* After , at next member */
+    STREAM_COLON,               /* After key */
+    STREAM_VALUE,               /* After : at value */
+    STREAM_NEXT,                /* After value, at , or end of container */
+    STREAM_DONE,                /* Document complete, only whitespace may follow */
+};
+
+/* Token which is not complete in current chunk */
+enum stream_token
+{
+    STREAM_NONE,
+    STREAM_KEY,
+    STREAM_STR,
+    STREAM_SCALAR,
+};
+
+/* Push parser */
+struct json_stream
+{
+    struct parser p;
+    struct json_opts opts;      /* Copy of options, chunks are not kept */
+    const struct json_handler *h;
+    void *ctx;
+    int state;                  /* enum stream_state */
+    int status;                 /* Error once parsing failed */
+    char *pending;              /* Token split across chunks, from its first character */
+    size_t pending_len;
+    size_t pending_size;
+    int pending_type;           /* enum stream_token */
+    bool escape;                /* Pending string ends with escaping backslash */
+    bool escaped;               /* String has escape sequences */
+    bool invalid;               /* String has control characters */
+};
+
+/* Container open in streaming writer */
+struct writer_level
+{
+    unsigned int depth;         /* Indentation depth, as used by printer of documents */
+    uint16_t type;              /* JSON_TYPE_DICT or JSON_TYPE_LIST */
+    uint16_t count;             /* Members written, only 0 or 1 */
+};
+
+/* Streaming writer, output goes to the writer without building a document */
+struct json_writer
+{
+    struct writer w;
+    unsigned int indent;
+    unsigned int depth;         /* Open containers */
+    int status;                 /* First misuse or failure */
+    bool key;                   /* Key is written, its value comes next */
+    bool done;                  /* Root container is closed */
+    struct writer_level stack[JSON_DEPTH_MAX];
+};
+
 struct io_stream
 {
-    FILE *stream;
+    struct writer *w;
     unsigned int depth;
     unsigned int indent;
 };
 
 /* Function declarations */
-static void free_obj(int type, void* data);
+static void free_obj(struct arena *arena, int type, void* data);
+static struct json* json_alloc(struct arena *arena);
+static struct list* new_list(struct arena *arena);
+static struct dict* new_dict(struct arena *arena);
 
-static struct json* parse(char *start, char *end, int *err);
-static struct json* parse_val(char *start, char *end, char **raw, int *err);
-static struct list* parse_list(char *start, char *end, char **raw, int *err);
-static struct dict* parse_dict(char *start, char *end, char **raw, int *err);
+static int parse_token(char *start, char *end, char **raw, struct token *t, struct parser *p);
 
 
-static int print(FILE *stream, struct json* json, unsigned int indent, unsigned int depth);
-static int print_val(FILE *stream, struct json* json, unsigned int indent, unsigned int depth);
-static int print_dict(FILE *stream, struct dict* dict, unsigned int indent, unsigned int depth);
-static int print_list(FILE *stream, struct list* list, unsigned int indent, unsigned int depth);
+static int print(struct writer *w, struct json* json, unsigned int indent, unsigned int depth);
+static void print_val(struct writer *w, struct json* json, unsigned int indent, unsigned int depth);
+static void print_dict(struct writer *w, struct dict* dict, unsigned int indent, unsigned int depth);
+static void print_list(struct writer *w, struct list* list, unsigned int indent, unsigned int depth);
 static int print_list_cb(void* stream, unsigned int index,void *data);
 static int print_dict_cb(void* stream, unsigned int index, char *key, void* val);
-static int print_indent(FILE *stream, int indent, int depth);
+static void print_indent(struct writer *w, int indent, int depth);
+static void print_str(struct writer *w, const char *str, size_t len);
 
-static struct json* clone(struct json* json, int *err);
-static struct list* clone_list(struct list *list, int *err);
-static struct dict* clone_dict(struct dict* dict, int *err);
-static void* clone_obj(int type, void *data, int *err);
+static struct json* clone(struct arena *arena, struct json* json, int *err);
+static struct list* clone_list(struct arena *arena, struct list *list, int *err);
+static struct dict* clone_dict(struct arena *arena, struct dict* dict, int *err);
+static void* clone_obj(struct arena *arena, int type, void *data, int *err);
 
 static void init_val(struct json *json, int type, void* data);
 
+/* Options used when caller does not provide any */
+static const struct json_opts default_opts = {
+    .flags = 0,
+    .dup = JSON_DUP_ERROR,
+    .max_depth = JSON_DEPTH_MAX,
+};
+
 #if 0
 static const char *type_str(unsigned int type)
 {
@@ -119,7 +274,7 @@ static int json_cmp(struct json *j1, struct json *j2)
                 break;
 
             case JSON_TYPE_STR:
-                ret = strcmp(j2->str, j1->str);
+                ret = memcmp(j2->str, j1->str, MIN2(j1->len, j2->len) + 1);
                 break;
 
             case JSON_TYPE_DICT:
@@ -171,6 +326,7 @@ static void init_val(struct json *json, int type, void* data)
 
                 case JSON_TYPE_STR:
                     json->str = (char*)data;
+                    json->len = strlen(data);
                     break;
 
                 case JSON_TYPE_DICT:
@@ -191,7 +347,68 @@ static void init_val(struct json *json, int type, void* data)
     }
 }
 
-static void free_obj(int type, void* data)
+/*
+* @brief Allocate json value
+* @param arena Arena for allocation, NULL for heap
+* @return Json value
+*/
+static struct json* json_alloc(struct arena *arena)
+{
+    struct json  *json = NULL;
+    if((json = arena_alloc(arena, sizeof(struct json)))){
+        json->data = NULL;
+        json->type = JSON_TYPE_NULL;
+        json->flags = arena ? JSON_FLAG_ARENA : 0;
+    } else {
+        TRACE(ERROR, "Failed to allocate value");
+    }
+    return json;
+}
+
+/*
+* @brief Allocate list for json values
+* Values in arena are released with arena, so list does not free them
+* @param arena Arena for allocation, NULL for heap
+* @return List
+*/
+static struct list* new_list(struct arena *arena)
+{
+    return list_new_arena(arena, arena ? NULL : (list_free_t)json_del, (list_cmp_t)json_cmp, (list_print_t)print_list_cb);
+}
+
+/*
+* @brief Allocate dict for json values
+* @param arena Arena for allocation, NULL for heap
+* @return Dict
+*/
+static struct dict* new_dict(struct arena *arena)
+{
+    return dict_new_arena(arena, arena ? NULL : (dict_free_t)json_del, (dict_cmp_t)json_cmp, (dict_print_t)print_dict_cb);
+}
+
+/*
+* @brief Allocate root value of document
+* @param p Parser context
+* @return Json value
+*/
+static struct json* json_root(struct parser *p)
+{
+    struct json_doc *doc = NULL;
+    if(!p->arena){
+        return json_new();
+    } else if((doc = arena_alloc(p->arena, sizeof(struct json_doc)))){
+        doc->arena = p->arena;
+        doc->json.data = NULL;
+        doc->json.type = JSON_TYPE_NULL;
+        /* Document flag is set once parsing is successful */
+        doc->json.flags = JSON_FLAG_ARENA;
+        return &doc->json;
+    }
+    TRACE(ERROR, "Failed to allocate document");
+    return NULL;
+}
+
+static void free_obj(struct arena *arena, int type, void* data)
 {
     switch(type){
         case JSON_TYPE_DICT:
@@ -204,7 +421,7 @@ static void free_obj(int type, void* data)
         break;
         case JSON_TYPE_STR:
             /* Free String */
-            free(data);
+            arena_free(arena, data);
         break;
         case JSON_TYPE_OBJ:
             json_del(data);
@@ -215,719 +432,1130 @@ static void free_obj(int type, void* data)
 }
 
 /*
-* @brief Parse a json list in buffer
-* @param start Pointer to start of buffer
-* @param end Pointer to end of buffer
-* @param raw Pointer to plcae holder for data remaining after parsing
-* @param err Pointer for error status
-* @return Json list
+* @brief Get scratch buffer of parser
+* @param p Parser context
+* @param size Required size
+* @return buffer or NULL
 */
-static struct list* parse_list(char *start, char *end,char **raw, int *err)
+static char* parser_scratch(struct parser *p, size_t size)
 {
-    struct list *list = NULL;
-    struct json *json = NULL;
-    char *begin = start;
-    char *temp = NULL;
-
-    /* Check data */
-    if(start && end && raw && err && (start < end)){
-
-        /* Check beginning, List should start with [*/
-        if(*start != '['){
-            TRACE(ERROR, "List must begin with [");
-            *raw = begin;
-            *err = JsonErr(JSON_ERR_PARSE);
-            return NULL;
-        }
-
-        /* Skip all white space after [ */
-        start = trim(start + 1, end);
-        if(start == end){
-            TRACE(ERROR, "Missing ]");
-            *raw = begin;
-            *err = JsonErr(JSON_ERR_PARSE);
-            return NULL;
-        }
-
-        /* Allocate a new List of Json Object */
-        if(!(list = list_new((list_free_t)json_del, (list_cmp_t)json_cmp, (list_print_t)print_list_cb))){
-            TRACE(ERROR, "Failed to init List");
-            *err = JsonErr(JSON_ERR_NO_MEM);
-            *raw = begin;
+    char *buffer = NULL;
+    if(size > p->scratch_size){
+        if(!(buffer = realloc(p->scratch, size))){
+            TRACE(ERROR, "Failed to allocate scratch buffer");
             return NULL;
         }
-
-        /* List is terminated with ], Check for empty  list */
-        if(*start == ']'){
-            /* Empty List */
-            *raw = start + 1;
-            *err = JsonErr(JSON_ERR_SUCCESS);
-            return list;
-        } 
-
-        /* Parse all data */
-        for(*raw = begin; *start && (start < end); *raw = start ){
-
-            /* Parse Value field for List object */
-            if(!(json = parse_val(start, end, &temp, err))){
-                TRACE(ERROR, "Failed to parse value");
-                list_del(list);
-                *raw = begin;
-                *err = JsonErr(JSON_ERR_PARSE);
-                return NULL;
-            }
-
-            /* Add Value in List */
-            if((list_add(list, json)) < 0 ){
-                TRACE(ERROR, "Failed to add value in List");
-                *raw = begin;
-                *err = JSON_ERR_NO_MEM;
-                list_del(list);
-                return NULL;
-            }
-
-            /* Trim data */
-            start = trim(temp, end);
-            if(start < end ){
-                /* Check if end of list reached */
-                if(*start == ']'){
-                    *raw = start + 1;
-                    *err = JsonErr(JSON_ERR_SUCCESS);
-                    return list;
-                } else if(*start != ','){
-                    /* List Must have comma */
-                    TRACE(ERROR, "Missing ,");
-                    *raw = begin;
-                    list_del(list);
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
-                /* Trim after comma */
-                start = trim(start+1, end);
-            }
-        }
-        /* Failed to find the end of list */
-        if(list)
-            list_del(list);
-
-        *err = JsonErr(JSON_ERR_PARSE);
-        TRACE(ERROR, "Parsing error!! Missing ]");
-    } else {
-        TRACE(ERROR, "Invalid arguments");
-        if(err)
-         *err = JsonErr(JSON_ERR_PARSE);
+        p->scratch = buffer;
+        p->scratch_size = size;
     }
+    return p->scratch;
+}
 
-    return NULL;
+/*
+* @brief Decode escapes in string or key
+* Plain string is used as it is in input, escaped one is decoded in scratch buffer.
+* In situ string is decoded inside input buffer and null terminated in place of closing quote.
+* @param str String returned by parse_str
+* @param len Length of string, updated with decoded length
+* @param escaped String has escape sequences
+* @param p Parser context
+* @return decoded string, null terminated only for in situ parsing
+*/
+static char* decode_str(char *str, int *len, bool escaped, struct parser *p)
+{
+    char *dst = NULL;
+    if(p->opts->flags & JSON_OPT_INSITU){
+        dst = str;
+    } else if(!escaped){
+        return str;
+    } else if(!(dst = parser_scratch(p, *len))){
+        return NULL;
+    }
+    if(escaped && ((*len = unescape_str(dst, str, *len)) < 0)){
+        TRACE(ERROR, "Invalid escape sequence");
+        return NULL;
+    }
+    if(dst == str)
+        dst[*len] = '\0';
+    return dst;
 }
 
 /*
-* @brief Parse a json value in buffer
+* @brief Parse a json value other than object or list
 * @param start Pointer to start of buffer
 * @param end Pointer to end of buffer
 * @param raw Pointer to plcae holder for data remaining after parsing
-* @param err Pointer for error status
-* @return Json value
+* @param t Placeholder for value
+* @param p Parser context
+* @return JSON_ERR value
 */
-static struct json* parse_val(char *start, char *end, char **raw, int *err)
+static int parse_token(char *start, char *end, char **raw, struct token *t, struct parser *p)
 {
-    struct json *json = NULL;
     char *begin = start;
     char *temp = NULL;
-    double double_val = 0.0f;
-    unsigned int uint_number;
-    bool bool_val = false;
-    long long_val = 0;
-    int type = JSON_TYPE_INVALID;
+    uint64_t number = 0;
     bool overflow = false;
-    bool unsigned_flag = false; 
-    int len = 0;
+    bool unsigned_flag = false;
+    bool escaped = false;
     int sign = 1;
-    void *val = NULL;
-
-    /* Check for valid dat */
-    if(start && end && raw && err && (start < end)){
-        /* Parse Value */
-        switch(*start){
-            case '{':
-                type = JSON_TYPE_DICT;
-
-                /* Parse Json Object */
-                if(!(val = (void*)parse_dict(start, end, &temp, err))){
-                    TRACE(ERROR,"Failed to parse dict");
-                    *raw = begin;
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
-                *raw = temp;
-                
-                break;
 
-            case '[':
-                type = JSON_TYPE_LIST;
+    *raw = begin;
+    if(!(start && end && (start < end))){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    switch(*start){
+        case 't' :case 'f':
+            /* Parse boolean */
+            t->type = JSON_TYPE_BOOL;
+            t->boolean = parse_boolean(start, end, &temp);
+            if(start == temp){
+                TRACE(ERROR,"Failed to parse object");
+                return JsonErr(JSON_ERR_PARSE);
+            }
+            break;
 
-                /* Parse List */
-                if(!(val = (void*)parse_list(start, end, &temp, err))){
-                    TRACE(ERROR,"Failed to parse list");
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    *raw = begin;
-                    return NULL;
-                }
-                *raw = temp;
-                break;
+        case '"':
+            /* Parse quoted string */
+            t->type = JSON_TYPE_STR;
+            if(!(t->str = parse_str(start, end, &temp, &t->len, &escaped)) ||
+               !(t->str = decode_str(t->str, &t->len, escaped, p))){
+                TRACE(ERROR, "Failed to parse object");
+                return JsonErr(JSON_ERR_PARSE);
+            }
+            break;
 
-            case 't' :case 'f':
-                type = JSON_TYPE_BOOL;
-                /* Parse boolean */
-                bool_val = parse_boolean(start, end, &temp);
+        case 'n': case 'N':
+            t->type = JSON_TYPE_NULL;
+            if(((end - start) < 4) || ((strncasecmp(start, "null", 4)) != 0)){
+                TRACE(ERROR, "Failed to parse null");
+                return JsonErr(JSON_ERR_PARSE);
+            }
+            temp = start + 4;
+            break;
 
-                /* Check for failure */
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+        case '.': case '+':case '-':
+            t->type = JSON_TYPE_INT;
+            if(*start == '-'){
+                sign = -1;
+                start++;
+            } else if(*start == '+'){
+                start++;
+            }
+            /* Check if we are at the end of data */
+            if(start >= end){
+                TRACE(ERROR,"Failed to parse number, only sign found");
+                return JsonErr(JSON_ERR_PARSE);
+            }
+            /* Parse Number */
+            if(is_float(start, end)){
+                /* Parse double value, including exponent */
+                t->double_number = parse_float(start, end, &temp);
                 if(start == temp){
-                    TRACE(ERROR,"Failed to parse object");
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    *raw = begin;
-                    return NULL;
-                }
-                *raw = temp;
-                val = (void*)&bool_val;
-                break;
-
-            case '"':
-                /* Parse quoted string */
-                type = JSON_TYPE_STR;
-                len = 0;
-
-                /* Check for failure */
-                if(!(val = (void*)parse_str(start, end, &temp, &len)) || !(val = strdup(val))){
-                    TRACE(ERROR, "Failed to parse object");
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    *raw = begin;
-                    return NULL;
+                    TRACE(ERROR,"Failed to parse double value");
+                    return JsonErr(JSON_ERR_PARSE);
                 }
-                *raw = temp;
-                break;
-            case 'n': case 'N':
-                type = JSON_TYPE_NULL;
-                if(((end - start) < 4) || ((strncasecmp(start, "null", 4)) != 0)){
-                    TRACE(ERROR, "Failed to parse null");
-                    *raw = begin;
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
+                t->type = JSON_TYPE_DOUBLE;
+                t->double_number *= sign;
+            } else if(is_hex(start, end)){
+                start +=2;
+                /* Parse hex value */
+                number = parse_hex(start, end, &temp, &overflow);
+                if(start == temp){
+                    TRACE(ERROR,"Failed to parse hex value");
+                    return JsonErr(JSON_ERR_PARSE);
+                } else if(overflow || (number > UINT_MAX)){
+                    TRACE(ERROR,"Hex value too large");
+                    return JsonErr(JSON_ERR_OVERFLOW);
+                } else if(sign == -1 ){
+                    TRACE(ERROR,"Hex value can not be negative");
+                    return JsonErr(JSON_ERR_PARSE);
                 }
-                *raw = start + 4;
-            break;
-            case '0': case '1': case '2': case '3': case '4':
-            case '5': case '6': case '7': case '8': case '9':
-            case '.': case '+':case '-':
-
-                type = JSON_TYPE_INT;
-                overflow = false;
-                unsigned_flag = false;
-                sign = 1;
-                if(*start == '-'){
-                    sign = -1;
-                    start++;
-                } else if(*start == '+'){
-                    start++;
+                t->uint_number = number;
+                t->type = JSON_TYPE_HEX;
+            } else if(is_octal(start, end)){
+                start++;
+                /* Parse octal values */
+                number = parse_octal(start, end, &temp, &overflow);
+                if(start == temp){
+                    TRACE(ERROR,"Failed to parse octal value");
+                    return JsonErr(JSON_ERR_PARSE);
+                } else if(overflow || (number > UINT_MAX)){
+                    TRACE(ERROR,"Octal value too large");
+                    return JsonErr(JSON_ERR_OVERFLOW);
+                } else if(sign == -1 ){
+                    TRACE(ERROR,"Octal value can not be negative");
+                    return JsonErr(JSON_ERR_PARSE);
                 }
-                /* Check if we are at the end of data */
-                if(start >= end){
-                    TRACE(ERROR,"Failed to parse number, only sign found");
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    *raw = begin;
-                    return NULL;
+                t->uint_number = number;
+                t->type = JSON_TYPE_OCTAL;
+            } else {
+                number = parse_int(start, end, &temp, &overflow, &unsigned_flag);
+                if(start == temp){
+                    TRACE(ERROR,"Failed to parse integer value");
+                    return JsonErr(JSON_ERR_PARSE);
+                } else if(unsigned_flag && (sign == -1)){
+                    TRACE(ERROR,"Unsigned value can not be negative");
+                    return JsonErr(JSON_ERR_PARSE);
                 }
-                /* Parse Number */
-                if(*start == '.'){
-                    start++;
-                    /* Parse double value*/
-                    double_val = parse_float(start, end, &temp);
-                    if(start == temp){
-                        TRACE(ERROR,"Failed to parse double value");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    }
-                    /* Parsing successful*/
-                    type = JSON_TYPE_DOUBLE;
-                    double_val *= sign;
-                    val = (void*)&double_val;
-
-                } else if(is_hex(start, end)){
-                    start +=2;
-                    /* Parse hex value */
-                    uint_number = parse_hex(start, end, &temp, &overflow);
-                    if(start == temp){
-                        TRACE(ERROR,"Failed to parse hex value");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    } else if(sign == -1 ){
-                        TRACE(ERROR,"Hex value can not be negative");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    }
-                    /* Parsing successful*/
-                    val = (void*)&uint_number;
-                    type = JSON_TYPE_HEX;
-                } else if(is_octal(start, end)){
-                    start++;
-                    /* Parse octal values */
-                    uint_number = parse_octal(start, end, &temp, &overflow);
-                    if(start == temp){
-                        TRACE(ERROR,"Failed to parse octal value");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    } else if(sign == -1 ){
-                        TRACE(ERROR,"Octal value can not be negative");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    }
-                    /* Parsing successful*/
-                    val = (void*)&uint_number;
-                    type = JSON_TYPE_OCTAL;
+
+                if(!overflow && unsigned_flag && (number <= ULONG_MAX)){
+                    /* Unsigned value is kept in same bits */
+                    t->long_number = (long)number;
+                    t->type = JSON_TYPE_UINT;
+                } else if(!overflow && !unsigned_flag && (number <= (uint64_t)LONG_MAX + (sign == -1))){
+                    /* Negate in unsigned, so that smallest long does not overflow */
+                    t->long_number = (long)((sign == -1) ? (0 - number) : number);
                 } else {
-                    long_val = parse_int(start, end, &temp, &overflow, &unsigned_flag);
-                    if(start == temp){
-                        TRACE(ERROR,"Failed to parse octal value");
-                        *err = JsonErr(JSON_ERR_PARSE);
-                        *raw = begin;
-                        return NULL;
-                    }
-                    
-                    /* Parsing successful*/
-                    
-                    long_val *= sign;
-                    val = (void*)&long_val;
-                    if(unsigned_flag){
-                        type = JSON_TYPE_UINT;
-                    }
-                    /* Check if there is also a fractional part */
-                    start = temp;
-                    if((start < end) &&( *start == '.')){
-                        start++;
-                        double_val = parse_float(start, end, &temp);
-                        if(start == temp){
-                            TRACE(ERROR,"Failed to parse decimal value");
-                            *err = JsonErr(JSON_ERR_PARSE);
-                            *raw = begin;
-                            return NULL;
-                        }
-                        /* Check sign */
-                        if(long_val > 0){
-                            double_val += long_val;
-                        } else {
-                            double_val = long_val - double_val;
-                        }
-                        type = JSON_TYPE_DOUBLE;
-                        val = (void*)&double_val;
-                    }
+                    /* Too large for integer, keep it as double */
+                    TRACE(DEBUG,"Integer overflow, using double");
+                    t->double_number = parse_float(start, end, &start) * sign;
+                    t->type = JSON_TYPE_DOUBLE;
                 }
-                *raw = trim(temp, end);
-                *err = JsonErr(JSON_ERR_SUCCESS);
-                break;
+            }
+            temp = trim(temp, end);
+            break;
 
-            default:
-                TRACE(ERROR,"Missing Value");
-                *err = JsonErr(JSON_ERR_PARSE);
-                *raw = begin;
-                return NULL;
-        }
-        /* Allocate json vlue*/
-        if(!(json = json_new())){
-            TRACE(ERROR," Failed to alocate memeory");
+        default:
+            TRACE(ERROR,"Missing Value");
+            return JsonErr(JSON_ERR_PARSE);
+    }
+    *raw = temp;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Report value other than object or list to handler
+* @param h Event handler
+* @param ctx Context of handler
+* @param t Value
+* @return JSON_ERR value returned by handler
+*/
+static inline __attribute__((always_inline))
+int emit_token(const struct json_handler *h, void *ctx, const struct token *t)
+{
+    switch(t->type){
+        case JSON_TYPE_STR:
+            return h->string ? h->string(ctx, t->str, t->len) : 0;
+        case JSON_TYPE_BOOL:
+            return h->boolean ? h->boolean(ctx, t->boolean) : 0;
+        case JSON_TYPE_NULL:
+            return h->null ? h->null(ctx) : 0;
+        case JSON_TYPE_DOUBLE:
+            return h->double_number ? h->double_number(ctx, t->double_number) : 0;
+        case JSON_TYPE_HEX: case JSON_TYPE_OCTAL:
+            return h->integer ? h->integer(ctx, t->type, t->uint_number) : 0;
+        default:
+            return h->integer ? h->integer(ctx, t->type, t->long_number) : 0;
+    }
+}
+
+/*
+* @brief Report start or end of container to handler
+* @param h Event handler
+* @param ctx Context of handler
+* @param type JSON_TYPE_DICT or JSON_TYPE_LIST
+* @param open true for start of container
+* @return JSON_ERR value returned by handler
+*/
+static inline __attribute__((always_inline))
+int emit_container(const struct json_handler *h, void *ctx, int type, bool open)
+{
+    if(type == JSON_TYPE_DICT){
+        if(open)
+            return h->start_object ? h->start_object(ctx) : 0;
+        return h->end_object ? h->end_object(ctx) : 0;
+    } else if(open){
+        return h->start_list ? h->start_list(ctx) : 0;
+    }
+    return h->end_list ? h->end_list(ctx) : 0;
+}
+
+/*
+* @brief Push container on parser stack
+* Stack starts inside parser context and moves to heap when it grows, up to maximum nesting depth
+* @param p Parser context
+* @param type JSON_TYPE_DICT or JSON_TYPE_LIST
+* @param err Pointer for error status
+* @return frame of container
+*/
+static struct frame* parser_push(struct parser *p, int type, int *err)
+{
+    struct frame *stack = NULL;
+    struct frame *frame = NULL;
+    unsigned int size = 0;
+
+    if(p->depth >= p->max_depth){
+        TRACE(ERROR, "Nesting deeper than %u", p->max_depth);
+        *err = JsonErr(JSON_ERR_DEPTH);
+        return NULL;
+    }
+    if(p->depth == p->stack_size){
+        size = (p->stack_size * 2 < p->max_depth) ? (p->stack_size * 2) : p->max_depth;
+        if(!(stack = realloc((p->stack == p->local) ? NULL : p->stack, size * sizeof(struct frame)))){
+            TRACE(ERROR, "Failed to grow parser stack");
             *err = JsonErr(JSON_ERR_NO_MEM);
-            *raw = begin;
-            /* Make Sure to free what we allocated*/
-            free_obj(type, val);
-        } else {
-            init_val(json, type, val);
+            return NULL;
         }
-    } else {
-        TRACE(ERROR, "Invalid arguments");
-        if(err)
-         *err = JsonErr(JSON_ERR_PARSE);
+        if(p->stack == p->local)
+            memcpy(stack, p->local, sizeof(p->local));
+        p->stack = stack;
+        p->stack_size = size;
     }
-    return json;
+    frame = &p->stack[p->depth++];
+    frame->type = type;
+    frame->obj = NULL;
+    frame->key = NULL;
+    return frame;
 }
 
-static struct dict* parse_dict(char *start,  char *end,  char **raw, int *err)
+/*
+* @brief Add value to container being built, value at depth 0 is root of document
+* Value is deleted on failure
+* @param p Parser context
+* @param json Json value, NULL if it could not be allocated
+* @param depth Number of containers open around value
+* @return JSON_ERR value
+*/
+static int dom_add(struct parser *p, struct json *json, unsigned int depth)
 {
-    char *begin = start;
+    struct frame *frame = NULL;
+    struct json *old = NULL;
     char *key = NULL;
-    char *temp = NULL;
-    struct json* json = NULL;
-    struct dict* dict = NULL;
-    int len = 0;
+    int ret = 0;
 
-    /* Check for args */
-    if(start && end && raw && err){
-        /* Nothing Parsed */
-        *raw = start;
-         if(*start == '{'){
-             /* Trim after { */
-            start = trim(start + 1, end);
+    if(!json){
+        TRACE(ERROR, "Failed to allocate value");
+        return JsonErr(JSON_ERR_NO_MEM);
+    } else if(!depth){
+        p->root = json;
+        return JsonErr(JSON_ERR_SUCCESS);
+    }
 
-            /* Check if we are at the end */
-            if(start >= end){
-                TRACE(ERROR,"Missing }");
-                *err = JsonErr(JSON_ERR_PARSE);
-                *raw = begin;
-                return NULL;
-            }
+    frame = &p->stack[depth - 1];
+    if(frame->type == JSON_TYPE_LIST){
+        if(list_add(frame->obj, json) < 0){
+            TRACE(ERROR, "Failed to add value in List");
+            json_del(json);
+            return JsonErr(JSON_ERR_NO_MEM);
+        }
+        return JsonErr(JSON_ERR_SUCCESS);
+    }
 
-            if(!(dict = dict_new((dict_free_t)json_del, (dict_cmp_t)json_cmp, (dict_print_t)print_dict_cb))){
-                TRACE(ERROR,"Failed to allocate dict object");
-                *err = JsonErr(JSON_ERR_NO_MEM);
-                *raw = begin;
-                return NULL;
-            }
+    /* Key copied to key stack is released, dict makes its own copy */
+    if(!(key = frame->key)){
+        key = p->keys + frame->mark;
+        p->keys_used = frame->mark;
+    }
+    /* Same lookup detects duplicate entry */
+    ret = (p->opts->flags & JSON_OPT_INSITU) ?
+        dict_add_ref(frame->obj, key, frame->len, json, p->opts->dup == JSON_DUP_LAST, (void**)&old) :
+        dict_add(frame->obj, key, frame->len, json, p->opts->dup == JSON_DUP_LAST, (void**)&old);
+    if(ret < 0){
+        TRACE(ERROR, "Failed to add value for %.*s in json object", frame->len, key);
+        json_del(json);
+        return JsonErr(JSON_ERR_NO_MEM);
+    }
+    if(old){
+        if(p->opts->dup == JSON_DUP_ERROR){
+            TRACE(ERROR, "Duplicate Key %.*s in json object", frame->len, key);
+            json_del(json);
+            return JsonErr(JSON_ERR_KEY_REPEAT);
+        }
+        /* Drop the value which was not kept */
+        json_del((p->opts->dup == JSON_DUP_LAST) ? old : json);
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
 
-            /* Empty Object*/
-            if(*start == '}'){
-                temp = trim(start + 1, end);
-                *err = JsonErr(JSON_ERR_SUCCESS);
-                *raw = temp;
-                return dict;
-            }
-            
-            /* Traverse all rest of data  */
-            for(*raw = begin; *start && (start < end); *raw = start){
+/*
+* @brief Create container on top of parser stack
+* @param p Parser context
+* @param type JSON_TYPE_DICT or JSON_TYPE_LIST
+* @return JSON_ERR value
+*/
+static int dom_start(struct parser *p, int type)
+{
+    struct frame *frame = &p->stack[p->depth - 1];
+    if(!(frame->obj = (type == JSON_TYPE_DICT) ? (void*)new_dict(p->arena) : (void*)new_list(p->arena))){
+        TRACE(ERROR, "Failed to allocate container");
+        return JsonErr(JSON_ERR_NO_MEM);
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
 
-                /* Rest Should bey Key:Val pair */
-                key = parse_str(start, end, &temp, &len);
-                if(!key || (temp == start)){
-                    TRACE(ERROR,"Missing Key, should start with \"");
-                    dict_del(dict);
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
-                
-                /* Trim whitespace */
-                start = trim(temp, end);
-                if(( start >= end ) || *start != ':'){
-                    TRACE(ERROR,"Missing :");
-                    dict_del(dict);
-                    free(key);
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
+static inline __attribute__((always_inline))
+int dom_start_object(void *ctx)
+{
+    return dom_start(ctx, JSON_TYPE_DICT);
+}
 
-                /* Trim white space after collon */
-                start = trim(start + 1, end);
-                if( start >= end ){
-                    TRACE(ERROR,"Missing Value after :");
-                    dict_del(dict);
-                    free(key);
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
+static inline __attribute__((always_inline))
+int dom_start_list(void *ctx)
+{
+    return dom_start(ctx, JSON_TYPE_LIST);
+}
 
-                /* Parse current Value */
-                if(!(json = parse_val(start, end, &temp, err))){
-                    TRACE(ERROR,"Failed to parse value for %s", key);
-                    dict_del(dict);
-                    free(key);
-                    *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
-                }
+/*
+* @brief Close container on top of parser stack, it becomes value of its parent
+* @param ctx Parser context
+* @return JSON_ERR value
+*/
+static inline __attribute__((always_inline))
+int dom_end(void *ctx)
+{
+    struct parser *p = ctx;
+    struct frame *frame = &p->stack[p->depth - 1];
+    struct json *json = NULL;
 
-                /* Check duplicate entry */
-                if(dict_get(dict, key)){
-                    TRACE(ERROR,"Duplicate Key %s in json object", key);
-                    dict_del(dict);
-                    free(key);
-                    *err = JsonErr(JSON_ERR_KEY_REPEAT);
-                    return NULL;
-                }
+    if(!(json = (p->depth > 1) ? json_alloc(p->arena) : json_root(p))){
+        TRACE(ERROR, "Failed to allocate json object");
+        return JsonErr(JSON_ERR_NO_MEM);
+    }
+    init_val(json, frame->type, frame->obj);
+    frame->obj = NULL;
+    return dom_add(p, json, p->depth - 1);
+}
 
-                /* Add Key value pair in json object */
-                if((dict_set(dict, key, json)) < 0){
-                    TRACE(ERROR,"Failed to add value for %s in json object", key);
-                    dict_del(dict);
-                    free(key);
-                    *err = JsonErr(JSON_ERR_NO_MEM);
-                    return NULL;
+/*
+* @brief Keep key of member until its value is added
+* Key decoded in scratch buffer is copied to key stack, as scratch buffer is reused
+* by value and by nested objects. Other keys stay in input buffer.
+* @param ctx Parser context
+* @param key Key
+* @param len Length of key
+* @return JSON_ERR value
+*/
+static inline __attribute__((always_inline))
+int dom_key(void *ctx, const char *key, size_t len)
+{
+    struct parser *p = ctx;
+    struct frame *frame = &p->stack[p->depth - 1];
+    char *keys = NULL;
+    size_t size = 0;
+
+    frame->len = len;
+    if(key != p->scratch){
+        frame->key = (char*)key;
+        return JsonErr(JSON_ERR_SUCCESS);
+    }
+    if(!p->keys || (p->keys_used + len > p->keys_size)){
+        size = (p->keys_used + len) * 2 + 16;
+        if(!(keys = realloc(p->keys, size))){
+            TRACE(ERROR, "Failed to allocate key stack");
+            return JsonErr(JSON_ERR_NO_MEM);
+        }
+        p->keys = keys;
+        p->keys_size = size;
+    }
+    memcpy(p->keys + p->keys_used, key, len);
+    frame->key = NULL;
+    frame->mark = p->keys_used;
+    p->keys_used += len;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+static inline __attribute__((always_inline))
+int dom_string(void *ctx, const char *str, size_t len)
+{
+    struct parser *p = ctx;
+    struct json *json = NULL;
+
+    if((json = json_alloc(p->arena))){
+        json->type = JSON_TYPE_STR;
+        json->len = len;
+        if(p->opts->flags & JSON_OPT_INSITU){
+            /* Decoded and null terminated inside input buffer */
+            json->str = (char*)str;
+            json->flags |= JSON_FLAG_REF;
+        } else if(!(json->str = arena_strndup(p->arena, str, len))){
+            TRACE(ERROR, "Failed to allocate string");
+            json_del(json);
+            json = NULL;
+        }
+    }
+    return dom_add(p, json, p->depth);
+}
+
+static inline __attribute__((always_inline))
+int dom_integer(void *ctx, int type, long val)
+{
+    struct parser *p = ctx;
+    struct json *json = NULL;
+
+    if((json = json_alloc(p->arena))){
+        json->type = type;
+        if((type == JSON_TYPE_HEX) || (type == JSON_TYPE_OCTAL))
+            json->uint_number = val;
+        else
+            json->long_number = val;
+    }
+    return dom_add(p, json, p->depth);
+}
+
+static inline __attribute__((always_inline))
+int dom_double(void *ctx, double val)
+{
+    struct parser *p = ctx;
+    struct json *json = NULL;
+
+    if((json = json_alloc(p->arena))){
+        json->type = JSON_TYPE_DOUBLE;
+        json->double_number = val;
+    }
+    return dom_add(p, json, p->depth);
+}
+
+static inline __attribute__((always_inline))
+int dom_boolean(void *ctx, int val)
+{
+    struct parser *p = ctx;
+    struct json *json = NULL;
+
+    if((json = json_alloc(p->arena))){
+        json->type = JSON_TYPE_BOOL;
+        json->boolean = val;
+    }
+    return dom_add(p, json, p->depth);
+}
+
+static inline __attribute__((always_inline))
+int dom_null(void *ctx)
+{
+    struct parser *p = ctx;
+    return dom_add(p, json_alloc(p->arena), p->depth);
+}
+
+/* Events building json document, context is parser */
+static const struct json_handler dom_handler = {
+    .start_object = dom_start_object,
+    .end_object = dom_end,
+    .start_list = dom_start_list,
+    .end_list = dom_end,
+    .key = dom_key,
+    .string = dom_string,
+    .integer = dom_integer,
+    .double_number = dom_double,
+    .boolean = dom_boolean,
+    .null = dom_null,
+};
+
+/*
+* @brief Free what is left of document after failure
+* @param p Parser context
+*/
+static void parser_unwind(struct parser *p)
+{
+    for(; p->depth; p->depth--){
+        if(p->stack[p->depth - 1].obj)
+            free_obj(p->arena, p->stack[p->depth - 1].type, p->stack[p->depth - 1].obj);
+    }
+    if(p->root){
+        json_del(p->root);
+        p->root = NULL;
+    }
+    p->keys_used = 0;
+}
+
+/*
+* @brief Tokenize a json document in buffer and report its values to handler
+* Parser does not recurse, open containers are kept on parser stack.
+* Inlined for each handler, so that document builder is called directly.
+* Buffer can also hold members of a list without its brackets, then it is reported
+* as a list of its own, which ends with buffer.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param h Event handler
+* @param ctx Context of handler
+* @param p Parser context
+* @param members Buffer holds members of a list
+* @return JSON_ERR value
+*/
+static inline __attribute__((always_inline))
+int parse(char *start,  char *end, const struct json_handler *h, void *ctx, struct parser *p, bool members)
+{
+    struct frame *frame = NULL;
+    struct token t;
+    char *temp = NULL;
+    bool escaped = false;
+    int state = PARSE_OPEN;
+    int err = JsonErr(JSON_ERR_SUCCESS);
+
+    /* Object should start with { or [ */
+    start = trim(start, end);
+    if(members){
+        /* List is open before first member */
+        if(!(frame = parser_push(p, JSON_TYPE_LIST, &err)) || ((err = emit_container(h, ctx, JSON_TYPE_LIST, true)) < 0))
+            return err;
+        state = PARSE_MEMBER;
+    } else if((start >= end) || ((*start != '{') && (*start != '['))){
+        TRACE(ERROR,"Failed to parse JSON Object Invalid character %c", (start < end) ? *start : ' ');
+        return JsonErr(JSON_ERR_PARSE);
+    }
+
+    while(state != PARSE_DONE){
+        switch(state){
+            case PARSE_OPEN:
+                /* Start points to { or [ */
+                if(!(frame = parser_push(p, (*start == '{') ? JSON_TYPE_DICT : JSON_TYPE_LIST, &err)) ||
+                   ((err = emit_container(h, ctx, frame->type, true)) < 0)){
+                    state = PARSE_ERROR;
+                } else if((start = trim(start + 1, end)) >= end){
+                    TRACE(ERROR, "Missing %c", (frame->type == JSON_TYPE_DICT) ? '}' : ']');
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if(*start == ((frame->type == JSON_TYPE_DICT) ? '}' : ']')){
+                    /* Empty container */
+                    state = PARSE_CLOSE;
+                } else {
+                    state = PARSE_MEMBER;
                 }
+                break;
 
-                /* Trim */
-                start = trim(temp, end);
-                if(start >= end ){
-                    TRACE(ERROR,"Missing }");
-                    dict_del(dict);
-                    *err = JsonErr(JSON_ERR_NO_MEM);
-                    return NULL;
+            case PARSE_MEMBER:
+                /* Json object member starts with key and : */
+                state = PARSE_VALUE;
+                if(frame->type != JSON_TYPE_DICT)
+                    break;
+                t.str = parse_str(start, end, &temp, &t.len, &escaped);
+                if(!t.str || (temp == start)){
+                    TRACE(ERROR,"Missing Key, should start with \"");
+                    state = PARSE_ERROR;
+                } else if(((start = trim(temp, end)) >= end) || (*start != ':')){
+                    TRACE(ERROR,"Missing :");
+                    state = PARSE_ERROR;
+                } else if((start = trim(start + 1, end)) >= end){
+                    TRACE(ERROR,"Missing Value after :");
+                    state = PARSE_ERROR;
+                } else if(!(t.str = decode_str(t.str, &t.len, escaped, p))){
+                    state = PARSE_ERROR;
+                } else if(h->key && ((err = h->key(ctx, t.str, t.len)) < 0)){
+                    state = PARSE_ERROR;
+                    break;
                 }
-                
-                /* Only valid characters are comma and } */
-                switch(*start){
-                    case ',':
-                        /* Process next field */
-                        start = trim(start + 1, end);
-                        continue;
-                        break;
-
-                    case '}':
-                        /* Object closure */
-                        start = trim(start + 1, end);
-                        /* Whats remaining */
-                        *raw = start;
-                        return dict;
-
-                    default:
-                        TRACE(ERROR,"Missing ,");
-                        *raw = begin;
-                        dict_del(dict);
-                        if(err)
-                            *err = JsonErr(JSON_ERR_PARSE);
-                    return NULL;
+                if(state == PARSE_ERROR)
+                    err = JsonErr(JSON_ERR_PARSE);
+                break;
+
+            case PARSE_VALUE:
+                /* Nested container is opened, anything else is reported right away */
+                if((start < end) && ((*start == '{') || (*start == '['))){
+                    state = PARSE_OPEN;
+                } else if((err = parse_token(start, end, &temp, &t, p)) < 0){
+                    TRACE(ERROR,"Failed to parse value");
+                    state = PARSE_ERROR;
+                } else if((err = emit_token(h, ctx, &t)) < 0){
+                    state = PARSE_ERROR;
+                } else {
+                    start = temp;
+                    state = PARSE_NEXT;
                 }
-            }
-         }
-         *err = JsonErr(JSON_ERR_SUCCESS);
-    } else {
-        TRACE(ERROR, "Invalid arguments");
-        if(err)
-         *err = JsonErr(JSON_ERR_PARSE);
+                break;
+
+            case PARSE_NEXT:
+                /* Value is followed by comma or end of container */
+                frame = &p->stack[p->depth - 1];
+                if(members && (p->depth == 1) && ((start = trim(start, end)) >= end)){
+                    /* End of buffer closes list of members */
+                    if((err = emit_container(h, ctx, JSON_TYPE_LIST, false)) < 0){
+                        state = PARSE_ERROR;
+                    } else {
+                        p->depth--;
+                        state = PARSE_DONE;
+                    }
+                } else if(members && (p->depth == 1) && (*start == ']')){
+                    TRACE(ERROR, "List of members is closed");
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if((start = trim(start, end)) >= end){
+                    TRACE(ERROR, "Missing %c", (frame->type == JSON_TYPE_DICT) ? '}' : ']');
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if(*start == ','){
+                    start = trim(start + 1, end);
+                    state = PARSE_MEMBER;
+                } else if(*start == ((frame->type == JSON_TYPE_DICT) ? '}' : ']')){
+                    state = PARSE_CLOSE;
+                } else {
+                    TRACE(ERROR,"Missing ,");
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                }
+                break;
+
+            case PARSE_CLOSE:
+                /* Start points to } or ], container is done */
+                start = trim(start + 1, end);
+                if((err = emit_container(h, ctx, p->stack[p->depth - 1].type, false)) < 0)
+                    state = PARSE_ERROR;
+                else if(--p->depth)
+                    state = PARSE_NEXT;
+                else
+                    state = PARSE_DONE;
+                break;
+
+            default:
+                return err;
+        }
     }
 
-    return dict;
+    if(start < end){
+        TRACE(ERROR,"Invalid character %c after json object", *start);
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
 }
+
 /*
-* @brief Parse a json object in buffer
+* @brief Locate string at structural character
+* Closing quote is next structural character, string is scanned again only
+* if index found backslash or control character in it.
 * @param start Pointer to start of buffer
 * @param end Pointer to end of buffer
-* @param err Pointer for error status
-* @return Json object
+* @param s Structural index
+* @param pos Position in index, at opening quote, moved after closing quote
+* @param len Placeholder for length of string
+* @param escaped Placeholder for escape sequences found
+* @return first character of string, not decoded
 */
-static struct json* parse(char *start,  char *end, int *err)
+static char* index_str(char *start, char *end, struct structural *s, const uint32_t **pos, int *len, bool *escaped)
 {
+    char *open = start + (*pos)[0];
+    char *close = NULL;
     char *temp = NULL;
-    struct json* json = NULL;
-    struct list *list = NULL;
-    struct dict* dict = NULL;
 
-    /* Check for args */
-    if(start && end && err && (start < end)){
-        /* Trim Extra Space */
-        start = trim(start, end);
+    if((open >= end) || (*open != '"'))
+        return NULL;
+    close = start + (*pos)[1];
+    if((close < end) && (*close == '"') && structural_plain(s, (*pos)[0] + 1, (*pos)[1])){
+        *len = close - open - 1;
+        *escaped = false;
+    } else if(!parse_str(open, end, &temp, len, escaped) || (temp != close + 1)){
+        return NULL;
+    }
+    *pos = structural_next(s, structural_next(s, *pos));
+    return open + 1;
+}
 
-        /* Object should start with { */
-        if(*start == '{'){
-            if(!(dict = parse_dict(start, end, &temp, err))){
-                TRACE(ERROR,"Failed to parse dict");
-                dict_del(dict);
-            } else {
-                /* Alocate JSON object */
-                if(!(json = json_new())){
-                    TRACE(ERROR,"Failed to allocate json object");
-                    *err = JsonErr(JSON_ERR_NO_MEM);
-                    dict_del(dict);
+/*
+* @brief Tokenize a json document using structural index of buffer
+* Same as parse, but tokens are located with index instead of skipping whitespace,
+* values other than containers and strings are parsed with parse_token.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param s Structural index of buffer
+* @param h Event handler
+* @param ctx Context of handler
+* @param p Parser context
+* @return JSON_ERR value
+*/
+static int parse_index(char *start, char *end, struct structural *s, const struct json_handler *h, void *ctx, struct parser *p)
+{
+    struct frame *frame = NULL;
+    struct token t;
+    const uint32_t *pos = s->pos;
+    char *token = start + *pos;
+    char *temp = NULL;
+    bool escaped = false;
+    int state = PARSE_OPEN;
+    int err = JsonErr(JSON_ERR_SUCCESS);
+
+    /* Object should start with { or [ */
+    if((token >= end) || ((*token != '{') && (*token != '['))){
+        TRACE(ERROR,"Failed to parse JSON Object Invalid character %c", (token < end) ? *token : ' ');
+        return JsonErr(JSON_ERR_PARSE);
+    }
+
+    while(state != PARSE_DONE){
+        switch(state){
+            case PARSE_OPEN:
+                if(!(frame = parser_push(p, (*token == '{') ? JSON_TYPE_DICT : JSON_TYPE_LIST, &err)) ||
+                   ((err = emit_container(h, ctx, frame->type, true)) < 0)){
+                    state = PARSE_ERROR;
+                } else if((token = start + *(pos = structural_next(s, pos))) >= end){
+                    TRACE(ERROR, "Missing %c", (frame->type == JSON_TYPE_DICT) ? '}' : ']');
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if(*token == ((frame->type == JSON_TYPE_DICT) ? '}' : ']')){
+                    state = PARSE_CLOSE;
                 } else {
-                    init_val(json, JSON_TYPE_DICT, dict);
-                    *err = JsonErr(JSON_ERR_SUCCESS);
+                    state = PARSE_MEMBER;
                 }
-            }
-        } else if(*start == '['){
-            if(!(list = parse_list(start, end, &temp, err))){
-                TRACE(ERROR,"Failed to parse list");
-                list_del(list);
-            } else {
-                /* Alocate JSON object */
-                if(!(json=json_new())){
-                    TRACE(ERROR,"Failed to allocate json object");
-                    *err = JsonErr(JSON_ERR_NO_MEM);
-                    list_del(list);
+                break;
+
+            case PARSE_MEMBER:
+                state = PARSE_VALUE;
+                if(frame->type != JSON_TYPE_DICT)
+                    break;
+                if(!(t.str = index_str(start, end, s, &pos, &t.len, &escaped))){
+                    TRACE(ERROR,"Missing Key, should start with \"");
+                    state = PARSE_ERROR;
+                } else if(((token = start + *pos) >= end) || (*token != ':')){
+                    TRACE(ERROR,"Missing :");
+                    state = PARSE_ERROR;
+                } else if((token = start + *(pos = structural_next(s, pos))) >= end){
+                    TRACE(ERROR,"Missing Value after :");
+                    state = PARSE_ERROR;
+                } else if(!(t.str = decode_str(t.str, &t.len, escaped, p))){
+                    state = PARSE_ERROR;
+                } else if(h->key && ((err = h->key(ctx, t.str, t.len)) < 0)){
+                    state = PARSE_ERROR;
+                    break;
+                }
+                if(state == PARSE_ERROR)
+                    err = JsonErr(JSON_ERR_PARSE);
+                break;
+
+            case PARSE_VALUE:
+                if((token < end) && ((*token == '{') || (*token == '['))){
+                    state = PARSE_OPEN;
+                } else if((token < end) && (*token == '"')){
+                    /* String */
+                    t.type = JSON_TYPE_STR;
+                    if(!(t.str = index_str(start, end, s, &pos, &t.len, &escaped)) ||
+                       !(t.str = decode_str(t.str, &t.len, escaped, p))){
+                        TRACE(ERROR, "Failed to parse object");
+                        err = JsonErr(JSON_ERR_PARSE);
+                        state = PARSE_ERROR;
+                    } else if((err = emit_token(h, ctx, &t)) < 0){
+                        state = PARSE_ERROR;
+                    } else {
+                        token = start + *pos;
+                        state = PARSE_NEXT;
+                    }
+                } else if((err = parse_token(token, end, &temp, &t, p)) < 0){
+                    TRACE(ERROR,"Failed to parse value");
+                    state = PARSE_ERROR;
+                } else if((err = emit_token(h, ctx, &t)) < 0){
+                    state = PARSE_ERROR;
                 } else {
-                    init_val(json, JSON_TYPE_LIST, list);
-                    *err = JsonErr(JSON_ERR_SUCCESS);
+                    /* Value must end right before next structural character */
+                    token = trim(temp, end);
+                    if(token == start + pos[1])
+                        pos = structural_next(s, pos);
+                    state = PARSE_NEXT;
                 }
-            }
-        } else {
-             TRACE(ERROR,"Failed to parse JSON Object Invalid character %c", *start);
-             *err = JsonErr(JSON_ERR_PARSE);
-        }
-        if(json){
-            start = trim(temp, end);
-            if(start < end){
-                TRACE(ERROR,"Invalid character %c after json object", *start);
-                *err = JsonErr(JSON_ERR_PARSE);
-                json_del(json);
-                json = NULL;
-            }
+                break;
+
+            case PARSE_NEXT:
+                frame = &p->stack[p->depth - 1];
+                if(token >= end){
+                    TRACE(ERROR, "Missing %c", (frame->type == JSON_TYPE_DICT) ? '}' : ']');
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if(token != start + *pos){
+                    TRACE(ERROR,"Missing ,");
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                } else if(*token == ','){
+                    token = start + *(pos = structural_next(s, pos));
+                    state = PARSE_MEMBER;
+                } else if(*token == ((frame->type == JSON_TYPE_DICT) ? '}' : ']')){
+                    state = PARSE_CLOSE;
+                } else {
+                    TRACE(ERROR,"Missing ,");
+                    err = JsonErr(JSON_ERR_PARSE);
+                    state = PARSE_ERROR;
+                }
+                break;
+
+            case PARSE_CLOSE:
+                token = start + *(pos = structural_next(s, pos));
+                if((err = emit_container(h, ctx, p->stack[p->depth - 1].type, false)) < 0)
+                    state = PARSE_ERROR;
+                else if(--p->depth)
+                    state = PARSE_NEXT;
+                else
+                    state = PARSE_DONE;
+                break;
+
+            default:
+                return err;
         }
-    } else {
-        TRACE(ERROR, "Invalid arguments");
-        if(err)
-         *err = JsonErr(JSON_ERR_PARSE);
     }
-    return json;
+
+    if(token < end){
+        TRACE(ERROR,"Invalid character %c after json object", *token);
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
 }
 
 /*
-* @brief Print Json Value to stream
-* @param stream Stream for output
+* @brief Print number, it is formatted directly into writer buffer when it has room
+* Inlined, so that switch on type folds into print_val.
+* @param w Writer for output
+* @param json Json Value of INT, UINT, HEX, OCTAL or DOUBLE type
+*/
+static inline __attribute__((always_inline))
+void print_number(struct writer *w, struct json *json)
+{
+    char buffer[MAX2(ITOA_SIZE, DTOA_SIZE)];
+    char *start = writer_room(w, sizeof(buffer));
+    char *pos = start ? start : buffer;
+
+    switch(json->type){
+        case JSON_TYPE_INT:
+            pos += format_int(json->long_number, pos);
+        break;
+        case JSON_TYPE_UINT:
+            pos += format_uint((uint64_t)json->long_number, pos);
+        break;
+        case JSON_TYPE_HEX:
+            memcpy(pos, "0x", 2);
+            pos += 2 + format_hex(json->uint_number, pos + 2);
+        break;
+        case JSON_TYPE_OCTAL:
+            *pos++ = '0';
+            pos += format_octal(json->uint_number, pos);
+        break;
+        default:
+            pos += format_double(json->double_number, pos);
+        break;
+    }
+    if(start)
+        writer_advance(w, pos - start);
+    else
+        writer_write(w, buffer, pos - buffer);
+}
+
+/*
+* @brief Print Json Value to writer
+* @param w Writer for output
 * @param val Json Value
 * @param indent Indentation to be used for pertty printing
 * @param depth Depth depth inside Json Obect
-* @return number of bytes printed
 */
-static int print_val(FILE *stream, struct json* json, unsigned int indent, unsigned int depth)
+static void print_val(struct writer *w, struct json* json, unsigned int indent, unsigned int depth)
 {
-    int ret = 0;
     switch(json->type){
         case JSON_TYPE_NULL:
-        ret = fprintf(stream, "null");
+            writer_write(w, "null", 4);
         break;
         case JSON_TYPE_DICT:
-            ret = print_dict(stream, json->dict, indent, depth + 1);
+            print_dict(w, json->dict, indent, depth + 1);
         break;
         case JSON_TYPE_STR:
-            ret = fprintf(stream, "\"%s\"", json->str);
+            print_str(w, json->str, json->len);
         break;
         case JSON_TYPE_BOOL:
-            ret = fprintf(stream, "%s", json->boolean == true ? "true" : "false");
+            if(json->boolean)
+                writer_write(w, "true", 4);
+            else
+                writer_write(w, "false", 5);
         break;
         case JSON_TYPE_DOUBLE:
-            ret = fprintf(stream, "%lf", json->double_number);
-        break;
         case JSON_TYPE_INT:
-            ret = fprintf(stream, "%ld", json->long_number);
-        break;
-        /*
-        case JSON_TYPE_LONG:
-            ret = fprintf(stream, "%llu", json->long_number);
-        break;*/
         case JSON_TYPE_UINT:
-            ret = fprintf(stream, "%lu", (unsigned long)json->long_number);
-        break;
         case JSON_TYPE_HEX:
-            ret = fprintf(stream, "0x%0x", json->uint_number);
-        break;
         case JSON_TYPE_OCTAL:
-            ret = fprintf(stream, "0%o", json->uint_number);
+            print_number(w, json);
         break;
         case JSON_TYPE_LIST:
-            ret = print_list(stream, json->list, indent, depth);
+            print_list(w, json->list, indent, depth);
         break;
         case JSON_TYPE_OBJ:
-            ret = print(stream, json->json, indent, depth + 1);
+            print(w, json->json, indent, depth + 1);
         break;
         default:
         TRACE(WARN,"Unknown type:%d", json->type);
         break;
     }
-
-    return ret;
 }
 
 /*
-* @brief Print Indentation to stream
-* @param stream Stream for output
+* @brief Print Indentation to writer, spaces come from a precomputed buffer
+* @param w Writer for output
 * @param indent Indentation to be used for pertty printing
 * @param depth Depth depth inside Json Obect
-* @return number of bytes printed
 */
-static int print_indent(FILE *stream, int indent, int depth)
+static void print_indent(struct writer *w, int indent, int depth)
 {
-    int indentation;
-    if((depth <= 0) ||( indent <= 0)){
-        if(indent)
-            return fprintf(stream, "\n");
-        else
-            return 0;
+    if(indent > 0)
+        writer_char(w, '\n');
+    if((depth > 0) && (indent > 0))
+        writer_spaces(w, (size_t)indent * depth);
+}
+
+/*
+* @brief Print \u escape of UTF-16 code unit
+* @param w Writer for output
+* @param unit code unit
+*/
+static inline void print_unicode(struct writer *w, unsigned int unit)
+{
+    static const char hex[] = "0123456789abcdef";
+    char esc[6] = {'\\', 'u', hex[(unit >> 12) & 0xF], hex[(unit >> 8) & 0xF], hex[(unit >> 4) & 0xF], hex[unit & 0xF]};
+
+    writer_write(w, esc, sizeof(esc));
+}
+
+/*
+* @brief Print one character which needs escaping
+* Non ASCII characters are only seen with JSON_PRINT_ASCII. They are decoded from UTF-8,
+* characters above U+FFFF become a surrogate pair and bytes which are not valid UTF-8
+* are replaced with U+FFFD, one for each byte.
+* @param w Writer for output
+* @param str Character to escape
+* @param end End of string
+* @return Next character
+*/
+static const unsigned char* print_escape(struct writer *w, const unsigned char *str, const unsigned char *end)
+{
+    unsigned int ch = *str;
+    char esc[2] = {'\\'};
+    int len = 1;
+
+    if(ch < 0x80){
+        switch(ch){
+            case '"':  esc[1] = '"';  break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b';  break;
+            case '\f': esc[1] = 'f';  break;
+            case '\n': esc[1] = 'n';  break;
+            case '\r': esc[1] = 'r';  break;
+            case '\t': esc[1] = 't';  break;
+            default:
+                print_unicode(w, ch);
+                return str + 1;
+        }
+        writer_write(w, esc, sizeof(esc));
+        return str + 1;
+    }
+
+    /* Lead byte gives length, overlong forms and surrogates are rejected by range checks */
+    if((ch >= 0xC2) && (ch <= 0xDF) && (end - str >= 2) && ((str[1] & 0xC0) == 0x80)){
+        ch = ((ch & 0x1F) << 6) | (str[1] & 0x3F);
+        len = 2;
+    } else if((ch >= 0xE0) && (ch <= 0xEF) && (end - str >= 3) && ((str[1] & 0xC0) == 0x80) && ((str[2] & 0xC0) == 0x80)){
+        ch = ((ch & 0x0F) << 12) | ((str[1] & 0x3F) << 6) | (str[2] & 0x3F);
+        len = ((ch >= 0x800) && ((ch < 0xD800) || (ch > 0xDFFF))) ? 3 : 1;
+    } else if((ch >= 0xF0) && (ch <= 0xF4) && (end - str >= 4) && ((str[1] & 0xC0) == 0x80) &&
+              ((str[2] & 0xC0) == 0x80) && ((str[3] & 0xC0) == 0x80)){
+        ch = ((ch & 0x07) << 18) | ((str[1] & 0x3F) << 12) | ((str[2] & 0x3F) << 6) | (str[3] & 0x3F);
+        len = ((ch >= 0x10000) && (ch <= 0x10FFFF)) ? 4 : 1;
     }
 
-    indentation = indent * depth;
-    fprintf(stream, "\n%*c",indentation, ' ');
-    return indentation;
+    if(len == 1){
+        print_unicode(w, 0xFFFD);
+    } else if(ch > 0xFFFF){
+        ch -= 0x10000;
+        print_unicode(w, 0xD800 | (ch >> 10));
+        print_unicode(w, 0xDC00 | (ch & 0x3FF));
+    } else {
+        print_unicode(w, ch);
+    }
+    return str + len;
+}
+
+/*
+* @brief Print quoted string to writer, escaping quotes, backslash and control characters
+* Runs of characters which need no escaping are found with SIMD scan and copied at once,
+* with JSON_PRINT_ASCII runs also stop at non ASCII characters. Long runs are not copied
+* when writer sends them with writev.
+* @param w Writer for output
+* @param str String
+* @param len Length of string
+*/
+static void print_str(struct writer *w, const char *str, size_t len)
+{
+    const char *end = str + len;
+    const char *run = NULL;
+    bool ascii = (w->flags & JSON_PRINT_ASCII);
+
+    writer_char(w, '"');
+    while(str < end){
+        run = ascii ? scan_ascii(str, end) : scan_str(str, end);
+        writer_ref(w, str, run - str);
+        if(run == end)
+            break;
+        str = (const char*)print_escape(w, (const unsigned char*)run, (const unsigned char*)end);
+    }
+    writer_char(w, '"');
 }
 
 
 /*
-* @brief Print Json List to stream
-* @param stream Stream for output
+* @brief Print Json List to writer
+* @param w Writer for output
 * @param list Json List
 * @param indent Indentation to be used for pertty printing
 * @param depth Depth depth inside Json Obect
-* @return number of bytes printed
 */
-static int print_list(FILE *stream, struct list *list, unsigned int indent, unsigned int depth)
+static void print_list(struct writer *w, struct list *list, unsigned int indent, unsigned int depth)
 {
-    int ret = 0;
-    struct io_stream io_stream = {.stream = stream, .indent=indent, .depth=depth};
+    struct io_stream io_stream = {.w = w, .indent=indent, .depth=depth};
     if(list){
-        ret += fprintf(stream, "[");
-        ret += list_print(list, &io_stream);
-        ret += fprintf(stream, "]");
+        writer_char(w, '[');
+        list_print(list, &io_stream);
+        writer_char(w, ']');
     }
-    return ret;
 }
 
 static int print_list_cb(void* stream, unsigned int index, void *data)
 {
-    int ret = 0;
     struct io_stream* io_stream = (struct io_stream*)stream;
     if(index){
-        ret += fprintf(io_stream->stream, ",");
+        writer_char(io_stream->w, ',');
     }
-    ret += print_val(io_stream->stream, data, io_stream->indent, io_stream->depth);
-    return ret;
+    print_val(io_stream->w, data, io_stream->indent, io_stream->depth);
+    return 0;
 }
 
 static int print_dict_cb(void* stream, unsigned int index, char *key, void* data)
 {
-    int ret = 0;
     struct io_stream* io_stream = (struct io_stream*)stream;
     if(index){
-        ret += fprintf(io_stream->stream, ",");
+        writer_char(io_stream->w, ',');
     }
-    ret += print_indent(io_stream->stream, io_stream->indent, io_stream->depth + 1);
-    ret += fprintf(io_stream->stream, "\"%s\":", key);
-    ret += print_val(io_stream->stream, data, io_stream->indent, io_stream->depth + 1);
-    return ret;
+    print_indent(io_stream->w, io_stream->indent, io_stream->depth + 1);
+    print_str(io_stream->w, key, strlen(key));
+    writer_char(io_stream->w, ':');
+    print_val(io_stream->w, data, io_stream->indent, io_stream->depth + 1);
+    return 0;
 }
 /*
-* @brief Print Dict to stream
-* @param stream Stream for output
+* @brief Print Dict to writer
+* @param w Writer for output
 * @param json Json object
 * @param indent Indentation to be used for pertty printing
 * @param depth Depth depth inside Json Obect
-* @return number of bytes printed
 */
-static int print_dict(FILE *stream, struct dict *dict, unsigned int indent, unsigned int depth)
+static void print_dict(struct writer *w, struct dict *dict, unsigned int indent, unsigned int depth)
 {
-    int ret = 0;
-    struct io_stream io_stream = {.stream = stream, .indent=indent, .depth=depth};
+    struct io_stream io_stream = {.w = w, .indent=indent, .depth=depth};
     
     /* Check data */
     if(dict){
-        //ret += print_indent(stream, indent, depth);
-        ret += fprintf(stream, "{");
-        ret += dict_print(dict, &io_stream);
-        ret += print_indent(stream, indent, depth);
-        ret += fprintf(stream, "}");
-        //ret += print_indent(stream, indent, depth);
+        writer_char(w, '{');
+        dict_print(dict, &io_stream);
+        print_indent(w, indent, depth);
+        writer_char(w, '}');
     }
-
-    return ret;
 }
 
-static int print(FILE *stream, struct json *json, unsigned int indent, unsigned int depth)
+/*
+* @brief Print json document to writer
+* @param w Writer for output
+* @param json Json object
+* @param indent Indentation to be used for pertty printing
+* @param depth Depth depth inside Json Obect
+* @return JSON_ERR value
+*/
+static int print(struct writer *w, struct json *json, unsigned int indent, unsigned int depth)
 {
-    int ret = -1;
+    int ret = JsonErr(JSON_ERR_SUCCESS);
     if(json){
         if(json->type == JSON_TYPE_OBJ){
-            ret = print(stream, json->json, indent, depth);
+            ret = print(w, json->json, indent, depth);
         } else if(json->type == JSON_TYPE_LIST){
-            ret = print_list(stream, json->list, indent, depth);
+            print_list(w, json->list, indent, depth);
         } else if(json->type == JSON_TYPE_DICT){
-            ret = print_dict(stream, json->dict, indent, depth);
+            print_dict(w, json->dict, indent, depth);
         } else if(json->type == JSON_TYPE_NULL){
-            ret = print_val(stream, json, indent, depth);
+            print_val(w, json, indent, depth);
         } else {
             TRACE(ERROR,"Invalid Json Object : %d", json->type);
             ret = JsonErr(JSON_ERR_ARGS);
@@ -939,24 +1567,178 @@ static int print(FILE *stream, struct json *json, unsigned int indent, unsigned
     return ret;
 }
 
-static void* clone_obj(int type, void* src, int *err)
+/*
+* @brief Flush output of writer
+* @param w Writer for output
+* @return Number of bytes printed, JSON_ERR value for failure
+*/
+static int print_end(struct writer *w)
+{
+    int ret;
+
+    if((ret = writer_flush(w)) < 0)
+        return ret;
+    if(w->total > INT_MAX){
+        TRACE(ERROR, "Output is too large");
+        return JsonErr(JSON_ERR_OVERFLOW);
+    }
+    return w->total;
+}
+
+/*
+* @brief Print json document to writer and flush it
+* @param w Writer for output
+* @param json Json object
+* @param indent Indentation to be used for pertty printing, with enum json_print_flags
+* @return Number of bytes printed, JSON_ERR value for failure
+*/
+static int print_doc(struct writer *w, struct json *json, unsigned int indent)
+{
+    int ret;
+
+    w->flags = indent & ~JSON_PRINT_INDENT_MASK;
+    if((ret = print(w, json, indent & JSON_PRINT_INDENT_MASK, 0)) < 0)
+        return ret;
+    return print_end(w);
+}
+
+/*
+* @brief Set indentation and state of new streaming writer
+* @param jw Streaming writer, its writer is initialized
+* @param indent Indetation for pretty printing, with enum json_print_flags
+*/
+static void writer_init(struct json_writer *jw, unsigned int indent)
+{
+    jw->w.flags = indent & ~JSON_PRINT_INDENT_MASK;
+    jw->indent = indent & JSON_PRINT_INDENT_MASK;
+    jw->depth = 0;
+    jw->status = JsonErr(JSON_ERR_SUCCESS);
+    jw->key = jw->done = false;
+}
+
+/*
+* @brief Check that a value can be written next and write separator before it
+* Document is an object or list, value in object needs a key before it.
+* @param jw Streaming writer
+* @param container Value is an object or list
+* @return JSON_ERR value
+*/
+static int writer_value(struct json_writer *jw, bool container)
+{
+    struct writer_level *top = NULL;
+
+    if(jw->status < 0)
+        return jw->status;
+    if(!jw->depth){
+        if(jw->done || !container){
+            TRACE(ERROR, "Value outside of document");
+            return (jw->status = JsonErr(JSON_ERR_ARGS));
+        }
+        return JsonErr(JSON_ERR_SUCCESS);
+    }
+    top = &jw->stack[jw->depth - 1];
+    if(top->type == JSON_TYPE_DICT){
+        if(!jw->key){
+            TRACE(ERROR, "Value in object without key");
+            return (jw->status = JsonErr(JSON_ERR_ARGS));
+        }
+        jw->key = false;
+    } else {
+        if(top->count)
+            writer_char(&jw->w, ',');
+        top->count = 1;
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Start object or list
+* Indentation depth follows print_val, so output is same as printing the document.
+* @param jw Streaming writer
+* @param type JSON_TYPE_DICT or JSON_TYPE_LIST
+* @param ch Opening character
+* @return JSON_ERR value
+*/
+static int writer_open(struct json_writer *jw, int type, char ch)
+{
+    struct writer_level *level = NULL;
+    int ret;
+
+    if((ret = writer_value(jw, true)) < 0)
+        return ret;
+    if(jw->depth >= JSON_DEPTH_MAX){
+        TRACE(ERROR, "Too deep nesting");
+        return (jw->status = JsonErr(JSON_ERR_DEPTH));
+    }
+    level = &jw->stack[jw->depth];
+    level->depth = 0;
+    if(jw->depth)
+        level->depth = level[-1].depth + (level[-1].type == JSON_TYPE_DICT) + (type == JSON_TYPE_DICT);
+    level->type = type;
+    level->count = 0;
+    jw->depth++;
+    writer_char(&jw->w, ch);
+    return jw->w.err;
+}
+
+/*
+* @brief End innermost object or list
+* @param jw Streaming writer
+* @param type JSON_TYPE_DICT or JSON_TYPE_LIST
+* @param ch Closing character
+* @return JSON_ERR value
+*/
+static int writer_close(struct json_writer *jw, int type, char ch)
+{
+    struct writer_level *top = jw->depth ? &jw->stack[jw->depth - 1] : NULL;
+
+    if(jw->status < 0)
+        return jw->status;
+    if(!top || (top->type != type) || jw->key){
+        TRACE(ERROR, "End does not match open container");
+        return (jw->status = JsonErr(JSON_ERR_ARGS));
+    }
+    if(type == JSON_TYPE_DICT)
+        print_indent(&jw->w, jw->indent, top->depth);
+    writer_char(&jw->w, ch);
+    jw->done = !--jw->depth;
+    return jw->w.err;
+}
+
+/*
+* @brief Write number value
+* @param jw Streaming writer
+* @param json Number
+* @return JSON_ERR value
+*/
+static int writer_number(struct json_writer *jw, struct json *json)
+{
+    int ret;
+
+    if((ret = writer_value(jw, false)) < 0)
+        return ret;
+    print_number(&jw->w, json);
+    return jw->w.err;
+}
+
+static void* clone_obj(struct arena *arena, int type, void* src, int *err)
 {
     void *data = NULL;
     if(src && err){
         switch(type){
             case JSON_TYPE_STR:
-                if(!(data = strdup(src))){
+                if(!(data = arena_strndup(arena, src, strlen(src)))){
                     *err = JsonErr(JSON_ERR_NO_MEM);
                 }
             break;
             case JSON_TYPE_LIST:
-                data = clone_list(src, err);
+                data = clone_list(arena, src, err);
             break;
             case JSON_TYPE_DICT:
-                data = clone_dict(src, err);
+                data = clone_dict(arena, src, err);
             break;
             case JSON_TYPE_OBJ:
-                data = clone(src, err);
+                data = clone(arena, src, err);
             break;
             default:
                 data = src;
@@ -973,35 +1755,46 @@ static void* clone_obj(int type, void* src, int *err)
 
 /*
 * @brief Clone json value
+* @param arena Arena for allocation, NULL for heap
 * @param src_val Json value to be cloned
 * @param err plcaeholder for error
 * @return Pointer to new generated json value
 */
-struct json* clone(struct json* src, int *err)
+static struct json* clone(struct arena *arena, struct json* src, int *err)
 {
     struct json* json = NULL;
     void* data = NULL;
     if(src){
-        /* Duplicate Json Data */
-        if((data = clone_obj(src->type, src->data, err))){
-            if((src->type != JSON_TYPE_LIST)&&
-               (src->type != JSON_TYPE_DICT)&&
-               (src->type != JSON_TYPE_OBJ)&&
-               (src->type != JSON_TYPE_STR)){
-                /* For Non Pointer data set pointer to buffer from where it will be copied */
-                data = &src->data;
-            }
-            if((json = json_new())){
-                *err = JsonErr(JSON_ERR_SUCCESS);
-                init_val(json, src->type, data);
-            } else {
-                TRACE(ERROR,"Failed to allocate json val");
+        if(src->type == JSON_TYPE_STR){
+            /* String may contain null characters, copy by length */
+            if(!(data = arena_strndup(arena, src->str, src->len))){
+                TRACE(ERROR,"Failed to allocate data");
                 *err = JsonErr(JSON_ERR_NO_MEM);
-                /* Free memory which was allocated for clone */
-                free_obj(src->type, data);
+                return NULL;
+            }
+        } else if((src->type == JSON_TYPE_LIST)||
+           (src->type == JSON_TYPE_DICT)||
+           (src->type == JSON_TYPE_OBJ)){
+            /* Duplicate Json Data */
+            if(!(data = clone_obj(arena, src->type, src->data, err))){
+                TRACE(ERROR,"Failed to allocate data");
+                return NULL;
             }
         } else {
-            TRACE(ERROR,"Failed to allocate data");
+            /* For Non Pointer data set pointer to buffer from where it will be copied */
+            data = &src->data;
+        }
+
+        if((json = json_alloc(arena))){
+            *err = JsonErr(JSON_ERR_SUCCESS);
+            init_val(json, src->type, data);
+            json->len = src->len;
+        } else {
+            TRACE(ERROR,"Failed to allocate json val");
+            *err = JsonErr(JSON_ERR_NO_MEM);
+            /* Free memory which was allocated for clone */
+            if(data != &src->data)
+                free_obj(arena, src->type, data);
         }
     }
 
@@ -1010,11 +1803,12 @@ struct json* clone(struct json* src, int *err)
 
 /*
 * @brief Clone json list
+* @param arena Arena for allocation, NULL for heap
 * @param src_list Json list to be cloned
 * @param err plcaeholder for error
 * @return Pointer to new generated json list
 */
-static struct list* clone_list(struct list *src_list, int *err)
+static struct list* clone_list(struct arena *arena, struct list *src_list, int *err)
 {
     struct list* list = NULL;
     struct json* src_json = NULL;
@@ -1023,9 +1817,10 @@ static struct list* clone_list(struct list *src_list, int *err)
 
     if(src_list){
         if((iter = list_iter(src_list))){
-            if((list = list_new((list_free_t)json_del, (list_cmp_t)json_cmp, (list_print_t)print_list_cb))){
+            if((list = new_list(arena))){
+                list_reserve(list, list_size(src_list));
                 for(src_json = iter_next(iter); src_json; src_json = iter_next(iter)){
-                    if((json = json_clone(src_json, err))){
+                    if((json = clone(arena, src_json, err))){
                         if((list_add(list, json)) < 0){
                             TRACE(ERROR,"Failed to add in list");
                             list_del(list);
@@ -1050,7 +1845,7 @@ static struct list* clone_list(struct list *src_list, int *err)
     return list;
 }
 
-static struct dict* clone_dict(struct dict *src_dict, int *err)
+static struct dict* clone_dict(struct arena *arena, struct dict *src_dict, int *err)
 {
     struct dict *dict = NULL;
     struct json *json = NULL;
@@ -1059,13 +1854,13 @@ static struct dict* clone_dict(struct dict *src_dict, int *err)
     if(src_dict && err){
         /* Iterator for original dict */
         if((iter = dict_iter(src_dict))){
-            if((dict = dict_new((dict_free_t)json_del, (dict_cmp_t)json_cmp, (dict_print_t)print_dict_cb))){
+            if((dict = new_dict(arena))){
                 /* Traverse entire dict and duplicate*/
                 for(key = iter_next(iter); key; key = iter_next(iter)){
                     /* duplicate key */
                     /* Value should be here, if not found some internal error occurred*/
                     if((json = dict_get(src_dict, key))){
-                        if((json = json_clone(json, err))){
+                        if((json = clone(arena, json, err))){
                             if((dict_set(dict, key, json))>=0){
                                 *err = JsonErr(JSON_ERR_SUCCESS);
                             } else {
@@ -1094,37 +1889,698 @@ static struct dict* clone_dict(struct dict *src_dict, int *err)
         }
     } else {
         TRACE(ERROR, "Invalid arguments");
-        if(err)
-            *err = JsonErr(JSON_ERR_ARGS);
+        if(err)
+            *err = JsonErr(JSON_ERR_ARGS);
+    }
+    return dict;
+}
+
+/*
+* @brief Load a json oject from buffer
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_loads(char *start, char* end, int *err)
+{
+    return json_loads_opts(start, end, NULL, err);
+}
+
+/*
+* @brief Initialize parser context
+* @param p Parser context, released with parser_free
+* @param opts Parser options, NULL for defaults
+*/
+static void parser_init(struct parser *p, const struct json_opts *opts)
+{
+    memset(p, 0, offsetof(struct parser, local));
+    p->opts = opts ? opts : &default_opts;
+    p->stack = p->local;
+    p->depth = 0;
+    p->stack_size = PARSER_STACK_INIT;
+    p->max_depth = p->opts->max_depth ? p->opts->max_depth : JSON_DEPTH_MAX;
+}
+
+/*
+* @brief Release buffers of parser context, document is not released
+* @param p Parser context
+*/
+static void parser_free(struct parser *p)
+{
+    free(p->scratch);
+    free(p->keys);
+    if(p->stack != p->local)
+        free(p->stack);
+}
+
+/*
+* @brief Load a json object from buffer
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options, NULL for defaults
+* @param indexed Build structural index of buffer before parsing
+* @param err Pointer for error status
+* @return Json object
+*/
+static struct json* loads(char *start, char* end, const struct json_opts *opts, bool indexed, int *err)
+{
+    struct json *json = NULL;
+    struct structural s;
+    struct parser p;
+    int status = JsonErr(JSON_ERR_SUCCESS);
+
+    parser_init(&p, opts);
+
+    /* Check data */
+    if( start && end && (start < end) ){
+        /* Document in arena, size of input is good estimate of memory needed */
+        if((p.opts->flags & JSON_OPT_ARENA) && !(p.arena = arena_new(end - start))){
+            TRACE(ERROR,"Failed to allocate arena");
+            if(err)
+                *err = JsonErr(JSON_ERR_NO_MEM);
+            return NULL;
+        }
+        /* Process Buffer, index has 32 bit offsets */
+        if(!indexed || ((size_t)(end - start) > STRUCTURAL_MAX)){
+            status = parse(start, end, &dom_handler, &p, &p, false);
+        } else if(structural_init(&s, start, end) < 0){
+            status = JsonErr(JSON_ERR_NO_MEM);
+        } else {
+            status = parse_index(start, end, &s, &dom_handler, &p, &p);
+            structural_free(&s);
+        }
+        if(status < 0)
+            parser_unwind(&p);
+        json = p.root;
+        parser_free(&p);
+        if(p.arena){
+            if(json){
+                /* Root owns the arena from now on */
+                json->flags |= JSON_FLAG_DOC;
+            } else {
+                arena_del(p.arena);
+            }
+        }
+        if(err)
+            *err = status;
+    } else if(start && end){
+        /* Nothing to parse */
+        TRACE(ERROR, "Invalid arguments");
+        if(err)
+            *err = JsonErr(JSON_ERR_PARSE);
+    } else {
+        /* Invalid input */
+        TRACE(ERROR,"Invalid params");
+        if(err) 
+            *err = JsonErr(JSON_ERR_ARGS);
+    }
+
+    return json;
+}
+
+/*
+* @brief Load a json oject from buffer with parser options
+* With JSON_OPT_INSITU buffer is modified and must outlive the returned json
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options, NULL for defaults
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_loads_opts(char *start, char* end, const struct json_opts *opts, int *err)
+{
+    return loads(start, end, opts, false, err);
+}
+
+/*
+* @brief Load a json oject from buffer in two stages
+* First stage finds structural characters with vector instructions, a window at a time,
+* second stage builds the same json as json_loads_opts from them.
+* Meant for large documents, index needs a bit for each byte of buffer.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options, NULL for defaults
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_loads_index(char *start, char* end, const struct json_opts *opts, int *err)
+{
+    return loads(start, end, opts, true, err);
+}
+
+/*
+* @brief Load a json oject from read only buffer
+* Input is never written, buffer can be a string literal, a read only mapping
+* or shared with threads still reading it. JSON_OPT_INSITU is ignored,
+* strings and keys are always copied and buffer can be released after parsing.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options, NULL for defaults
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_loads_const(const char *start, const char *end, const struct json_opts *opts, int *err)
+{
+    struct json_opts copy = opts ? *opts : default_opts;
+
+    /* Parser writes buffer only to decode strings in situ */
+    copy.flags &= ~JSON_OPT_INSITU;
+    return loads((char*)start, (char*)end, &copy, false, err);
+}
+
+/* Part of a list parsed by worker pool */
+struct part
+{
+    char *start;                /* Members of list, without brackets */
+    char *end;
+    struct json *root;          /* List of members */
+    struct arena *arena;        /* Arena of list */
+};
+
+/* List split in parts */
+struct parts
+{
+    const struct json_opts *opts;
+    struct part *part;
+};
+
+/*
+* @brief Parse a part of list in its own arena, job of worker pool
+* @param arg List split in parts
+* @param index Part to parse
+* @return JSON_ERR value
+*/
+static int parse_part(void *arg, size_t index)
+{
+    struct parts *parts = arg;
+    struct part *part = &parts->part[index];
+    struct parser p;
+    int status;
+
+    parser_init(&p, parts->opts);
+    if((p.opts->flags & JSON_OPT_ARENA) && !(p.arena = arena_new(part->end - part->start))){
+        TRACE(ERROR,"Failed to allocate arena");
+        return JsonErr(JSON_ERR_NO_MEM);
+    }
+    if((status = parse(part->start, part->end, &dom_handler, &p, &p, true)) < 0){
+        parser_unwind(&p);
+        if(p.arena)
+            arena_del(p.arena);
+        p.arena = NULL;
+    }
+    part->root = p.root;
+    part->arena = p.arena;
+    parser_free(&p);
+    return status;
+}
+
+/*
+* @brief Load a json list from read only buffer, members are parsed by a pool of threads
+* Quote aware pre-scan splits list between its members, parts are parsed concurrently,
+* each in its own arena, and joined in order into one list. Result is the same as
+* json_loads_const, other documents and small buffers are parsed by calling thread.
+* If any part fails whole buffer is parsed again by one thread, to report same error.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options, NULL for defaults, JSON_OPT_INSITU is ignored
+* @param threads Number of threads, 0 for number of cpus
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_loads_parallel(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, int *err)
+{
+    struct json_opts copy = opts ? *opts : default_opts;
+    const char *splits[PARALLEL_PARTS_MAX];
+    struct part part[PARALLEL_PARTS_MAX];
+    struct parts parts = {.opts = &copy, .part = part};
+    struct json *json = NULL;
+    const char *first = NULL;
+    const char *close = NULL;
+    size_t count = 0, total = 0, i;
+    int status;
+
+    copy.flags &= ~JSON_OPT_INSITU;
+    threads = pool_threads(threads);
+    count = ((threads * PARALLEL_PARTS) < PARALLEL_PARTS_MAX) ? (threads * PARALLEL_PARTS) : PARALLEL_PARTS_MAX;
+
+    /* Only a large list is worth splitting, last split is found with closing bracket */
+    if((threads > 1) && start && end && ((end - start) >= PARALLEL_MIN) &&
+       ((first = trim(start, end)) < end) && (*first == '[')){
+        count--;
+        close = structural_split(first, end, (end - first) / (count + 1), splits, &count);
+    }
+    if(!close || !count || (trim(close + 1, end) < end))
+        return loads((char*)start, (char*)end, &copy, false, err);
+
+    memset(part, 0, sizeof(part));
+    for(i = 0; i <= count; i++){
+        part[i].start = (char*)(i ? splits[i - 1] + 1 : first + 1);
+        part[i].end = (char*)((i < count) ? splits[i] : close);
+    }
+    status = pool_run(threads, count + 1, parse_part, &parts);
+
+    /* Members are moved to list of first part, arenas are merged into its arena */
+    for(i = 0; (status >= 0) && (i <= count); i++)
+        total += list_size(part[i].root->list);
+    if((status >= 0) && (list_reserve(part[0].root->list, total) < 0))
+        status = JsonErr(JSON_ERR_NO_MEM);
+    for(i = 1; (status >= 0) && (i <= count); i++){
+        list_append(part[0].root->list, part[i].root->list);
+        if(part[i].arena){
+            arena_merge(part[0].arena, part[i].arena);
+        } else {
+            json_del(part[i].root);
+        }
+        part[i].root = NULL;
+        part[i].arena = NULL;
+    }
+    if(status < 0){
+        for(i = 0; i <= count; i++){
+            if(part[i].arena)
+                arena_del(part[i].arena);
+            else if(part[i].root)
+                json_del(part[i].root);
+        }
+        TRACE(ERROR, "Failed to parse list in parts, parse it again to find error");
+        return loads((char*)start, (char*)end, &copy, false, err);
+    }
+    json = part[0].root;
+    if(part[0].arena){
+        /* Root owns the arena from now on */
+        json->flags |= JSON_FLAG_DOC;
+    }
+    if(err)
+        *err = status;
+    return json;
+}
+
+/*
+* @brief Parse json buffer and report its values to handler, without building json
+* Nothing is allocated for values, escaped strings and keys are decoded in a buffer
+* reused by parser. With JSON_OPT_INSITU they are decoded inside input buffer instead.
+* Other options are ignored except nesting depth, repeated keys are reported as they are.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param handler Callbacks for values
+* @param ctx Context passed to callbacks
+* @param opts Parser options, NULL for defaults
+* @return JSON_ERR value, or error returned by callback
+*/
+int json_sax(char *start, char *end, const struct json_handler *handler, void *ctx, const struct json_opts *opts)
+{
+    struct parser p;
+    int status = JsonErr(JSON_ERR_SUCCESS);
+
+    if(!start || !end || !handler){
+        TRACE(ERROR, "Invalid params");
+        return JsonErr(JSON_ERR_ARGS);
+    } else if(start >= end){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    parser_init(&p, opts);
+    status = parse(start, end, handler, ctx, &p, false);
+    parser_free(&p);
+    return status;
+}
+
+/*
+* @brief Find closing quote of string which may continue in next chunk
+* String is checked on the way, escapes and invalid characters are noted in push parser.
+* @param start first character after opening quote, or after previous part of string
+* @param end end of chunk
+* @param js Push parser, backslash at end of previous part escapes first character
+* @return closing quote, NULL if string does not end in chunk
+*/
+static inline char* stream_quote(char *start, char *end, struct json_stream *js)
+{
+    if(js->escape){
+        if(start >= end)
+            return NULL;
+        js->escape = false;
+        start++;
+    }
+    for(; (start = (char*)scan_str(start, end)) < end; start++){
+        if(*start == '"'){
+            return start;
+        } else if(*start == '\\'){
+            js->escaped = true;
+            if(++start >= end){
+                js->escape = true;
+                return NULL;
+            }
+        } else if((*start != '\n') && (*start != '\r') && (*start != '\t')){
+            /* For now we allow line break, other control characters are invalid */
+            js->invalid = true;
+        }
+    }
+    return NULL;
+}
+
+/*
+* @brief Find end of value other than string, object or list
+* @param start first character of value
+* @param end end of chunk
+* @return first character after value, NULL if value may continue in next chunk
+*/
+static char* stream_scalar(char *start, char *end)
+{
+    for(; start < end; start++){
+        if(scan_is_ws(*start))
+            return start;
+        switch(*start){
+            case ',': case ':': case '"':
+            case '{': case '}': case '[': case ']':
+                return start;
+            default:
+                break;
+        }
+    }
+    return NULL;
+}
+
+/*
+* @brief Report complete token to handler
+* Keys are always copied to scratch buffer, as chunk is gone before value is complete.
+* @param js Push parser
+* @param h Event handler
+* @param ctx Context of handler
+* @param type enum stream_token
+* @param start first character of token, opening quote for strings
+* @param end end of token, after closing quote for strings
+* @return JSON_ERR value
+*/
+static inline __attribute__((always_inline))
+int stream_token(struct json_stream *js, const struct json_handler *h, void *ctx, int type, char *start, char *end)
+{
+    struct parser *p = &js->p;
+    struct token t;
+    char *key = NULL;
+    char *temp = NULL;
+    int err = JsonErr(JSON_ERR_SUCCESS);
+
+    if(type == STREAM_SCALAR){
+        if((err = parse_token(start, end, &temp, &t, p)) < 0)
+            return err;
+        if(temp != end){
+            TRACE(ERROR, "Invalid character %c in value", *temp);
+            return JsonErr(JSON_ERR_PARSE);
+        }
+        js->state = STREAM_NEXT;
+        return emit_token(h, ctx, &t);
+    }
+
+    /* String was checked while its closing quote was found */
+    t.len = end - start - 2;
+    if(js->invalid || !(t.str = decode_str(start + 1, &t.len, js->escaped, p))){
+        TRACE(ERROR, "Failed to parse string");
+        return JsonErr(JSON_ERR_PARSE);
+    }
+    if(type == STREAM_STR){
+        t.type = JSON_TYPE_STR;
+        js->state = STREAM_NEXT;
+        return emit_token(h, ctx, &t);
+    }
+    if(t.str != p->scratch){
+        if(!(key = parser_scratch(p, t.len + 1)))
+            return JsonErr(JSON_ERR_NO_MEM);
+        memcpy(key, t.str, t.len);
+        t.str = key;
+    }
+    js->state = STREAM_COLON;
+    return h->key ? h->key(ctx, t.str, t.len) : 0;
+}
+
+/*
+* @brief Keep start of token which continues in next chunk
+* @param js Push parser
+* @param type enum stream_token
+* @param start first character of token
+* @param len length of token in chunk
+* @return JSON_ERR value
+*/
+static int stream_pending(struct json_stream *js, int type, const char *start, size_t len)
+{
+    char *pending = NULL;
+    size_t size = 0;
+
+    if(js->pending_len + len > js->pending_size){
+        size = (js->pending_len + len) * 2;
+        if(!(pending = realloc(js->pending, size))){
+            TRACE(ERROR, "Failed to allocate pending token");
+            return JsonErr(JSON_ERR_NO_MEM);
+        }
+        js->pending = pending;
+        js->pending_size = size;
+    }
+    if(len)
+        memcpy(js->pending + js->pending_len, start, len);
+    js->pending_len += len;
+    js->pending_type = type;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Parse chunk from state left by previous chunk
+* Parser stops between tokens at end of chunk, token which does not end in chunk is kept pending.
+* Inlined for document builder, so that it is called directly.
+* @param js Push parser
+* @param h Event handler
+* @param ctx Context of handler
+* @param start Pointer to start of chunk, after pending token
+* @param end Pointer to end of chunk
+* @return JSON_ERR value
+*/
+static inline __attribute__((always_inline))
+int stream_run(struct json_stream *js, const struct json_handler *h, void *ctx, char *start, char *end)
+{
+    struct parser *p = &js->p;
+    struct frame *frame = NULL;
+    char *stop = NULL;
+    int type = STREAM_NONE;
+    int err = JsonErr(JSON_ERR_SUCCESS);
+    char close;
+
+    while((start = trim(start, end)) < end){
+        frame = p->depth ? &p->stack[p->depth - 1] : NULL;
+        close = (frame && (frame->type == JSON_TYPE_DICT)) ? '}' : ']';
+        type = STREAM_NONE;
+        switch(js->state){
+            case STREAM_ROOT:
+                /* Object should start with { or [ */
+                if((*start != '{') && (*start != '[')){
+                    TRACE(ERROR,"Failed to parse JSON Object Invalid character %c", *start);
+                    return JsonErr(JSON_ERR_PARSE);
+                }
+                js->state = STREAM_VALUE;
+                continue;
+
+            case STREAM_FIRST:
+            case STREAM_MEMBER:
+                if((js->state == STREAM_FIRST) && (*start == close)){
+                    /* Empty container */
+                    js->state = STREAM_NEXT;
+                    continue;
+                } else if(frame->type == JSON_TYPE_LIST){
+                    js->state = STREAM_VALUE;
+                    continue;
+                } else if(*start != '"'){
+                    TRACE(ERROR,"Missing Key, should start with \"");
+                    return JsonErr(JSON_ERR_PARSE);
+                }
+                type = STREAM_KEY;
+                break;
+
+            case STREAM_COLON:
+                if(*start != ':'){
+                    TRACE(ERROR,"Missing :");
+                    return JsonErr(JSON_ERR_PARSE);
+                }
+                start++;
+                js->state = STREAM_VALUE;
+                continue;
+
+            case STREAM_VALUE:
+                if((*start == '{') || (*start == '[')){
+                    if(!(frame = parser_push(p, (*start == '{') ? JSON_TYPE_DICT : JSON_TYPE_LIST, &err)) ||
+                       ((err = emit_container(h, ctx, frame->type, true)) < 0))
+                        return err;
+                    start++;
+                    js->state = STREAM_FIRST;
+                    continue;
+                }
+                type = (*start == '"') ? STREAM_STR : STREAM_SCALAR;
+                break;
+
+            case STREAM_NEXT:
+                if(*start == ','){
+                    start++;
+                    js->state = STREAM_MEMBER;
+                } else if(*start == close){
+                    start++;
+                    if((err = emit_container(h, ctx, frame->type, false)) < 0)
+                        return err;
+                    js->state = --p->depth ? STREAM_NEXT : STREAM_DONE;
+                } else {
+                    TRACE(ERROR,"Missing ,");
+                    return JsonErr(JSON_ERR_PARSE);
+                }
+                continue;
+
+            default:
+                TRACE(ERROR,"Invalid character %c after json object", *start);
+                return JsonErr(JSON_ERR_PARSE);
+        }
+
+        /* Token, kept pending if it does not end in chunk */
+        js->escape = js->escaped = js->invalid = false;
+        if(type == STREAM_SCALAR)
+            stop = stream_scalar(start, end);
+        else if((stop = stream_quote(start + 1, end, js)))
+            stop++;
+        if(!stop)
+            return stream_pending(js, type, start, end - start);
+        if((err = stream_token(js, h, ctx, type, start, stop)) < 0)
+            return err;
+        start = stop;
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Create push parser, input is given a chunk at a time with json_stream_feed
+* Without handler json document is built, else values are reported to handler as with json_sax.
+* JSON_OPT_INSITU is ignored, chunks are not kept.
+* @param handler Callbacks for values, NULL to build json document
+* @param ctx Context passed to callbacks
+* @param opts Parser options, NULL for defaults
+* @return Push parser, released with json_stream_del
+*/
+struct json_stream* json_stream_new(const struct json_handler *handler, void *ctx, const struct json_opts *opts)
+{
+    struct json_stream *js = NULL;
+
+    if(!(js = calloc(1, sizeof(struct json_stream)))){
+        TRACE(ERROR, "Failed to allocate push parser");
+        return NULL;
+    }
+    js->opts = opts ? *opts : default_opts;
+    js->opts.flags &= ~JSON_OPT_INSITU;
+    parser_init(&js->p, &js->opts);
+    js->h = handler ? handler : &dom_handler;
+    js->ctx = handler ? ctx : &js->p;
+    js->state = STREAM_ROOT;
+    if(!handler && (js->opts.flags & JSON_OPT_ARENA) && !(js->p.arena = arena_new(0))){
+        TRACE(ERROR, "Failed to allocate arena");
+        free(js);
+        return NULL;
+    }
+    return js;
+}
+
+/*
+* @brief Parse next chunk of input
+* Chunk is not needed after the call, tokens split across chunks are kept by parser.
+* @param js Push parser
+* @param chunk Next part of input
+* @param len Length of chunk
+* @return 1 when document is complete, 0 if more input is needed, JSON_ERR value on failure
+*/
+int json_stream_feed(struct json_stream *js, const char *chunk, size_t len)
+{
+    char *start = (char*)chunk;
+    char *end = start + len;
+    char *stop = NULL;
+    int type = STREAM_NONE;
+    size_t n = len;
+
+    if(!js || (!chunk && len)){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    } else if(js->status < 0){
+        return js->status;
     }
-    return dict;
-}
 
+    if(len && (js->pending_type != STREAM_NONE)){
+        /* Complete token left by previous chunk */
+        if(js->pending_type == STREAM_SCALAR)
+            stop = stream_scalar(start, end);
+        else if((stop = stream_quote(start, end, js)))
+            stop++;
+        if(stop)
+            n = stop - start;
+        if(((js->status = stream_pending(js, js->pending_type, start, n)) >= 0) && stop){
+            type = js->pending_type;
+            n = js->pending_len;
+            js->pending_type = STREAM_NONE;
+            js->pending_len = 0;
+            js->status = stream_token(js, js->h, js->ctx, type, js->pending, js->pending + n);
+        }
+        start = stop ? stop : end;
+    }
+    if((js->status < 0) || (js->pending_type != STREAM_NONE))
+        ;
+    else if(js->h == &dom_handler)
+        js->status = stream_run(js, &dom_handler, &js->p, start, end);
+    else
+        js->status = stream_run(js, js->h, js->ctx, start, end);
+
+    if(js->status < 0){
+        /* Release what was built so far */
+        parser_unwind(&js->p);
+        return js->status;
+    }
+    return (js->state == STREAM_DONE);
+}
 /*
-* @brief Load a json oject from buffer
-* @param start Pointer to start of buffer
-* @param end Pointer to end of buffer
-* @param err Pointer for error status
-* @return Json object
+* @brief End input of push parser
+* @param js Push parser
+* @param err Pointer for error status, JSON_ERR_PARSE if document is not complete
+* @return Json document, caller owns it, NULL if parser has a handler
 */
-struct json* json_loads(char *start, char* end, int *err)
+struct json* json_stream_end(struct json_stream *js, int *err)
 {
     struct json *json = NULL;
+    int status = JsonErr(JSON_ERR_SUCCESS);
 
-    /* Check data */
-    if( start && end ){
-        /* Process Buffer */
-        json = parse(start, end, err);
-    } else {
-        /* Invalid input */
-        TRACE(ERROR,"Invalid params");
-        if(err) 
-            *err = JsonErr(JSON_ERR_ARGS);
+    if(!js){
+        TRACE(ERROR, "Invalid arguments");
+        status = JsonErr(JSON_ERR_ARGS);
+    } else if((status = js->status) >= 0){
+        if(js->state != STREAM_DONE){
+            TRACE(ERROR, "Document is not complete");
+            status = js->status = JsonErr(JSON_ERR_PARSE);
+            parser_unwind(&js->p);
+        } else if((json = js->p.root)){
+            /* Document and its arena belong to caller from now on */
+            if(js->p.arena)
+                json->flags |= JSON_FLAG_DOC;
+            js->p.root = NULL;
+            js->p.arena = NULL;
+        }
     }
-
+    if(err)
+        *err = status;
     return json;
 }
 
+/*
+* @brief Delete push parser, with document if it was not taken by json_stream_end
+* @param js Push parser
+*/
+void json_stream_del(struct json_stream *js)
+{
+    if(js){
+        parser_unwind(&js->p);
+        parser_free(&js->p);
+        if(js->p.arena)
+            arena_del(js->p.arena);
+        free(js->pending);
+        free(js);
+    }
+}
+
 /*
 * @brief Load a json oject from file
 * @param fname filename
@@ -1132,24 +2588,34 @@ struct json* json_loads(char *start, char* end, int *err)
 * @return Json object
 */
 struct json* json_load(char* fname, int *err)
+{
+    return json_load_opts(fname, NULL, err);
+}
+
+/*
+* @brief Load a json oject from file with parser options
+* @param fname filename
+* @param opts Parser options, NULL for defaults
+* @param err Pointer for error status
+* @return Json object
+*/
+struct json* json_load_opts(char* fname, const struct json_opts *opts, int *err)
 {
     struct json* json = NULL;
-    unsigned int len = 0;
+    size_t len = 0;
+    bool mapped = false;
     char *buffer = NULL;
 
     /* Check for data*/
     if(fname){
-        /* Read all data */
-        buffer = readall(fname, &len);
+        /* Map file, or read all data if it can not be mapped */
+        buffer = mapall(fname, &len, &mapped);
 
         /* Check if data was read correctly */            
         if(( len > 0 ) && buffer){
 
-            /* Start Parsing */
-            json = json_loads(buffer, buffer + len, err);
-
-            /* Free Buffer */ 
-            free(buffer); 
+            /* Start Parsing, mapped file is read only and released after parsing */
+            json = json_loads_const(buffer, buffer + len, opts, err);
         } else {
             /* Failed to read file in buffer*/
             TRACE(ERROR,"Failed to read file : %s", fname);
@@ -1158,6 +2624,9 @@ struct json* json_load(char* fname, int *err)
                 *err = JsonErr(JSON_ERR_SYS);
             json = NULL;
         }
+        /* Release Buffer */
+        if(buffer)
+            unmapall(buffer, len, mapped);
     } else {
         /* Invalid arguments*/
         TRACE(ERROR,"Invalid args");
@@ -1167,6 +2636,123 @@ struct json* json_load(char* fname, int *err)
     return json;
 }
 
+/*
+* @brief Build json value at cursor
+* Object or list is parsed like a document of its own, any other value becomes
+* a document holding only that value. Rest of buffer is not looked at.
+* With JSON_OPT_INSITU buffer is modified, cursors into it can not be used anymore.
+* @param cur cursor at value
+* @param opts Parser options, NULL for defaults
+* @param err Pointer for error status
+* @return Json value
+*/
+struct json* json_cursor_json(const struct json_cursor *cur, const struct json_opts *opts, int *err)
+{
+    struct json *json = NULL;
+    struct json *root = NULL;
+    struct parser p;
+    struct token t;
+    char *last = NULL;
+    char *temp = NULL;
+    int status = JsonErr(JSON_ERR_SUCCESS);
+
+    if(!cur || !cur->start || !cur->end || (cur->start >= cur->end)){
+        TRACE(ERROR, "Invalid arguments");
+        if(err)
+            *err = JsonErr(JSON_ERR_ARGS);
+        return NULL;
+    }
+    if((*cur->start == '{') || (*cur->start == '[')){
+        if(!(last = (char*)structural_skip(cur->start, cur->end))){
+            if(err)
+                *err = JsonErr(JSON_ERR_PARSE);
+            return NULL;
+        }
+        return json_loads_opts(cur->start, last, opts, err);
+    }
+
+    /* Single value, arena of default size */
+    parser_init(&p, opts);
+    if((p.opts->flags & JSON_OPT_ARENA) && !(p.arena = arena_new(0))){
+        TRACE(ERROR,"Failed to allocate arena");
+        if(err)
+            *err = JsonErr(JSON_ERR_NO_MEM);
+        return NULL;
+    }
+    if(((status = parse_token(cur->start, cur->end, &temp, &t, &p)) >= 0) &&
+       ((status = emit_token(&dom_handler, &p, &t)) >= 0)){
+        json = p.root;
+        temp = trim(temp, cur->end);
+        if((temp < cur->end) && (*temp != ',') && (*temp != '}') && (*temp != ']')){
+            TRACE(ERROR,"Invalid character %c after value", *temp);
+            status = JsonErr(JSON_ERR_PARSE);
+            json_del(json);
+            json = NULL;
+        } else if(p.arena){
+            /* Value is moved to document root, which owns the arena */
+            if((root = json_root(&p))){
+                *root = *json;
+                root->flags |= JSON_FLAG_DOC;
+            } else {
+                status = JsonErr(JSON_ERR_NO_MEM);
+            }
+            json = root;
+        }
+    }
+    parser_free(&p);
+    if(p.arena && !json)
+        arena_del(p.arena);
+    if(err)
+        *err = status;
+    return json;
+}
+
+/*
+* @brief Load a json oject from buffer, allocating whole document from an arena
+* Values of document are released together with json_doc_del
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param err Pointer for error status
+* @return Json document
+*/
+struct json* json_loads_arena(char *start, char* end, int *err)
+{
+    struct json_opts opts = default_opts;
+    opts.flags |= JSON_OPT_ARENA;
+    return json_loads_opts(start, end, &opts, err);
+}
+
+/*
+* @brief Delete json document
+* Arena of document is released at once, heap allocated json is deleted normally
+* @param json Json document
+*/
+void json_doc_del(struct json *json)
+{
+    json_del(json);
+}
+
+/*
+* @brief Get memory usage of json document
+* @param json Json document
+* @param used Placeholder for bytes allocated from arena, can be NULL
+* @param reserved Placeholder for bytes reserved by arena, can be NULL
+* @return JSON_ERR Value
+*/
+int json_doc_stats(const struct json *json, size_t *used, size_t *reserved)
+{
+    const struct json_doc *doc = (const struct json_doc*)json;
+    if(json && (json->flags & JSON_FLAG_DOC)){
+        if(used)
+            *used = arena_used(doc->arena);
+        if(reserved)
+            *reserved = arena_reserved(doc->arena);
+        return JsonErr(JSON_ERR_SUCCESS);
+    }
+    TRACE(ERROR, "Invalid arguments");
+    return JsonErr(JSON_ERR_ARGS);
+}
+
 /*
 * @brief Print json object to stdout
 * @param json Json object
@@ -1175,7 +2761,48 @@ struct json* json_load(char* fname, int *err)
 */
 int json_print(struct json *json, unsigned int indent)
 {
-    return print(stdout, json, indent, 0);
+    return json_printfp(json, stdout, indent);
+}
+
+/*
+* @brief Print json object to stream
+* Output is formatted in a buffer and written with few fwrite calls
+* @param json Json object
+* @param fp Stream for output
+* @param indent Indetation for pretty printing
+* @return Number of bytes printed
+*/
+int json_printfp(struct json *json, FILE *fp, unsigned int indent)
+{
+    struct writer w;
+
+    if(!fp){
+        TRACE(ERROR,"Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    writer_file(&w, fp);
+    return print_doc(&w, json, indent);
+}
+
+/*
+* @brief Print json object to file descriptor
+* Output is formatted in a buffer and written with few writev calls, long strings
+* and keys are written from the document without copying them to the buffer.
+* @param json Json object
+* @param fd File descriptor for output
+* @param indent Indetation for pretty printing
+* @return Number of bytes printed
+*/
+int json_printfd(struct json *json, int fd, unsigned int indent)
+{
+    struct writer w;
+
+    if(fd < 0){
+        TRACE(ERROR,"Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    writer_fdv(&w, fd);
+    return print_doc(&w, json, indent);
 }
 
 /*
@@ -1187,11 +2814,16 @@ int json_print(struct json *json, unsigned int indent)
 */
 int json_printf(struct json *json, char *fname, unsigned int indent)
 {
-    FILE *fp = fopen(fname, "w");
+    int fd = -1;
     int len = 0;
-    if(fp){
-        len = print(stdout, json, indent, 0);
-        fclose(fp);
+
+    if(!fname){
+        TRACE(ERROR,"Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    if((fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) >= 0){
+        len = json_printfd(json, fd, indent);
+        close(fd);
     } else {
         TRACE(ERROR,"Failed to open file : %s", fname);
         len = JsonErr(JSON_ERR_SYS);
@@ -1202,30 +2834,52 @@ int json_printf(struct json *json, char *fname, unsigned int indent)
 
 /*
 * @brief Print json object to a buffer
+* Output is null terminated, it fails if it does not fit with its null character.
+* With NULL buffer and zero size nothing is printed and length of output is returned,
+* same as json_serialized_size.
 * @param json Json object
 * @param buffer Buffer where json needs to be printed
 * @param size Size of buffer
 * @param indent Indetation for pretty printing
-* @return Number of bytes printed
+* @return Number of bytes printed, JSON_ERR_OVERFLOW if buffer is too small
 */
 int json_prints(struct json *json, char *buffer, unsigned int size, unsigned int indent)
 {
+    struct writer w;
     int len = 0;
-    FILE *fp = fmemopen((void*)buffer, size,  "w");
-    if(fp){
-        len = print(stdout, json, indent, 0);
-        buffer[len] = 0;
-        fclose(fp);
-    } else {
-        TRACE(ERROR,"Failed to initialized buffer as file");
-        len = JsonErr(JSON_ERR_SYS);
+
+    if(!buffer && !size)
+        return json_serialized_size(json, indent);
+    if(!buffer || !size){
+        TRACE(ERROR,"Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
     }
-   return len;
+    writer_mem(&w, buffer, size);
+    len = print_doc(&w, json, indent);
+    buffer[w.used] = 0;
+    return len;
 }
 
+/*
+* @brief Get exact length of json printed with given indentation
+* Document is printed to a writer which only counts bytes, nothing is allocated.
+* @param json Json object
+* @param indent Indetation for pretty printing
+* @return Number of bytes without null character, JSON_ERR value for failure
+*/
+int json_serialized_size(struct json *json, unsigned int indent)
+{
+    struct writer w;
+
+    writer_count(&w);
+    return print_doc(&w, json, indent);
+}
 
 /*
 * @brief Convert json to string representation (Dynamically generated buffer)
+* Buffer grows while printing and is shrunk to its length at the end. Computing the
+* length first with json_serialized_size takes a second formatting pass, which costs
+* more than growing the buffer.
 * @param json Json object
 * @param len Pointer to length where length of string will be saved
 * @param indent Indetation for pretty printing
@@ -1233,28 +2887,315 @@ int json_prints(struct json *json, char *buffer, unsigned int size, unsigned int
 */
 char* json_str(struct json *json, int *len, unsigned int indent)
 {
-    char **buf_ptr;
-    char *buffer;
-    size_t *size_ptr = NULL;
-    int print_length = 0;
-    FILE *fp = fdmemopen(&buf_ptr, &size_ptr);
-    if(fp){
-         print_length = print(stdout, json, indent, 0);
-         buffer = *buf_ptr;
-         fclose(fp);
-         if(len)
-            *len = print_length;
-         if(print_length > 0)
-            buffer[print_length] = 0;
-
-         return buffer;
-    } else {
-        TRACE(ERROR,"Failed to initialize buffer as file");
-        if(len)
-            *len = JsonErr(JSON_ERR_SYS);
+    struct writer w;
+    int ret = 0;
+
+    if((ret = writer_alloc(&w, 1024)) >= 0)
+        ret = print_doc(&w, json, indent);
+    if(len)
+        *len = ret;
+    if(ret < 0){
+        writer_free(&w);
+        return NULL;
+    }
+    return writer_take(&w);
+}
+
+/*
+* @brief Create streaming writer, document is written a value at a time without building it
+* With NULL buffer and zero size output goes to a growing buffer, taken with json_writer_str.
+* Else output is null terminated in caller's buffer, json_writer_end fails with
+* JSON_ERR_OVERFLOW if it does not fit.
+* @param buffer Buffer for output, NULL for growing buffer
+* @param size Size of buffer
+* @param indent Indetation for pretty printing, with enum json_print_flags
+* @return Streaming writer, released with json_writer_del
+*/
+struct json_writer* json_writer_new(char *buffer, size_t size, unsigned int indent)
+{
+    struct json_writer *jw = NULL;
+
+    if(!buffer != !size){
+        TRACE(ERROR, "Invalid arguments");
+        return NULL;
+    }
+    if(!(jw = malloc(sizeof(struct json_writer)))){
+        TRACE(ERROR, "Failed to allocate writer");
+        return NULL;
+    }
+    if(buffer){
+        writer_mem(&jw->w, buffer, size);
+    } else if(writer_alloc(&jw->w, 1024) < 0){
+        free(jw);
+        return NULL;
+    }
+    writer_init(jw, indent);
+    return jw;
+}
+
+/*
+* @brief Create streaming writer to file descriptor, output is buffered until json_writer_end
+* Strings are copied, they need not stay valid after the call which writes them.
+* @param fd File descriptor for output
+* @param indent Indetation for pretty printing, with enum json_print_flags
+* @return Streaming writer, released with json_writer_del
+*/
+struct json_writer* json_writer_fd(int fd, unsigned int indent)
+{
+    struct json_writer *jw = NULL;
+
+    if(fd < 0){
+        TRACE(ERROR, "Invalid arguments");
+        return NULL;
+    }
+    if(!(jw = malloc(sizeof(struct json_writer)))){
+        TRACE(ERROR, "Failed to allocate writer");
+        return NULL;
+    }
+    writer_fd(&jw->w, fd);
+    writer_init(jw, indent);
+    return jw;
+}
+
+/*
+* @brief Create streaming writer to stream, output is buffered until json_writer_end
+* @param fp Stream for output
+* @param indent Indetation for pretty printing, with enum json_print_flags
+* @return Streaming writer, released with json_writer_del
+*/
+struct json_writer* json_writer_fp(FILE *fp, unsigned int indent)
+{
+    struct json_writer *jw = NULL;
+
+    if(!fp){
+        TRACE(ERROR, "Invalid arguments");
+        return NULL;
+    }
+    if(!(jw = malloc(sizeof(struct json_writer)))){
+        TRACE(ERROR, "Failed to allocate writer");
+        return NULL;
+    }
+    writer_file(&jw->w, fp);
+    writer_init(jw, indent);
+    return jw;
+}
+
+/*
+* @brief Start an object
+* @param jw Streaming writer
+* @return JSON_ERR value
+*/
+int json_write_start_object(struct json_writer *jw)
+{
+    return writer_open(jw, JSON_TYPE_DICT, '{');
+}
+
+/*
+* @brief End innermost object
+* @param jw Streaming writer
+* @return JSON_ERR value
+*/
+int json_write_end_object(struct json_writer *jw)
+{
+    return writer_close(jw, JSON_TYPE_DICT, '}');
+}
+
+/*
+* @brief Start a list
+* @param jw Streaming writer
+* @return JSON_ERR value
+*/
+int json_write_start_list(struct json_writer *jw)
+{
+    return writer_open(jw, JSON_TYPE_LIST, '[');
+}
+
+/*
+* @brief End innermost list
+* @param jw Streaming writer
+* @return JSON_ERR value
+*/
+int json_write_end_list(struct json_writer *jw)
+{
+    return writer_close(jw, JSON_TYPE_LIST, ']');
+}
+
+/*
+* @brief Write key of next member of object, it is escaped as needed
+* @param jw Streaming writer
+* @param key Key, not null terminated
+* @param len Length of key
+* @return JSON_ERR value
+*/
+int json_write_key(struct json_writer *jw, const char *key, size_t len)
+{
+    struct writer_level *top = jw->depth ? &jw->stack[jw->depth - 1] : NULL;
+
+    if(jw->status < 0)
+        return jw->status;
+    if(!top || (top->type != JSON_TYPE_DICT) || jw->key || (!key && len)){
+        TRACE(ERROR, "Key outside of object or without value");
+        return (jw->status = JsonErr(JSON_ERR_ARGS));
+    }
+    if(top->count)
+        writer_char(&jw->w, ',');
+    top->count = 1;
+    jw->key = true;
+    print_indent(&jw->w, jw->indent, top->depth + 1);
+    print_str(&jw->w, key, len);
+    writer_char(&jw->w, ':');
+    return jw->w.err;
+}
+
+/*
+* @brief Write string value, it is escaped as needed
+* @param jw Streaming writer
+* @param str String, not null terminated
+* @param len Length of string
+* @return JSON_ERR value
+*/
+int json_write_str(struct json_writer *jw, const char *str, size_t len)
+{
+    int ret;
+
+    if(!str && len){
+        TRACE(ERROR, "Invalid arguments");
+        return (jw->status = JsonErr(JSON_ERR_ARGS));
+    }
+    if((ret = writer_value(jw, false)) < 0)
+        return ret;
+    print_str(&jw->w, str, len);
+    return jw->w.err;
+}
+
+/*
+* @brief Write signed integer value
+* @param jw Streaming writer
+* @param val Value
+* @return JSON_ERR value
+*/
+int json_write_int(struct json_writer *jw, long val)
+{
+    struct json json = {.type = JSON_TYPE_INT, .long_number = val};
+
+    return writer_number(jw, &json);
+}
+
+/*
+* @brief Write unsigned integer value
+* @param jw Streaming writer
+* @param val Value
+* @return JSON_ERR value
+*/
+int json_write_uint(struct json_writer *jw, unsigned long val)
+{
+    struct json json = {.type = JSON_TYPE_UINT, .long_number = (long)val};
+
+    return writer_number(jw, &json);
+}
+
+/*
+* @brief Write double value, with fewest digits which parse back to it
+* @param jw Streaming writer
+* @param val Value
+* @return JSON_ERR value
+*/
+int json_write_double(struct json_writer *jw, double val)
+{
+    struct json json = {.type = JSON_TYPE_DOUBLE, .double_number = val};
+
+    return writer_number(jw, &json);
+}
+
+/*
+* @brief Write boolean value
+* @param jw Streaming writer
+* @param val Value, true if not zero
+* @return JSON_ERR value
+*/
+int json_write_bool(struct json_writer *jw, int val)
+{
+    int ret;
+
+    if((ret = writer_value(jw, false)) < 0)
+        return ret;
+    if(val)
+        writer_write(&jw->w, "true", 4);
+    else
+        writer_write(&jw->w, "false", 5);
+    return jw->w.err;
+}
+
+/*
+* @brief Write null value
+* @param jw Streaming writer
+* @return JSON_ERR value
+*/
+int json_write_null(struct json_writer *jw)
+{
+    int ret;
+
+    if((ret = writer_value(jw, false)) < 0)
+        return ret;
+    writer_write(&jw->w, "null", 4);
+    return jw->w.err;
+}
+
+/*
+* @brief End document and flush output, buffer of caller is null terminated
+* @param jw Streaming writer
+* @return Number of bytes written, JSON_ERR value for failure or incomplete document
+*/
+int json_writer_end(struct json_writer *jw)
+{
+    int ret;
+
+    if(!jw){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    if(jw->status < 0)
+        return jw->status;
+    if(!jw->done){
+        TRACE(ERROR, "Document is not complete");
+        return (jw->status = JsonErr(JSON_ERR_ARGS));
+    }
+    ret = print_end(&jw->w);
+    if((jw->w.sink == WRITER_MEM) || (jw->w.sink == WRITER_ALLOC))
+        jw->w.buffer[jw->w.used] = 0;
+    return ret;
+}
+
+/*
+* @brief End document and take its string from writer with growing buffer
+* @param jw Streaming writer created with NULL buffer
+* @param len Pointer to length where length of string or JSON_ERR value will be saved
+* @return String, caller frees it, NULL for failure
+*/
+char* json_writer_str(struct json_writer *jw, int *len)
+{
+    int ret;
+
+    if(((ret = json_writer_end(jw)) >= 0) && (jw->w.sink != WRITER_ALLOC)){
+        TRACE(ERROR, "Writer does not have growing buffer");
+        ret = JsonErr(JSON_ERR_ARGS);
     }
-   return NULL;
+    if(len)
+        *len = ret;
+    return (ret < 0) ? NULL : writer_take(&jw->w);
+}
 
+/*
+* @brief Delete streaming writer, with its buffer if it was not taken
+* Output which was not flushed with json_writer_end is dropped.
+* @param jw Streaming writer
+*/
+void json_writer_del(struct json_writer *jw)
+{
+    if(jw){
+        writer_free(&jw->w);
+        free(jw);
+    }
 }
 
 int set_dict(struct dict *dict, int type, char *key, void* val)
@@ -1262,12 +3203,13 @@ int set_dict(struct dict *dict, int type, char *key, void* val)
     int err = 0;
     struct json *orig = NULL;
     struct json *json = NULL;
+    struct arena *arena = dict_arena(dict);
     if(dict && key){
         if(!val){
             /* Remove from dict*/
             dict_set(dict, key, NULL);
-        } else if((val = clone_obj(type, val, &err))){
-            if((json = json_new())){
+        } else if((val = clone_obj(arena, type, val, &err))){
+            if((json = json_alloc(arena))){
                 init_val(json, type, val);
                 /* Check if there is original value and its a list*/
                 if((orig = dict_get(dict, key)) && (orig->type == JSON_TYPE_LIST)){
@@ -1293,7 +3235,7 @@ int set_dict(struct dict *dict, int type, char *key, void* val)
                 TRACE(ERROR,"Failed to allocate Json object");
                 err = JsonErr(JSON_ERR_NO_MEM);
                 /* Free the duplicate value */
-                free_obj(type, val);
+                free_obj(arena, type, val);
             }
         } else {
             TRACE(ERROR,"Failed to duplicate value");
@@ -1310,14 +3252,14 @@ int set_list(struct list *list, int type, void* val)
 {
     int err = 0;
     struct json* json = NULL;
+    struct arena *arena = list_arena(list);
     if(list && val){
-        if((val = clone_obj(type, val, &err))){
-            if((json = json_new())){
+        if((val = clone_obj(arena, type, val, &err))){
+            if((json = json_alloc(arena))){
                 init_val(json, type, val);
                 if((list_add(list, json)) < 0){
                     TRACE(ERROR,"Failed to add in list");
                     err = JsonErr(JSON_ERR_NO_MEM);
-                    list_del(list);
                     json_del(json);
                 } else {
                     /* We have changed the current Json object to its List version*/ 
@@ -1327,7 +3269,7 @@ int set_list(struct list *list, int type, void* val)
                 TRACE(ERROR,"Failed to allocate Json object");
                 err = JsonErr(JSON_ERR_NO_MEM);
                 /* Free the duplicate value */
-                free_obj(type, val);
+                free_obj(arena, type, val);
             }
         } else {
             TRACE(ERROR,"Failed to duplicate value");
@@ -1357,6 +3299,7 @@ int json_set(struct json *json, int type, char *key, void *val)
     int err = JSON_ERR_ARGS;
     struct dict* dict = NULL;
     struct list* list = NULL;
+    struct arena *arena = NULL;
 
     if(json){
        switch(json->type){
@@ -1370,9 +3313,17 @@ int json_set(struct json *json, int type, char *key, void *val)
                 err = json_set(json->json, type, key, val);
             break;
             case JSON_TYPE_NULL:
+                if(json->flags & JSON_FLAG_DOC){
+                    arena = ((struct json_doc*)json)->arena;
+                } else if(json->flags & JSON_FLAG_ARENA){
+                    /* Value does not know its arena, only document root does */
+                    TRACE(ERROR, "Can not change type of value in document");
+                    err = JsonErr(JSON_ERR_ARGS);
+                    break;
+                }
                 if(val){
                     if(key){
-                        if((dict = dict_new((dict_free_t)json_del, (dict_cmp_t)json_cmp, (dict_print_t)print_dict_cb))){
+                        if((dict = new_dict(arena))){
                             err = set_dict(dict, type, key, val);
                             if(JsonIsError(err)){
                                 dict_del(dict);
@@ -1384,7 +3335,7 @@ int json_set(struct json *json, int type, char *key, void *val)
                             err = JsonErr(JSON_ERR_NO_MEM);
                         }
                     } else {
-                        if((list = list_new((list_free_t)json_del, (list_cmp_t)json_cmp, (list_print_t)print_list_cb))){
+                        if((list = new_list(arena))){
                             err = set_list(list, type, val);
                             if(JsonIsError(err)){
                                 list_del(list);
@@ -1418,14 +3369,7 @@ int json_set(struct json *json, int type, char *key, void *val)
 */
 struct json* json_new(void)
 {
-    struct json  *json = NULL;
-    if((json = malloc(sizeof(struct json)))){
-        json->data = NULL;
-        json->type = JSON_TYPE_NULL;
-    } else {
-        TRACE(ERROR, "Failed to allocate value");
-    }
-    return json;
+    return json_alloc(NULL);
 }
 
 /*
@@ -1435,9 +3379,16 @@ struct json* json_new(void)
 void json_del(struct json* json)
 {
     if(json){
-        /* Free Value based on the its type*/
-        free_obj(json->type, json->data);
-        free(json);
+        if(json->flags & JSON_FLAG_DOC){
+            /* Document root, release whole arena at once */
+            arena_del(((struct json_doc*)json)->arena);
+        } else if(!(json->flags & JSON_FLAG_ARENA)){
+            /* Free Value based on the its type, referenced string belongs to input buffer */
+            if(!(json->flags & JSON_FLAG_REF))
+                free_obj(NULL, json->type, json->data);
+            free(json);
+        }
+        /* Values owned by document are released with document */
     } else {
         TRACE(ERROR, "Invalid arguments");
     }
@@ -1513,7 +3464,7 @@ size_t json_size(struct json* json)
                 size = dict_size(json->dict);
             break;
             case JSON_TYPE_STR:
-                size = strlen(json->str) + 1;
+                size = json->len + 1;
             break;
             case JSON_TYPE_LIST:
                 size = list_size(json->list);
@@ -1576,7 +3527,7 @@ int json_val(struct json* json, void* buffer, size_t size)
 struct json* json_clone(struct json* json, int *err)
 {
     if(json && err){
-        json = clone(json, err);
+        json = clone(NULL, json, err);
     } else {
         TRACE(ERROR, "Null object");
         if(err)
@@ -1596,11 +3547,13 @@ char* json_sterror(int err)
     static char* _err_table[] ={
         [JSON_ERR_SUCCESS]      = "Success", 
         [JSON_ERR_NO_MEM]       = "Not enough memory",
+        [JSON_ERR_KEY_REPEAT]   = "Duplicate key",
         [JSON_ERR_KEY_NOT_FOUND]= "Key not found",
         [JSON_ERR_ARGS]         = "Invalid arguments",
         [JSON_ERR_PARSE]        = "Parsing ERROR",
         [JSON_ERR_OVERFLOW]     = "Integer Overflow detected",
         [JSON_ERR_SYS]          = "System ERROR",
+        [JSON_ERR_DEPTH]        = "Nesting too deep",
         [JSON_ERR_LAST]         = "Invalid ERROR",
     };
 
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "utils.h"
+#include "fsutils.h"
+#include "pool.h"
+
+#define MODULE "Lines"
+#include "trace.h"
+
+#define JsonErr(x)          (-(JSON_ERR_BEGIN + (x)))
+#define LINES_BATCH         (256 * 1024)    /* Bytes of records taken by a worker at once */
+
+/* Records parsed from one batch, in order */
+struct lines_out
+{
+    struct json **json;
+    size_t count;
+    size_t size;
+};
+
+/* Work shared by workers */
+struct lines
+{
+    const char *start;          /* Buffer */
+    const char *end;
+    const struct json_opts *opts;
+    size_t batches;             /* Number of batches */
+    json_line_cb cb;            /* Callback for each record, or NULL to collect them */
+    void *ctx;
+    struct lines_out *out;      /* Records of each batch when collecting */
+};
+
+/*
+* @brief Add record to records of batch
+* @param out records of batch
+* @param json record
+* @return JSON_ERR value
+*/
+static int lines_add(struct lines_out *out, struct json *json)
+{
+    struct json **temp = NULL;
+
+    if(out->count == out->size){
+        if(!(temp = realloc(out->json, (out->size * 2 + 16) * sizeof(struct json*)))){
+            TRACE(ERROR, "Failed to allocate records");
+            return JsonErr(JSON_ERR_NO_MEM);
+        }
+        out->json = temp;
+        out->size = out->size * 2 + 16;
+    }
+    out->json[out->count++] = json;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Parse records of a batch, job of worker pool
+* Batch owns records which start inside it, last one may run past its end.
+* Record starts at beginning of buffer or after a newline.
+* @param arg shared work
+* @param batch batch number
+* @return JSON_ERR value
+*/
+static int lines_batch(void *arg, size_t batch)
+{
+    struct lines *l = arg;
+    const char *start = l->start + batch * LINES_BATCH;
+    const char *stop = ((size_t)(l->end - start) > LINES_BATCH) ? start + LINES_BATCH : l->end;
+    const char *line = NULL;
+    struct json *json = NULL;
+    int status = JsonErr(JSON_ERR_SUCCESS);
+    int err;
+
+    if(batch && !(start = memchr(start - 1, '\n', l->end - start + 1)))
+        return status;
+    for(start += (batch != 0); start < stop; start = line + 1){
+        /* glibc memchr scans with vector instructions */
+        if(!(line = memchr(start, '\n', l->end - start)))
+            line = l->end;
+        /* Blank lines are skipped */
+        if(trim(start, line) >= line)
+            continue;
+        err = JsonErr(JSON_ERR_SUCCESS);
+        json = json_loads_const(start, line, l->opts, &err);
+        if(l->cb){
+            if((status = l->cb(l->ctx, start - l->start, json, json ? JsonErr(JSON_ERR_SUCCESS) : err)) < 0)
+                return status;
+        } else if(!json){
+            TRACE(ERROR, "Failed to parse record at %zu", (size_t)(start - l->start));
+            return err;
+        } else if((status = lines_add(&l->out[batch], json)) < 0){
+            json_del(json);
+            return status;
+        }
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Parse all batches on worker pool
+* @param l shared work
+* @param threads number of threads, 0 for number of cpus
+* @return JSON_ERR value
+*/
+static int lines_run(struct lines *l, unsigned int threads)
+{
+    l->batches = (l->end - l->start + LINES_BATCH - 1) / LINES_BATCH;
+    return pool_run(threads, l->batches, lines_batch, l);
+}
+
+/*
+* @brief Parse JSON Lines buffer in parallel and report each record to callback
+* Records are separated by newlines, blank lines are skipped. Buffer is split in batches
+* at record boundaries and parsed by a pool of threads, input is never written.
+* Callback is called from worker threads, concurrently and not in input order,
+* it owns the record and releases it with json_del.
+* Record which fails to parse is reported with NULL json and its error.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options for each record, NULL for defaults, JSON_OPT_INSITU is ignored
+* @param threads Number of threads, 0 for number of cpus
+* @param cb Callback for each record, returns negative JSON_ERR value to stop parsing
+* @param ctx Context passed to callback
+* @return JSON_ERR value, or error returned by callback
+*/
+int json_lines(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, json_line_cb cb, void *ctx)
+{
+    struct lines l;
+
+    if(!start || !end || (start > end) || !cb){
+        TRACE(ERROR, "Invalid arguments");
+        return JsonErr(JSON_ERR_ARGS);
+    }
+    memset(&l, 0, sizeof(l));
+    l.start = start;
+    l.end = end;
+    l.opts = opts;
+    l.cb = cb;
+    l.ctx = ctx;
+    return lines_run(&l, threads);
+}
+
+/*
+* @brief Parse JSON Lines buffer in parallel, records are returned in input order
+* Whole buffer fails if any record fails, blank lines are skipped.
+* @param start Pointer to start of buffer
+* @param end Pointer to end of buffer
+* @param opts Parser options for each record, NULL for defaults, JSON_OPT_INSITU is ignored
+* @param threads Number of threads, 0 for number of cpus
+* @param count Placeholder for number of records
+* @param err Pointer for error status
+* @return Records, released with json_lines_del, NULL for failure
+*/
+struct json** json_loads_lines(const char *start, const char *end, const struct json_opts *opts, unsigned int threads, size_t *count, int *err)
+{
+    struct json **json = NULL;
+    struct lines l;
+    size_t total = 0, i;
+    int status;
+
+    if(!start || !end || (start > end) || !count){
+        TRACE(ERROR, "Invalid arguments");
+        if(err)
+            *err = JsonErr(JSON_ERR_ARGS);
+        return NULL;
+    }
+    memset(&l, 0, sizeof(l));
+    l.start = start;
+    l.end = end;
+    l.opts = opts;
+    if(!(l.out = calloc((end - start) / LINES_BATCH + 1, sizeof(struct lines_out)))){
+        TRACE(ERROR, "Failed to allocate batches");
+        if(err)
+            *err = JsonErr(JSON_ERR_NO_MEM);
+        return NULL;
+    }
+    status = lines_run(&l, threads);
+
+    /* Batches are joined in order */
+    for(i = 0; i < l.batches; i++)
+        total += l.out[i].count;
+    if((status >= 0) && !(json = malloc((total + 1) * sizeof(struct json*)))){
+        TRACE(ERROR, "Failed to allocate records");
+        status = JsonErr(JSON_ERR_NO_MEM);
+    }
+    for(total = 0, i = 0; i < l.batches; i++){
+        if(!json){
+            json_lines_del(l.out[i].json, l.out[i].count);
+            continue;
+        } else if(l.out[i].count){
+            memcpy(json + total, l.out[i].json, l.out[i].count * sizeof(struct json*));
+            total += l.out[i].count;
+        }
+        free(l.out[i].json);
+    }
+    free(l.out);
+    *count = json ? total : 0;
+    if(err)
+        *err = status;
+    return json;
+}
+
+/*
+* @brief Load JSON Lines file in parallel, records are returned in input order
+* File is mapped read only, or read if it is a pipe.
+* @param fname filename
+* @param opts Parser options for each record, NULL for defaults
+* @param threads Number of threads, 0 for number of cpus
+* @param count Placeholder for number of records
+* @param err Pointer for error status
+* @return Records, released with json_lines_del, NULL for failure
+*/
+struct json** json_load_lines(char *fname, const struct json_opts *opts, unsigned int threads, size_t *count, int *err)
+{
+    struct json **json = NULL;
+    size_t len = 0;
+    bool mapped = false;
+    char *buffer = NULL;
+
+    if(!fname || !count){
+        TRACE(ERROR, "Invalid args");
+        if(err)
+            *err = JsonErr(JSON_ERR_ARGS);
+        return NULL;
+    }
+    if(!(buffer = mapall(fname, &len, &mapped))){
+        TRACE(ERROR, "Failed to read file : %s", fname);
+        if(err)
+            *err = JsonErr(JSON_ERR_SYS);
+        return NULL;
+    }
+    json = json_loads_lines(buffer, buffer + len, opts, threads, count, err);
+    unmapall(buffer, len, mapped);
+    return json;
+}
+
+/*
+* @brief Release records returned by json_loads_lines
+* @param json Records
+* @param count Number of records
+*/
+void json_lines_del(struct json **json, size_t count)
+{
+    size_t i;
+
+    if(json){
+        for(i = 0; i < count; i++)
+            json_del(json[i]);
+        free(json);
+    }
+}
@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "list.h"
 #include "iter.h"
+#include "arena.h"
 
 #define MODULE "List"
 #include "trace.h"
 
+/* Initial capacity of list */
+#define LIST_SIZE_MIN   4
+
 enum list_flags
 {
     LIST_SORTED = 0x01,
@@ -22,25 +27,16 @@ enum list_flags
 #define ListReSetFlag(x,y)      ReSetFlag((x)->flags,y)
 #define ListIsFlagSet(x,y)      IsFlagSet((x)->flags,y)
 #define ListIsFlagReSet(x,y)    IsFlagReSet((x)->flags,y)
-#define NodeSetFlag(x,y)        SetFlag((x)->flags,y)
-#define NodeReSetFlag(x,y)      ReSetFlag((x)->flags,y)
-#define NodeIsFlagSet(x,y)      IsFlagSet((x)->flags,y)
-#define NodeIsFlagReSet(x,y)    IsFlagReSet((x)->flags,y)
 
 #define ListSetSorted(x)        ListSetFlag(x, LIST_SORTED)
 #define ListSetUnSorted(x)      ListReSetFlag(x, LIST_SORTED)
 #define ListIsSorted(x)         ListIsFlagSet(x,LIST_SORTED)
 #define ListIsUnSorted(x)       ListIsFlagReSet(x,LIST_SORTED)
 
-
-struct node
-{
-    const void* data;
-    unsigned int flags;
-    struct list* list;
-    struct node* next;
-    struct node* prev;
-};
+/*
+* List items are stored in a contiguous array, in order
+* Sorted order is defined by cmp, item y is placed before x when cmp(x, y) < 0
+*/
 struct list
 {
     unsigned int flags;
@@ -48,138 +44,176 @@ struct list
     list_cmp_t cmp;
     list_print_t print;
     unsigned int count;
-    struct node* start;
-    struct node* end;
+    unsigned int size;
+    const void** data;
+    struct arena *arena;    /* Allocator, NULL for heap */
 };
 
-static struct node* node_new(struct list* list, const void *data);
-static void node_add(struct list* list, struct node* node);
-static void node_add_sorted(struct list* list, struct node* node);
-static struct node* node_index(const struct node* node, unsigned int index);
-static struct node* node_find(const struct node* node, const void* data, list_cmp_t cmp, int *index);
+static int list_grow(struct list* list, unsigned int size);
+static unsigned int sorted_index(const struct list* list, const void* data);
+static void merge_sort(const void** data, const void** temp, unsigned int count, list_cmp_t cmp);
 static void* list_iter_next(const void* data, void* current);
 static void* list_iter_get(const void* data, void* current);
 static int list_iter_size(const void* data);
 
-static struct node* node_new(struct list* list, const void *data)
+/*
+* @brief Make sure list can hold at least size items
+* @param list list
+* @param size number of items
+* @return 0 on success
+*/
+static int list_grow(struct list* list, unsigned int size)
 {
-     struct node* node = NULL;
-     if((node = malloc(sizeof(struct node)))){
-         node->data = data;
-         node->prev = node->next = NULL;
-         node->flags = 0;
-         node->list = list;
-     } else {
-         TRACE(ERROR, "Failed to allocate memory");
-     }
-
-     return node;
+    const void** data = NULL;
+    unsigned int n = list->size ? list->size : LIST_SIZE_MIN;
+    if(size <= list->size)
+        return 0;
+    /* Grow geometrically, so that appending is amortized O(1) */
+    for(; n < size; n *= 2);
+    if(!(data = arena_realloc(list->arena, list->data, list->size * sizeof(*data), n * sizeof(*data)))){
+        TRACE(ERROR, "Failed to allocate memory");
+        return -1;
+    }
+    list->data = data;
+    list->size = n;
+    return 0;
 }
 
-static void node_add(struct list* list, struct node* node)
+/*
+* @brief Find insertion position in sorted list, after all equal items
+* @param list sorted list
+* @param data item to be inserted
+* @return index for insertion
+*/
+static unsigned int sorted_index(const struct list* list, const void* data)
 {
-    if(list && node){
-        node->prev = list->end;
-        if(list->end){
-            list->end->next = node;
+    unsigned int low = 0, high = list->count, mid;
+    while(low < high){
+        mid = low + (high - low) / 2;
+        if((list->cmp(list->data[mid], data)) < 0){
+            high = mid;
         } else {
-            list->start = node;
+            low = mid + 1;
         }
-        list->end = node;
-        list->count++;
-    } else {
-        TRACE(ERROR,"Invalid arguments");
     }
+    return low;
 }
 
-static void node_add_sorted(struct list* list, struct node* node)
+/*
+* @brief Stable merge sort
+* @param data items
+* @param temp scratch space for count items
+* @param count number of items
+* @param cmp comparator
+*/
+static void merge_sort(const void** data, const void** temp, unsigned int count, list_cmp_t cmp)
 {
-    struct node* temp = NULL;
-    if(list && node ){
-        if(!list->cmp){
-            TRACE(WARN, "Operation not supported");
-            return;
-        }
-
-        for(temp = list->start; temp; temp = temp->next){
-            if((list->cmp(temp->data, node->data)) < 0){
-                break;
-            }
-        }
-
-        if(temp){
-            if(temp->prev){
-                temp->prev->next = node;
-            }
-            node->prev = temp->prev;
-            node->next = temp;
-            temp->prev = node;
-            if(temp == list->start){
-                list->start = node;
-            }
-
-        } else if(list->end){
-            list->end->next = node;
-            node->prev = list->end;
-            list->end = node;
+    unsigned int mid = count / 2;
+    unsigned int i = 0, j = mid, k = 0;
+    if(count < 2)
+        return;
+    merge_sort(data, temp, mid, cmp);
+    merge_sort(data + mid, temp, count - mid, cmp);
+    while((i < mid) && (j < count)){
+        /* Take right item only if it must be placed before left, keeps equal items in order */
+        if((cmp(data[i], data[j])) < 0){
+            temp[k++] = data[j++];
         } else {
-            list->start = list->end = node;
+            temp[k++] = data[i++];
         }
-        list->count++;
-    } else {
-        TRACE(ERROR,"Invalid arguments");
     }
+    while(i < mid){
+        temp[k++] = data[i++];
+    }
+    /* Rest of right half is already in place */
+    memcpy(data, temp, k * sizeof(*data));
 }
 
-static struct node* node_index(const struct node* node, unsigned int index)
-{
-    for(; node && index; node = node->next, index--);
-    return (struct node*)node;
-}
-
-static struct node* node_find(const struct node* node, const void* data, list_cmp_t cmp, int *index)
+struct list* list_new(list_free_t f, list_cmp_t cmp, list_print_t print)
 {
-    int i = 0;
-    if(!node || !cmp || !node->list)
-        return NULL;
-    
-    for(i = 0; node && index; node = node->next, i++){
-        if(cmp(node->data, data) == 0){
-            if(index)
-                *index = i;
-            break;
-        }
-     }
-     return (struct node*)node;
+    return list_new_arena(NULL, f, cmp, print);
 }
 
-struct list* list_new(list_free_t f, list_cmp_t cmp, list_print_t print)
+/*
+* @brief Create list which allocates all its memory from arena
+* @param arena arena, NULL for heap
+* @param f function to free items
+* @param cmp function to compare items
+* @param print function to print item
+* @return list
+*/
+struct list* list_new_arena(struct arena *arena, list_free_t f, list_cmp_t cmp, list_print_t print)
 {
     struct list* list = NULL;
-    if((list = malloc(sizeof(struct list)))){
-        list->start = list->end = NULL;
+    if((list = arena_alloc(arena, sizeof(struct list)))){
+        list->arena = arena;
+        list->data = NULL;
         list->count = 0;
+        list->size = 0;
         list->free = f;
         list->cmp = cmp;
         list->print = print;
         list->flags = 0;
         /* Empty List is sorted */
-        ListSetSorted(list); 
+        ListSetSorted(list);
     } else {
         TRACE(ERROR, "Failed to allocate memory");
     }
     return list;
 }
 
+/*
+* @brief Reserve space for items, hint to avoid reallocation while adding
+* @param list list
+* @param size total number of items expected
+* @return 0 on success
+*/
+int list_reserve(struct list* list, unsigned int size)
+{
+    int ret = -1;
+    if(list){
+        ret = list_grow(list, size);
+    } else {
+        TRACE(ERROR,"Invalid arguments");
+    }
+    return ret;
+}
+
 int list_add(struct list* list, const void* data)
 {
-    struct node* node = NULL;
     int count = -1;
     if(list){
-        if((node = node_new(list, data))){
+        if((list->count < list->size) || (list_grow(list, list->count + 1) == 0)){
             /* We are appending in the list with out checking content, hence it becomes unsorted*/
             ListSetUnSorted(list);
-            node_add(list, node);
+            list->data[list->count++] = data;
+            count = list->count;
+        }
+    } else {
+        TRACE(ERROR,"Invalid arguments");
+    }
+    return count;
+}
+
+/*
+* @brief Move all items of other list to end of list, in order
+* Other list is left empty, its items are not copied or freed
+* @param list list
+* @param other list to take items from
+* @return number of items in list, -1 on failure
+*/
+int list_append(struct list* list, struct list* other)
+{
+    int count = -1;
+    if(list && other && (list != other)){
+        if(!other->count || (list_grow(list, list->count + other->count) == 0)){
+            if(other->count){
+                ListSetUnSorted(list);
+                memcpy(list->data + list->count, other->data, other->count * sizeof(void*));
+            }
+            list->count += other->count;
+            other->count = 0;
+            ListSetSorted(other);
             count = list->count;
         }
     } else {
@@ -190,18 +224,22 @@ int list_add(struct list* list, const void* data)
 
 int list_add_sorted(struct list* list, const void* data)
 {
-    struct node* node = NULL;
+    unsigned int index;
     int count = -1;
     if(list){
-        if((node = node_new(list, data))){
+        if(!list->cmp){
+            TRACE(WARN, "Operation not supported");
+        } else if((list_grow(list, list->count + 1)) == 0){
             /* Sort List if not sorted */
             if(ListIsUnSorted(list)){
                 TRACE(INFO,"Sorting unsorted list");
                 list_sort(list);
             }
 
-            node_add_sorted(list, node);
-            count = list->count;
+            index = sorted_index(list, data);
+            memmove(&list->data[index + 1], &list->data[index], (list->count - index) * sizeof(*list->data));
+            list->data[index] = data;
+            count = ++list->count;
         } else {
             TRACE(ERROR, "Failed to allocate node");
         }
@@ -215,11 +253,8 @@ int list_add_sorted(struct list* list, const void* data)
 void* list_get(const struct list *list, unsigned int index)
 {
     void* data = NULL;
-    struct node* node = NULL;
     if(list && (list->count > index)){
-        if((node = node_index(list->start, index))){
-            data = (void*)node->data;
-        }
+        data = (void*)list->data[index];
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
@@ -229,20 +264,20 @@ void* list_get(const struct list *list, unsigned int index)
 
 int list_sort(struct list *list)
 {
-    struct node *temp = NULL;
-    struct node *node = NULL;
+    const void** temp = NULL;
     int count = -1;
     if(list){
-        if(ListIsUnSorted(list)){
-            node = list->start;
-            list->start = list->end = NULL;
-            list->count = 0;
+        if(ListIsSorted(list) || (list->count < 2)){
+            ListSetSorted(list);
+            count = list->count;
+        } else if(!list->cmp){
+            TRACE(WARN, "Operation not supported");
+        } else if(!(temp = malloc(list->count * sizeof(*temp)))){
+            TRACE(ERROR, "Failed to allocate memory");
+        } else {
+            merge_sort(list->data, temp, list->count, list->cmp);
+            free(temp);
             ListSetSorted(list);
-            for(; node; node = temp){
-                temp = node->next;
-                node->next = node->prev = NULL;
-                node_add_sorted(list, node);
-            }
             count = list->count;
         }
     } else {
@@ -253,22 +288,28 @@ int list_sort(struct list *list)
 
 int list_find(const struct list *list, const void* data)
 {
-    int index = -1;
+    unsigned int i;
     if(list){
-        node_find(list->start, data, list->cmp, &index);
+        if(list->cmp){
+            for(i = 0; i < list->count; i++){
+                if(list->cmp(list->data[i], data) == 0){
+                    return i;
+                }
+            }
+        }
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
-    return index;
+    return -1;
 }
 
 static void* list_iter_get(const void* data, void* current)
 {
     void* ret = NULL;
     const struct list* list = (const struct list*)data;
-    struct node* node = current;
-    if(list && node){
-        ret = (void*)node->data;
+    const void** item = current;
+    if(list && item){
+        ret = (void*)*item;
     } else {
         TRACE(ERROR, "Invalid argumets");
     }
@@ -278,14 +319,10 @@ static void* list_iter_get(const void* data, void* current)
 static void* list_iter_next(const void* data, void* current)
 {
     const struct list* list = (const struct list*)data;
-    struct node* node = current;
+    const void** item = current;
     if(list){
-        if(node){
-            node = node->next;
-        } else {
-            node = list->start;
-        }
-        return node;
+        item = item ? item + 1 : list->data;
+        return (item && (item < list->data + list->count)) ? (void*)item : NULL;
     } else {
         TRACE(ERROR, "Invalid argumets");
     }
@@ -313,17 +350,15 @@ struct iter* list_iter(struct list* list)
 
 void list_del(struct list* list)
 {
-    struct node *next = NULL;
-    struct node *node = NULL;
+    unsigned int i;
     if(list){
-        for(node = list->start; node; node = next){
-            next = node->next;
-            if(list->free){
-                list->free((void*)node->data);
+        if(list->free){
+            for(i = 0; i < list->count; i++){
+                list->free((void*)list->data[i]);
             }
-            free(node);
         }
-        free(list);
+        arena_free(list->arena, list->data);
+        arena_free(list->arena, list);
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
@@ -333,12 +368,11 @@ void list_del(struct list* list)
 
 int list_print(const struct list *list, const void *stream)
 {
-    int i;
+    unsigned int i;
     int ret = 0;
-    struct node* node = NULL;
     if(list && list->print){
-        for(node = list->start, i = 0; node; node = node->next, i++){
-            ret += list->print(stream, i, node->data);
+        for(i = 0; i < list->count; i++){
+            ret += list->print(stream, i, list->data[i]);
         }
     } else {
         TRACE(ERROR,"Invalid arguments");
@@ -351,37 +385,29 @@ int list_print(const struct list *list, const void *stream)
 int list_remove(struct list* list, unsigned int index)
 {
     int ret = -1;
-    struct node* node = NULL;
     if(list && (index < list->count)){
-        if((node = node_index(list->start, index))){
-            if(node->prev){
-                node->prev->next = node->next;
-            } else {
-                list->start = node->next;
-            }
-
-            if(node->next){
-                node->next->prev = node->prev;
-            } else {
-                list->end = node->prev;
-            }
-
-            if(list->free){
-                list->free((void*)node->data);
-            }
-            free(node);
-            if(list->count == 0){
-                TRACE(ERROR,"List count negative");
-            } else {
-                list->count--;
-            }
+        if(list->free){
+            list->free((void*)list->data[index]);
         }
+        list->count--;
+        memmove(&list->data[index], &list->data[index + 1], (list->count - index) * sizeof(*list->data));
+        ret = list->count;
     } else {
         TRACE(ERROR,"Invalid arguments");
     }
     return ret;
 }
 
+/*
+* @brief Get arena used by list
+* @param list list
+* @return arena or NULL for heap
+*/
+struct arena* list_arena(const struct list *list)
+{
+    return list ? list->arena : NULL;
+}
+
 int list_size(const struct list *list)
 {
     int len = -1;
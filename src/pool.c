@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+#include "scan.h"
+
+#define MODULE "Pool"
+#include "trace.h"
+
+/* Jobs shared by workers */
+struct pool
+{
+    size_t jobs;            /* Number of jobs */
+    size_t next;            /* Next job to take, atomic */
+    int status;             /* First error, atomic, workers stop once it is set */
+    pool_job_t job;
+    void *arg;
+};
+
+/*
+* @brief Worker, takes jobs till there are none left or one fails
+* @param arg pool
+* @return NULL
+*/
+static void* pool_worker(void *arg)
+{
+    struct pool *pool = arg;
+    size_t index;
+    int expected = 0;
+    int status;
+
+    while(!__atomic_load_n(&pool->status, __ATOMIC_RELAXED) &&
+          ((index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->jobs)){
+        if((status = pool->job(pool->arg, index)) < 0){
+            /* Keep first error */
+            __atomic_compare_exchange_n(&pool->status, &expected, status, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+* @brief Get number of threads pool would use
+* @param threads number of threads asked for, 0 for number of cpus
+* @return number of threads, at most POOL_THREADS_MAX
+*/
+unsigned int pool_threads(unsigned int threads)
+{
+    long cpus;
+
+    if(!threads)
+        threads = ((cpus = sysconf(_SC_NPROCESSORS_ONLN)) > 0) ? cpus : 1;
+    return (threads > POOL_THREADS_MAX) ? POOL_THREADS_MAX : threads;
+}
+
+/*
+* @brief Run jobs on a pool of threads, calling thread is one of the workers
+* Jobs are taken in order of their index, but run concurrently and finish in any order.
+* Jobs not yet started are skipped once a job fails.
+* @param threads number of threads, 0 for number of cpus
+* @param jobs number of jobs
+* @param job function run for each job
+* @param arg argument passed to job
+* @return 0 or error of first job which failed
+*/
+int pool_run(unsigned int threads, size_t jobs, pool_job_t job, void *arg)
+{
+    pthread_t tid[POOL_THREADS_MAX];
+    struct pool pool = {.jobs = jobs, .job = job, .arg = arg};
+    unsigned int started = 0, i;
+
+    threads = pool_threads(threads);
+    if(threads > jobs)
+        threads = jobs;
+
+    /* Scan kernels are selected before workers use them */
+    scan_level();
+    for(started = 0; (started + 1) < threads; started++){
+        if(pthread_create(&tid[started], NULL, pool_worker, &pool)){
+            TRACE(WARN, "Failed to start worker, continue with %u", started + 1);
+            break;
+        }
+    }
+    pool_worker(&pool);
+    for(i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+    return pool.status;
+}
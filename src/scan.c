@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "scan.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+#define MODULE "Scan"
+#include "trace.h"
+
+#define WS  SCAN_CLASS_WS
+#define ST  SCAN_CLASS_STR
+
+/*
+* Character class table, independent of locale
+* Whitespace is space, \t, \n, \v, \f, \r and null character
+* String scan stops at quote, backslash and control characters
+*/
+const unsigned char scan_class[256] = {
+    ['\0'] = WS|ST, [0x01] = ST, [0x02] = ST, [0x03] = ST,
+    [0x04] = ST, [0x05] = ST, [0x06] = ST, [0x07] = ST,
+    [0x08] = ST, ['\t'] = WS|ST, ['\n'] = WS|ST, ['\v'] = WS|ST,
+    ['\f'] = WS|ST, ['\r'] = WS|ST, [0x0E] = ST, [0x0F] = ST,
+    [0x10] = ST, [0x11] = ST, [0x12] = ST, [0x13] = ST,
+    [0x14] = ST, [0x15] = ST, [0x16] = ST, [0x17] = ST,
+    [0x18] = ST, [0x19] = ST, [0x1A] = ST, [0x1B] = ST,
+    [0x1C] = ST, [0x1D] = ST, [0x1E] = ST, [0x1F] = ST,
+    [' '] = WS, ['"'] = ST, ['\\'] = ST,
+};
+
+/* Kernels for selected level */
+struct scan_ops
+{
+    const char* (*ws)(const char *start, const char *end);
+    const char* (*str)(const char *start, const char *end);
+    const char* (*ascii)(const char *start, const char *end);
+    void (*block)(const char *start, size_t count, struct scan_block *masks);
+};
+
+static const char* scan_ws_init(const char *start, const char *end);
+static const char* scan_str_init(const char *start, const char *end);
+static const char* scan_ascii_init(const char *start, const char *end);
+static void scan_block_init(const char *start, size_t count, struct scan_block *masks);
+
+static const struct scan_ops scan_ops_level[] = {
+    [SCAN_SCALAR]   = {.ws = scan_ws_scalar, .str = scan_str_scalar, .ascii = scan_ascii_scalar, .block = scan_block_scalar},
+    [SCAN_SSE2]     = {.ws = scan_ws_sse2, .str = scan_str_sse2, .ascii = scan_ascii_sse2, .block = scan_block_sse2},
+    [SCAN_AVX2]     = {.ws = scan_ws_avx2, .str = scan_str_avx2, .ascii = scan_ascii_avx2, .block = scan_block_avx2},
+};
+
+/* Resolved on first use */
+static struct scan_ops scan_ops = {.ws = scan_ws_init, .str = scan_str_init, .ascii = scan_ascii_init, .block = scan_block_init};
+static int scan_ops_current = -1;
+
+/*
+* @brief Get best level supported by cpu
+* @return enum scan_level
+*/
+static int scan_cpu_level(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        return SCAN_AVX2;
+    if(__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+/*
+* @brief Get level of kernels in use
+* @return enum scan_level
+*/
+int scan_level(void)
+{
+    if(scan_ops_current < 0)
+        scan_set_level(SCAN_AVX2);
+    return scan_ops_current;
+}
+
+/*
+* @brief Select kernels, level is limited to what cpu supports
+* @param level enum scan_level
+* @return level selected
+*/
+int scan_set_level(int level)
+{
+    int max = scan_cpu_level();
+    if((level < SCAN_SCALAR) || (level > max))
+        level = max;
+    scan_ops = scan_ops_level[level];
+    scan_ops_current = level;
+    return level;
+}
+
+static const char* scan_ws_init(const char *start, const char *end)
+{
+    scan_level();
+    return scan_ops.ws(start, end);
+}
+
+static const char* scan_str_init(const char *start, const char *end)
+{
+    scan_level();
+    return scan_ops.str(start, end);
+}
+
+static const char* scan_ascii_init(const char *start, const char *end)
+{
+    scan_level();
+    return scan_ops.ascii(start, end);
+}
+
+static void scan_block_init(const char *start, size_t count, struct scan_block *masks)
+{
+    scan_level();
+    scan_ops.block(start, count, masks);
+}
+
+/*
+* @brief Skip whitespace
+* @param start start of buffer
+* @param end end of buffer
+* @return first non whitespace character or end
+*/
+const char* scan_ws(const char *start, const char *end)
+{
+    /* Most tokens are separated by at most one space, avoid vector setup for them */
+    if((start < end) && !scan_is_ws(*start))
+        return start;
+    return scan_ops.ws(start, end);
+}
+
+const char* scan_ws_scalar(const char *start, const char *end)
+{
+    for(; (start < end) && scan_is_ws(*start); start++);
+    return start;
+}
+
+/*
+* @brief Find next character inside string which needs attention
+* @param start start of buffer, inside string
+* @param end end of buffer
+* @return first quote, backslash or control character, or end
+*/
+const char* scan_str(const char *start, const char *end)
+{
+    return scan_ops.str(start, end);
+}
+
+const char* scan_str_scalar(const char *start, const char *end)
+{
+    for(; (start < end) && !scan_is_str(*start); start++);
+    return start;
+}
+
+/*
+* @brief Find next character which is not printed as is in ASCII output
+* @param start start of buffer, inside string
+* @param end end of buffer
+* @return first quote, backslash, control or non ASCII character, or end
+*/
+const char* scan_ascii(const char *start, const char *end)
+{
+    return scan_ops.ascii(start, end);
+}
+
+const char* scan_ascii_scalar(const char *start, const char *end)
+{
+    for(; (start < end) && !scan_is_str(*start) && !(*start & 0x80); start++);
+    return start;
+}
+
+/*
+* @brief Classify consecutive blocks of SCAN_BLOCK_SIZE bytes
+* @param start start of first block
+* @param count number of blocks
+* @param masks placeholder for masks of each block
+*/
+void scan_block(const char *start, size_t count, struct scan_block *masks)
+{
+    scan_ops.block(start, count, masks);
+}
+
+void scan_block_scalar(const char *start, size_t count, struct scan_block *masks)
+{
+    unsigned char ch;
+    uint64_t bit;
+    int i;
+
+    memset(masks, 0, count * sizeof(struct scan_block));
+    for(; count; count--, masks++, start += SCAN_BLOCK_SIZE){
+        for(i = 0; i < SCAN_BLOCK_SIZE; i++){
+            ch = start[i];
+            bit = 1ULL << i;
+            if(ch == '"')
+                masks->quote |= bit;
+            else if(ch == '\\')
+                masks->backslash |= bit;
+            else if((ch == '{') || (ch == '}') || (ch == '[') || (ch == ']') || (ch == ':') || (ch == ','))
+                masks->op |= bit;
+            if(scan_is_ws(ch))
+                masks->ws |= bit;
+            if(ch < 0x20)
+                masks->ctrl |= bit;
+        }
+    }
+}
+
+#ifdef SCAN_X86
+/*
+* Whitespace mask of 16 bytes
+* \t to \r are consecutive, they are matched with one unsigned range check
+*/
+static inline int ws_mask_sse2(__m128i data)
+{
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(data, _mm_setzero_si128()));
+    __m128i ctrl = _mm_sub_epi8(data, _mm_set1_epi8('\t'));
+    ws = _mm_or_si128(ws, _mm_cmpeq_epi8(_mm_min_epu8(ctrl, _mm_set1_epi8('\r' - '\t')), ctrl));
+    return _mm_movemask_epi8(ws);
+}
+
+const char* scan_ws_sse2(const char *start, const char *end)
+{
+    unsigned int mask;
+    for(; (end - start) >= 16; start += 16){
+        mask = ~ws_mask_sse2(_mm_loadu_si128((const __m128i*)start)) & 0xFFFF;
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    return scan_ws_scalar(start, end);
+}
+
+/* Quote, backslash and control character mask of 16 bytes */
+static inline int str_mask_sse2(__m128i data)
+{
+    __m128i mask = _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8('"')),
+                                _mm_cmpeq_epi8(data, _mm_set1_epi8('\\')));
+    mask = _mm_or_si128(mask, _mm_cmpeq_epi8(_mm_min_epu8(data, _mm_set1_epi8(0x1F)), data));
+    return _mm_movemask_epi8(mask);
+}
+
+const char* scan_str_sse2(const char *start, const char *end)
+{
+    unsigned int mask;
+    for(; (end - start) >= 16; start += 16){
+        mask = str_mask_sse2(_mm_loadu_si128((const __m128i*)start));
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    return scan_str_scalar(start, end);
+}
+
+/* Non ASCII bytes have their top bit set, which is what movemask takes */
+const char* scan_ascii_sse2(const char *start, const char *end)
+{
+    unsigned int mask;
+    __m128i data;
+
+    for(; (end - start) >= 16; start += 16){
+        data = _mm_loadu_si128((const __m128i*)start);
+        mask = str_mask_sse2(data) | _mm_movemask_epi8(data);
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    return scan_ascii_scalar(start, end);
+}
+
+/*
+* Structural characters of 16 bytes
+* [ and ] differ from { and } only in bit 0x20, so both pairs are matched with two compares
+*/
+static inline int op_mask_sse2(__m128i data)
+{
+    __m128i low = _mm_or_si128(data, _mm_set1_epi8(0x20));
+    __m128i op = _mm_or_si128(_mm_cmpeq_epi8(low, _mm_set1_epi8('{')), _mm_cmpeq_epi8(low, _mm_set1_epi8('}')));
+    op = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(data, _mm_set1_epi8(':')), _mm_cmpeq_epi8(data, _mm_set1_epi8(','))));
+    return _mm_movemask_epi8(op);
+}
+
+void scan_block_sse2(const char *start, size_t count, struct scan_block *masks)
+{
+    __m128i data;
+    int i;
+
+    memset(masks, 0, count * sizeof(struct scan_block));
+    for(; count; count--, masks++, start += SCAN_BLOCK_SIZE){
+        for(i = 0; i < SCAN_BLOCK_SIZE; i += 16){
+            data = _mm_loadu_si128((const __m128i*)(start + i));
+            masks->quote |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_set1_epi8('"'))) << i;
+            masks->backslash |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_set1_epi8('\\'))) << i;
+            masks->ws |= (uint64_t)ws_mask_sse2(data) << i;
+            masks->op |= (uint64_t)op_mask_sse2(data) << i;
+            masks->ctrl |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(data, _mm_set1_epi8(0x1F)), data)) << i;
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int ws_mask_avx2(__m256i data)
+{
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8(' ')),
+                                 _mm256_cmpeq_epi8(data, _mm256_setzero_si256()));
+    __m256i ctrl = _mm256_sub_epi8(data, _mm256_set1_epi8('\t'));
+    ws = _mm256_or_si256(ws, _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, _mm256_set1_epi8('\r' - '\t')), ctrl));
+    return (unsigned int)_mm256_movemask_epi8(ws);
+}
+
+__attribute__((target("avx2")))
+const char* scan_ws_avx2(const char *start, const char *end)
+{
+    unsigned int mask;
+    for(; (end - start) >= 32; start += 32){
+        mask = ~ws_mask_avx2(_mm256_loadu_si256((const __m256i*)start));
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    /* Upper halves are cleared before running SSE code, to avoid AVX to SSE transition stall */
+    _mm256_zeroupper();
+    return scan_ws_sse2(start, end);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int str_mask_avx2(__m256i data)
+{
+    __m256i mask = _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8('"')),
+                                   _mm256_cmpeq_epi8(data, _mm256_set1_epi8('\\')));
+    mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(_mm256_min_epu8(data, _mm256_set1_epi8(0x1F)), data));
+    return (unsigned int)_mm256_movemask_epi8(mask);
+}
+
+__attribute__((target("avx2")))
+const char* scan_str_avx2(const char *start, const char *end)
+{
+    unsigned int mask;
+    for(; (end - start) >= 32; start += 32){
+        mask = str_mask_avx2(_mm256_loadu_si256((const __m256i*)start));
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    /* Upper halves are cleared before running SSE code, to avoid AVX to SSE transition stall */
+    _mm256_zeroupper();
+    return scan_str_sse2(start, end);
+}
+
+__attribute__((target("avx2")))
+const char* scan_ascii_avx2(const char *start, const char *end)
+{
+    unsigned int mask;
+    __m256i data;
+
+    for(; (end - start) >= 32; start += 32){
+        data = _mm256_loadu_si256((const __m256i*)start);
+        mask = str_mask_avx2(data) | (unsigned int)_mm256_movemask_epi8(data);
+        if(mask)
+            return start + __builtin_ctz(mask);
+    }
+    /* Upper halves are cleared before running SSE code, to avoid AVX to SSE transition stall */
+    _mm256_zeroupper();
+    return scan_ascii_sse2(start, end);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int op_mask_avx2(__m256i data)
+{
+    __m256i low = _mm256_or_si256(data, _mm256_set1_epi8(0x20));
+    __m256i op = _mm256_or_si256(_mm256_cmpeq_epi8(low, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(low, _mm256_set1_epi8('}')));
+    op = _mm256_or_si256(op, _mm256_or_si256(_mm256_cmpeq_epi8(data, _mm256_set1_epi8(':')),
+                                             _mm256_cmpeq_epi8(data, _mm256_set1_epi8(','))));
+    return (unsigned int)_mm256_movemask_epi8(op);
+}
+
+/* Combine masks of two halves of block */
+#define MASK64(lo, hi)      ((uint64_t)(lo) | ((uint64_t)(hi) << 32))
+
+__attribute__((target("avx2")))
+void scan_block_avx2(const char *start, size_t count, struct scan_block *masks)
+{
+    __m256i quote = _mm256_set1_epi8('"');
+    __m256i backslash = _mm256_set1_epi8('\\');
+    __m256i ctrl = _mm256_set1_epi8(0x1F);
+    __m256i lo, hi;
+
+    for(; count; count--, masks++, start += SCAN_BLOCK_SIZE){
+        lo = _mm256_loadu_si256((const __m256i*)start);
+        hi = _mm256_loadu_si256((const __m256i*)(start + 32));
+        masks->quote = MASK64((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, quote)),
+                              (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, quote)));
+        masks->backslash = MASK64((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, backslash)),
+                                  (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, backslash)));
+        masks->ws = MASK64(ws_mask_avx2(lo), ws_mask_avx2(hi));
+        masks->op = MASK64(op_mask_avx2(lo), op_mask_avx2(hi));
+        masks->ctrl = MASK64((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(lo, ctrl), lo)),
+                             (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(hi, ctrl), hi)));
+    }
+}
+#else
+void scan_block_sse2(const char *start, size_t count, struct scan_block *masks)
+{
+    scan_block_scalar(start, count, masks);
+}
+
+void scan_block_avx2(const char *start, size_t count, struct scan_block *masks)
+{
+    scan_block_scalar(start, count, masks);
+}
+
+const char* scan_ws_sse2(const char *start, const char *end)
+{
+    return scan_ws_scalar(start, end);
+}
+
+const char* scan_ws_avx2(const char *start, const char *end)
+{
+    return scan_ws_scalar(start, end);
+}
+
+const char* scan_str_sse2(const char *start, const char *end)
+{
+    return scan_str_scalar(start, end);
+}
+
+const char* scan_str_avx2(const char *start, const char *end)
+{
+    return scan_str_scalar(start, end);
+}
+
+const char* scan_ascii_sse2(const char *start, const char *end)
+{
+    return scan_ascii_scalar(start, end);
+}
+
+const char* scan_ascii_avx2(const char *start, const char *end)
+{
+    return scan_ascii_scalar(start, end);
+}
+#endif
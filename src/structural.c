@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+#include "structural.h"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRUCTURAL_X86
+#endif
+
+#define MODULE "Structural"
+#include "trace.h"
+
+#define EVEN_BITS           0x5555555555555555ULL
+#define STRUCTURAL_BATCH    16      /* Blocks classified at once */
+/* Offsets of a window, with room for offsets kept from previous one and for 8 extra writes */
+#define STRUCTURAL_SIZE     (STRUCTURAL_WINDOW + SCAN_BLOCK_SIZE)
+
+/*
+* @brief Find characters escaped by backslash
+* Runs of backslashes are split into escaping and escaped ones with one addition,
+* runs starting on odd bits carry into the next even bit and the other way around.
+* @param backslash backslash mask of block
+* @param carry set if first byte of next block is escaped
+* @return mask of escaped characters
+*/
+static inline uint64_t find_escaped(uint64_t backslash, uint64_t *carry)
+{
+    uint64_t follows, odd_starts, even_seq;
+
+    backslash &= ~*carry;
+    follows = (backslash << 1) | *carry;
+    odd_starts = backslash & ~EVEN_BITS & ~follows;
+    *carry = __builtin_add_overflow(odd_starts, backslash, &even_seq);
+    return (EVEN_BITS ^ (even_seq << 1)) & follows;
+}
+
+/*
+* @brief Prefix xor, each bit is xor of itself and all lower bits
+* @param bits mask
+* @return mask of bytes from opening quote till before closing quote
+*/
+static inline uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+/*
+* @brief Add structural characters of a block to index
+* @param s structural index
+* @param masks masks of block
+* @param offset offset of block in buffer
+*/
+static inline __attribute__((always_inline))
+void structural_block(struct structural *s, const struct scan_block *masks, uint32_t offset)
+{
+    uint64_t quote, in_str, outside, scalar, bits;
+    uint32_t *pos = s->pos + s->count;
+    int count, i;
+
+    quote = masks->quote & ~find_escaped(masks->backslash, &s->escaped);
+
+    /* Opening quote and string are inside, closing quote is not */
+    in_str = prefix_xor(quote) ^ s->in_str;
+    s->in_str = (uint64_t)((int64_t)in_str >> 63);
+    outside = ~(in_str | quote);
+
+    /* Value other than string starts after whitespace, structural character or quote */
+    scalar = outside & ~(masks->ws | masks->op);
+    bits = (masks->op & outside) | quote | (scalar & ~((scalar << 1) | s->scalar));
+    s->scalar = scalar >> 63;
+
+    s->attention[offset / SCAN_BLOCK_SIZE] = (masks->backslash | masks->ctrl) & in_str;
+
+    /*
+    * Offsets are written 8 at a time to avoid a branch for each of them,
+    * extra entries are overwritten by next block. Top bit keeps ctz defined.
+    */
+    count = __builtin_popcountll(bits);
+    for(i = 0; i < count; i += 8, pos += 8){
+        pos[0] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[1] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[2] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[3] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[4] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[5] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[6] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+        pos[7] = offset + __builtin_ctzll(bits | (1ULL << 63));
+        bits &= bits - 1;
+    }
+    s->count += count;
+}
+
+/*
+* @brief Add blocks of next window to index
+* @param s structural index
+* @param len length of window, multiple of block size unless it ends buffer
+*/
+static inline __attribute__((always_inline))
+void structural_run(struct structural *s, size_t len)
+{
+    struct scan_block masks[STRUCTURAL_BATCH];
+    char tail[SCAN_BLOCK_SIZE];
+    size_t blocks = len / SCAN_BLOCK_SIZE;
+    size_t count, i;
+
+    for(; blocks; blocks -= count){
+        count = (blocks < STRUCTURAL_BATCH) ? blocks : STRUCTURAL_BATCH;
+        scan_block(s->start + s->offset, count, masks);
+        for(i = 0; i < count; i++, s->offset += SCAN_BLOCK_SIZE){
+            structural_block(s, &masks[i], s->offset);
+        }
+    }
+    if(len % SCAN_BLOCK_SIZE){
+        /* Last block is padded with whitespace */
+        memset(tail, ' ', SCAN_BLOCK_SIZE);
+        memcpy(tail, s->start + s->offset, len % SCAN_BLOCK_SIZE);
+        scan_block(tail, 1, masks);
+        structural_block(s, &masks[0], s->offset);
+        s->offset += len % SCAN_BLOCK_SIZE;
+    }
+}
+
+static void structural_run_generic(struct structural *s, size_t len)
+{
+    structural_run(s, len);
+}
+
+#ifdef STRUCTURAL_X86
+/* Bit counting instructions are available on every cpu with avx2 */
+__attribute__((target("popcnt,bmi")))
+static void structural_run_bmi(struct structural *s, size_t len)
+{
+    structural_run(s, len);
+}
+#endif
+
+/*
+* @brief Index next window of buffer
+* Offsets from pos are kept, window is indexed until there are at least two offsets
+* or whole buffer is indexed, then length of buffer is added.
+* @param s structural index
+* @param pos first offset to keep
+* @return first offset kept
+*/
+const uint32_t* structural_fill(struct structural *s, const uint32_t *pos)
+{
+    size_t len;
+
+    s->count = (s->pos + s->count) - pos;
+    memmove(s->pos, pos, s->count * sizeof(uint32_t));
+    while((s->count < 2) && (s->offset < s->len)){
+        len = ((s->len - s->offset) < STRUCTURAL_WINDOW) ? (s->len - s->offset) : STRUCTURAL_WINDOW;
+#ifdef STRUCTURAL_X86
+        if(scan_level() == SCAN_AVX2)
+            structural_run_bmi(s, len);
+        else
+#endif
+            structural_run_generic(s, len);
+        if(s->offset == s->len)
+            s->pos[s->count++] = s->len;
+    }
+    return s->pos;
+}
+
+/*
+* @brief Start structural index of buffer, first window is indexed
+* @param s structural index, released with structural_free
+* @param start start of buffer
+* @param end end of buffer, at most STRUCTURAL_MAX bytes from start
+* @return 0 or -1 for failure
+*/
+int structural_init(struct structural *s, const char *start, const char *end)
+{
+    memset(s, 0, sizeof(struct structural));
+    if(!start || (end < start) || ((size_t)(end - start) > STRUCTURAL_MAX)){
+        TRACE(ERROR, "Invalid arguments");
+        return -1;
+    }
+    s->start = start;
+    s->len = end - start;
+    if(!(s->pos = malloc(STRUCTURAL_SIZE * sizeof(uint32_t))) ||
+       !(s->attention = malloc(((s->len / SCAN_BLOCK_SIZE) + 1) * sizeof(uint64_t)))){
+        TRACE(ERROR, "Failed to allocate structural index");
+        structural_free(s);
+        return -1;
+    }
+    if(!s->len)
+        s->pos[s->count++] = 0;
+    structural_fill(s, s->pos);
+    return 0;
+}
+
+/*
+* @brief Release memory of structural index
+* @param s structural index
+*/
+void structural_free(struct structural *s)
+{
+    if(s){
+        free(s->pos);
+        free(s->attention);
+        memset(s, 0, sizeof(struct structural));
+    }
+}
+
+/*
+* @brief Find end of json object or list without parsing it
+* Brackets outside strings are counted a block at a time, batches grow
+* so that small containers are not scanned far beyond their end.
+* Content is not validated, only a closing bracket is required for each opening one.
+* @param start { or [ of container
+* @param end end of buffer
+* @return pointer after matching } or ], NULL if container is not closed
+*/
+const char* structural_skip(const char *start, const char *end)
+{
+    struct scan_block masks[STRUCTURAL_BATCH];
+    char tail[SCAN_BLOCK_SIZE];
+    uint64_t escaped = 0, in_str = 0, quote, inside, bits;
+    size_t depth = 0, batch = 1, count, i;
+    const char *block = start;
+    char ch;
+
+    while(block < end){
+        count = (end - block) / SCAN_BLOCK_SIZE;
+        if(!count){
+            /* Last block is padded with whitespace */
+            memset(tail, ' ', SCAN_BLOCK_SIZE);
+            memcpy(tail, block, end - block);
+            scan_block(tail, 1, masks);
+            count = 1;
+        } else {
+            count = (count < batch) ? count : batch;
+            scan_block(block, count, masks);
+        }
+        if(batch < STRUCTURAL_BATCH)
+            batch *= 2;
+        for(i = 0; i < count; i++, block += SCAN_BLOCK_SIZE){
+            quote = masks[i].quote & ~find_escaped(masks[i].backslash, &escaped);
+            inside = prefix_xor(quote) ^ in_str;
+            in_str = (uint64_t)((int64_t)inside >> 63);
+            for(bits = masks[i].op & ~(inside | quote); bits; bits &= bits - 1){
+                ch = block[__builtin_ctzll(bits)];
+                if((ch == '{') || (ch == '[')){
+                    depth++;
+                } else if(((ch == '}') || (ch == ']')) && !--depth){
+                    return block + __builtin_ctzll(bits) + 1;
+                }
+            }
+        }
+    }
+    TRACE(ERROR, "Container is not closed");
+    return NULL;
+}
+
+/*
+* @brief Find points where a list can be split between its members, without parsing it
+* Brackets outside strings are counted like structural_skip, a comma directly inside
+* the list is taken as split point once it is at least step bytes after previous one.
+* Content is not validated, parts must still be parsed.
+* @param start [ of list
+* @param end end of buffer
+* @param step minimum distance between split points
+* @param splits placeholder for commas where list can be split
+* @param count maximum number of split points, replaced by number found
+* @return pointer to matching ], NULL if list is not closed
+*/
+const char* structural_split(const char *start, const char *end, size_t step, const char **splits, size_t *count)
+{
+    struct scan_block masks[STRUCTURAL_BATCH];
+    char tail[SCAN_BLOCK_SIZE];
+    uint64_t escaped = 0, in_str = 0, quote, inside, bits;
+    size_t depth = 0, found = 0, blocks, i;
+    const char *block = start;
+    const char *next = start + step;
+    const char *pos = NULL;
+
+    while(block < end){
+        blocks = (end - block) / SCAN_BLOCK_SIZE;
+        if(!blocks){
+            /* Last block is padded with whitespace */
+            memset(tail, ' ', SCAN_BLOCK_SIZE);
+            memcpy(tail, block, end - block);
+            scan_block(tail, 1, masks);
+            blocks = 1;
+        } else {
+            blocks = (blocks < STRUCTURAL_BATCH) ? blocks : STRUCTURAL_BATCH;
+            scan_block(block, blocks, masks);
+        }
+        for(i = 0; i < blocks; i++, block += SCAN_BLOCK_SIZE){
+            quote = masks[i].quote & ~find_escaped(masks[i].backslash, &escaped);
+            inside = prefix_xor(quote) ^ in_str;
+            in_str = (uint64_t)((int64_t)inside >> 63);
+            for(bits = masks[i].op & ~(inside | quote); bits; bits &= bits - 1){
+                pos = block + __builtin_ctzll(bits);
+                if((*pos == '{') || (*pos == '[')){
+                    depth++;
+                } else if((*pos == '}') || (*pos == ']')){
+                    if(!--depth){
+                        *count = found;
+                        return pos;
+                    }
+                } else if((*pos == ',') && (depth == 1) && (pos >= next) && (found < *count)){
+                    splits[found++] = pos;
+                    next = pos + step;
+                }
+            }
+        }
+    }
+    TRACE(ERROR, "List is not closed");
+    *count = found;
+    return NULL;
+}
@@ -5,10 +5,36 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdint.h>
 #ifdef DARWIN_SYS
 #include <sys/mman.h>
 #endif
 #include "utils.h"
+#include "scan.h"
+#include "pow5.h"
+
+/* Decimal digits which always fit in 64 bit mantissa */
+#define FLOAT_DIGITS_MAX        19
+/* Larger exponents saturate, result is zero or infinity anyway */
+#define FLOAT_EXP_LIMIT         100000
+/* Mantissa is exact in double up to 2^53 */
+#define FLOAT_EXACT_MAX         (1ULL << 53)
+#define DOUBLE_MANTISSA_BITS    52
+#define DOUBLE_EXP_BIAS         1023
+#define DOUBLE_EXP_INF          0x7FF
+/* w * 10^q is infinity above this */
+#define DOUBLE_EXP10_MAX        308
+/* Slow path copy of number fits on stack */
+#define FLOAT_SLOW_BUFFER       256
+
+/* Decimal number, mantissa * 10^exponent */
+struct decimal
+{
+    uint64_t mantissa;
+    int64_t exponent;
+    int digits;         /* Significant digits in mantissa */
+    bool truncated;     /* Non zero digits were dropped from mantissa */
+};
 
 static int tohex(char ch);
 static int todigit(char ch);
@@ -64,7 +90,7 @@ static int todigit(char ch)
 * @param end end of buffer
 * @return rest of buffer after removing space
 */
-char* trim(char *start, char *end)
+char* trim(const char *start, const char *end)
 {
     /* Check for valid ptrs */
     if(start && end){
@@ -72,16 +98,16 @@ char* trim(char *start, char *end)
         if(start >  end){
             /* trim from the end */
             /* Skip all space, including null characters */
-            for(; (start > end) && (isspace(*start) || !*start) ; start--);
+            for(; (start > end) && scan_is_ws(*start); start--);
 
         } else {
             /* trim from beginning */
-            /* Skip all space and stop at null character or any other valid characters*/
-            for(; (start < end) && (!*start || isspace(*start)); start++);
+            /* Skip all space and null characters, whole vectors at a time */
+            start = (char*)scan_ws(start, end);
         }
     }
      /* Return the trimmed ptr, start and end will be handled by caller */
-    return start;
+    return (char*)start;
 }
 
 /*
@@ -90,7 +116,7 @@ char* trim(char *start, char *end)
 * @param end end of buffer
 * @return true if string representation is in hex
 */
-bool is_hex(char *start, char *end)
+bool is_hex(const char *start, const char *end)
 {
     /* Check data*/
     if(start && end && (start < end)){
@@ -104,13 +130,30 @@ bool is_hex(char *start, char *end)
     return false;
 }
 
+/*
+* @brief Check if given number has fraction or exponent
+* @param start start of buffer
+* @param end end of buffer
+* @return true if number should be parsed as double
+*/
+bool is_float(const char *start, const char *end)
+{
+    if(start && end && (start < end)){
+        for(; (start < end) && (todigit(*start) >= 0); start++);
+        return (start < end) && ((*start == '.') || (*start == 'e') || (*start == 'E'));
+    } else {
+        fprintf(stderr,"%s:%d>Null data", __func__, __LINE__);
+    }
+    return false;
+}
+
 /*
 * @brief Check if given number is in octal decimal format
 * @param start start of buffer
 * @param end end of buffer
 * @return true if string representation is in octal
 */
-bool is_octal(char *start, char *end)
+bool is_octal(const char *start, const char *end)
 {
     /*check for data*/
     if(start && end && (start < end)){
@@ -123,166 +166,426 @@ bool is_octal(char *start, char *end)
     return false;
 }
 
+/*
+* SWAR helpers, 8 characters are loaded in a 64 bit word, first character in lowest byte
+*/
+#define SWAR_ONES       0x0101010101010101ULL
+#define SWAR_HIGH       0x8080808080808080ULL
+#define SWAR_REP(x)     (SWAR_ONES * (x))
+
+/* Maximum number of decimal digits which can not overflow 64 bits */
+#define INT_DIGITS_SAFE 19
+
+/*
+* @brief Load 8 characters
+* @param str characters, at least 8
+* @return word with first character in lowest byte
+*/
+static inline uint64_t swar_load(const char *str)
+{
+    uint64_t val;
+    memcpy(&val, str, sizeof(val));
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    val = __builtin_bswap64(val);
+#endif
+    return val;
+}
+
+/*
+* @brief Mark bytes which are in range, all bytes must be below 0x80
+* @param val word
+* @param low lowest value
+* @param high highest value
+* @return 0x80 in every byte which is in range
+*/
+static inline uint64_t swar_range(uint64_t val, unsigned char low, unsigned char high)
+{
+    return (val + SWAR_REP(0x80 - low)) & ~(val + SWAR_REP(0x7F - high)) & SWAR_HIGH;
+}
+
+/*
+* @brief Check if all 8 characters are decimal digits
+* @param val word
+* @return true if all are digits
+*/
+static inline bool swar_is_digits(uint64_t val)
+{
+    return !(val & SWAR_HIGH) && (swar_range(val, '0', '9') == SWAR_HIGH);
+}
+
+/*
+* @brief Convert 8 decimal digits
+* @param val word with valid digits
+* @return value
+*/
+static inline uint32_t swar_digits(uint64_t val)
+{
+    val -= SWAR_REP('0');
+    /* Pairs of digits, then groups of 4, then 8 */
+    val = (val * 10) + (val >> 8);
+    val = (((val & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+           (((val >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return (uint32_t)val;
+}
+
+/*
+* @brief Convert 8 hex digits, if all are valid
+* @param val word
+* @param number placeholder for value
+* @return true if all characters are hex digits
+*/
+static inline bool swar_hex(uint64_t val, uint64_t *number)
+{
+    if((val & SWAR_HIGH) ||
+       ((swar_range(val, '0', '9') | swar_range(val | SWAR_REP(0x20), 'a', 'f')) != SWAR_HIGH))
+        return false;
+    /* Letters have bit 6 set, their low nibble is value - 9 */
+    val = (val & SWAR_REP(0x0F)) + ((val >> 6) & SWAR_ONES) * 9;
+    val = ((val & 0x000F000F000F000FULL) << 4) | ((val >> 8) & 0x000F000F000F000FULL);
+    val = ((val & 0x000000FF000000FFULL) << 8) | ((val >> 16) & 0x000000FF000000FFULL);
+    *number = ((val & 0xFFFF) << 16) | ((val >> 32) & 0xFFFF);
+    return true;
+}
+
+/*
+* @brief Convert 8 octal digits, if all are valid
+* @param val word
+* @param number placeholder for value
+* @return true if all characters are octal digits
+*/
+static inline bool swar_octal(uint64_t val, uint64_t *number)
+{
+    if((val & SWAR_HIGH) || (swar_range(val, '0', '7') != SWAR_HIGH))
+        return false;
+    val -= SWAR_REP('0');
+    val = ((val & 0x0007000700070007ULL) << 3) | ((val >> 8) & 0x0007000700070007ULL);
+    val = ((val & 0x0000003F0000003FULL) << 6) | ((val >> 16) & 0x0000003F0000003FULL);
+    *number = ((val & 0xFFF) << 12) | ((val >> 32) & 0xFFF);
+    return true;
+}
+
 /*
 * @brief Convert string to hex number
+* Leading zeros are skipped, value is exact up to 64 bits
 * @param start start of buffer
 * @param end end of buffer
 * @param raw rest of data after parsing
-* @param overflow overflow occured and data got trucnated
-* @return integer
+* @param overflow set if value does not fit in 64 bits
+* @return number
 */
-unsigned int parse_hex(char *start, char *end, char **raw,bool *overflow)
+uint64_t parse_hex(const char *start, const char *end, char **raw, bool *overflow)
 {
-    char *begin = start;
-    unsigned int number = 0;
-    unsigned int count = 0;
-    int hex_max = sizeof(number) * 2;
-    int val = 0;
-    bool is_overflow = false;
-    unsigned int number_truncated = 0;
+    char *begin = (char*)start;
+    uint64_t number = 0;
+    uint64_t chunk = 0;
+    int digits = 0;
+    int val;
 
     /* Check Data */
-    if( start && end && raw && (start < end)){
-        /* Traverse string */
-        for(*raw = start; *start && start < end; *raw = ++start){
-            
-            count++;
-            /* size of byte is 2 nibble */
-            if(count > hex_max){
-                /* Overflow */
-                fprintf(stderr, "Maximum hex length %d\n",hex_max);
-                is_overflow = true;
-                number_truncated = number;
-                if(overflow)
-                    *overflow = true;
-            }
-
-            /* Convert to Hex a-f, A-F, 0-9*/
-            val = tohex(*start);
-
-            if(val == -1){
-                if(count == 1){
-                /* No Hex Digit Found */
-                    fprintf(stderr, "Invalid Hex digit %c\n", *start);
-                    /* Nothing Parsed */
-                    *raw = begin;
-                    return 0;
-                }
-                break;
-            }
-
-            number =  (number<<4) | val;
-        }
-    } else {
+    if(!start || !end || !raw || (start >= end)){
         fprintf(stderr, "%s:%d>Null data\n",__func__, __LINE__);
+        return 0;
+    }
+    if(tohex(*start) < 0){
+        /* No Hex Digit Found */
+        fprintf(stderr, "Invalid Hex digit %c\n", *start);
+        /* Nothing Parsed */
+        *raw = begin;
+        return 0;
     }
+    for(; (start < end) && (*start == '0'); start++);
 
-    return (is_overflow == false) ? number : number_truncated;
+    /* 8 digits at a time, 16 digits fill 64 bits */
+    for(; ((end - start) >= 8) && (digits < 16) && swar_hex(swar_load(start), &chunk); start += 8, digits += 8){
+        number = (number << 32) | chunk;
+    }
+    for(; (start < end) && ((val = tohex(*start)) >= 0); start++, digits++){
+        if(digits >= 16){
+            if(overflow)
+                *overflow = true;
+        } else {
+            number = (number << 4) | val;
+        }
+    }
+    *raw = (char*)start;
+    return number;
 }
 
 /*
 * @brief Convert string to octal number
+* Leading zeros are skipped, value is exact up to 64 bits
 * @param start start of buffer
 * @param end end of buffer
 * @param raw rest of data after parsing
-* @param overflow overflow occured and data got trucnated
-* @return integer
+* @param overflow set if value does not fit in 64 bits
+* @return number
 */
-unsigned int parse_octal(char *start, char *end, char **raw, bool *overflow)
+uint64_t parse_octal(const char *start, const char *end, char **raw, bool *overflow)
 {
-    char *begin = start;
-    unsigned int number = 0;
-    int octal_max = sizeof(number) * 8 / 3;
-    unsigned int count = 0;
-    int val = 0;
-    bool is_overflow = false;
-    unsigned int number_truncated = 0;
-
-    if( start && end && raw && (start < end)){
-        /* Traverse all string */
-        for(*raw = start; *start && start < end; *raw = ++start){
-            count++;
-            /* size of byte is 2 nibble */
-            if(count > octal_max){
-                /* Overflow */
-                fprintf(stderr, "Maximum length : %d", octal_max);
-                is_overflow = true;
-                number_truncated = number;
-                if(overflow)
-                    *overflow = true;
-                  
-            }
-            /* Convert to octal 0-7*/
-            val = todigit(*start);
-            if((val == -1) || (val > 7)){
-                if(count == 1){
-                /* No Hex Digit Found */
-                    fprintf(stderr, "Invalid octal digit %c\n", *start);
-                    /* Nothing Parsed */
-                    *raw = begin;
-                    return 0;
-                }
-                break;
-            }
-            
-            number =  (number << 3) | val;
+    char *begin = (char*)start;
+    uint64_t number = 0;
+    uint64_t chunk = 0;
+    int val;
+
+    if(!start || !end || !raw || (start >= end)){
+        fprintf(stderr, "%s:%d>Null data\n",__func__, __LINE__);
+        return 0;
+    }
+    val = todigit(*start);
+    if((val < 0) || (val > 7)){
+        /* No Octal Digit Found */
+        fprintf(stderr, "Invalid octal digit %c\n", *start);
+        /* Nothing Parsed */
+        *raw = begin;
+        return 0;
+    }
+    for(; (start < end) && (*start == '0'); start++);
+
+    /* 8 digits at a time while 24 more bits can not overflow */
+    for(; ((end - start) >= 8) && !(number >> 40) && swar_octal(swar_load(start), &chunk); start += 8){
+        number = (number << 24) | chunk;
+    }
+    for(; (start < end) && ((val = todigit(*start)) >= 0) && (val <= 7); start++){
+        if(number >> 61){
+            if(overflow)
+                *overflow = true;
         }
+        number = (number << 3) | val;
+    }
+    *raw = (char*)start;
+    return number;
+}
+
+/* Powers of 10 which are exact in double */
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/*
+* @brief Convert w * 10^q to nearest double, Eisel-Lemire algorithm
+* w * 5^q is computed with 128 bit table entry, which is always precise enough for exact w.
+* Result is rounded to nearest, ties to even.
+* @param q decimal exponent
+* @param w decimal mantissa, not zero
+* @return bits of double
+*/
+static uint64_t eisel_lemire(int64_t q, uint64_t w)
+{
+    const uint64_t *pow5 = NULL;
+    uint64_t high, low, second, mantissa;
+    int lz, upperbit, shift;
+    int64_t power2;
+
+    if(q < POW5_128_MIN)
+        return 0;
+    if(q > DOUBLE_EXP10_MAX)
+        return (uint64_t)DOUBLE_EXP_INF << DOUBLE_MANTISSA_BITS;
+
+    lz = __builtin_clzll(w);
+    w <<= lz;
+    pow5 = pow5_128[q - POW5_128_MIN];
+    low = mul128(w, pow5[0], &high);
+    /* Lower half of table entry matters only when bits below needed precision are all ones */
+    if((high & (UINT64_MAX >> (DOUBLE_MANTISSA_BITS + 3))) == (UINT64_MAX >> (DOUBLE_MANTISSA_BITS + 3))){
+        mul128(w, pow5[1], &second);
+        low += second;
+        if(second > low)
+            high++;
+    }
+
+    upperbit = high >> 63;
+    shift = upperbit + 64 - DOUBLE_MANTISSA_BITS - 3;
+    mantissa = high >> shift;
+    /* floor(q * log2(10)) + 63 */
+    power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + DOUBLE_EXP_BIAS;
+
+    if(power2 <= 0){
+        /* Subnormal */
+        if(-power2 + 1 >= 64)
+            return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += (mantissa & 1);
+        mantissa >>= 1;
+        /* Rounding may carry into smallest normal number, exponent bit is then set by mantissa */
+        return mantissa;
+    }
+
+    /* Exactly halfway, round down to even instead of up, only possible for small q */
+    if((low <= 1) && (q >= -4) && (q <= 23) && ((mantissa & 3) == 1) &&
+       ((mantissa << shift) == high)){
+        mantissa &= ~1ULL;
+    }
+    mantissa += (mantissa & 1);
+    mantissa >>= 1;
+    if(mantissa >= (2ULL << DOUBLE_MANTISSA_BITS)){
+        mantissa = 1ULL << DOUBLE_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(1ULL << DOUBLE_MANTISSA_BITS);
+    if(power2 >= DOUBLE_EXP_INF)
+        return (uint64_t)DOUBLE_EXP_INF << DOUBLE_MANTISSA_BITS;
+    return ((uint64_t)power2 << DOUBLE_MANTISSA_BITS) | mantissa;
+}
+
+/*
+* @brief Add digit to decimal
+* @param dec decimal
+* @param digit digit value
+* @param fraction digit is after decimal point
+*/
+static inline void decimal_push(struct decimal *dec, int digit, bool fraction)
+{
+    if(!dec->mantissa && !digit){
+        /* Leading zero */
+        if(fraction)
+            dec->exponent--;
+    } else if(dec->digits < FLOAT_DIGITS_MAX){
+        dec->mantissa = dec->mantissa * 10 + digit;
+        dec->digits++;
+        if(fraction)
+            dec->exponent--;
     } else {
-        fprintf(stderr, "%s:%d>Null data\n",__func__, __LINE__);
+        /* Dropped digit */
+        if(!fraction)
+            dec->exponent++;
+        if(digit)
+            dec->truncated = true;
     }
+}
 
-    return (is_overflow == false) ? number : number_truncated;
+/*
+* @brief Convert number with all its digits using strtod
+* Number is rewritten as integer and exponent, so that locale decimal point does not matter
+* @param start first digit or decimal point
+* @param end end of digits
+* @param exponent explicit exponent
+* @return double
+*/
+static double parse_float_slow(const char *start, const char *end, int64_t exponent)
+{
+    char stack[FLOAT_SLOW_BUFFER];
+    char *buffer = stack;
+    size_t size = (end - start) + 32;
+    size_t len = 0;
+    bool fraction = false;
+    double number;
+
+    if((size > sizeof(stack)) && !(buffer = malloc(size))){
+        fprintf(stderr, "%s:%d>Failed to allocate memory\n", __func__, __LINE__);
+        return 0;
+    }
+    for(; start < end; start++){
+        if(*start == '.'){
+            fraction = true;
+            continue;
+        }
+        /* Every digit after decimal point scales integer down */
+        if(fraction)
+            exponent--;
+        if(len || (*start != '0'))
+            buffer[len++] = *start;
+    }
+    snprintf(buffer + len, size - len, "e%lld", (long long)exponent);
+    number = strtod(len ? buffer : "0", NULL);
+    if(buffer != stack)
+        free(buffer);
+    return number;
 }
 
 /*
-* @brief Convert string to fractional part of number
-* @param start start of buffer
+* @brief Convert string to double, correctly rounded
+* Accepts digits with optional fraction and exponent, and f suffix, sign is handled by caller.
+* Up to 19 significant digits are converted exactly with Eisel-Lemire algorithm,
+* longer numbers fall back to strtod only if the dropped digits could change the result.
+* @param start start of buffer, first digit or decimal point
 * @param end end of buffer
 * @param raw rest of data after parsing
-* @return fractional value
+* @return double value
 */
-double parse_float(char *start, char *end,  char **raw)
+double parse_float(const char *start, const char *end,  char **raw)
 {
-    char *begin = start;
+    char *begin = (char*)start;
+    const char *digits_end = NULL;
+    struct decimal dec = {.mantissa = 0, .exponent = 0, .digits = 0, .truncated = false};
+    int64_t exponent = 0;
+    int count = 0, frac = 0, val;
+    bool negative = false;
+    uint64_t bits;
     double number = 0;
-    double multiple = 1.0f;
-    int val = 0;
-    int count = 0;
 
     /* Check data*/
-    if( start && end && raw && (start < end)){
-        /* Traverse all string */
-        for(*raw = start; *start && start < end; *raw = ++start){
-            count++;
-
-            /* Convert to digit */
-            val = todigit(*start);
-            if(val == -1 ){
-                if(count == 1){
-                    fprintf(stderr,"Failed to parse, nothing after decimal\n");
-                    /* Nothing Parsed */
-                    *raw = begin;
-                    return 0;
-                }
-                break;
-            }
+    if(!start || !end || !raw || (start >= end)){
+        fprintf(stderr, "%s:%d>Null data\n",__func__, __LINE__);
+        return 0;
+    }
+    /* Nothing Parsed */
+    *raw = begin;
 
-            multiple *= 0.1f;
-            number = number + val * multiple;     
+    /* Integer part */
+    for(; (start < end) && ((val = todigit(*start)) >= 0); start++, count++){
+        decimal_push(&dec, val, false);
+    }
+    /* Fractional part */
+    if((start < end) && (*start == '.')){
+        for(start++; (start < end) && ((val = todigit(*start)) >= 0); start++, frac++){
+            decimal_push(&dec, val, true);
+        }
+        if(!frac){
+            fprintf(stderr,"Failed to parse, nothing after decimal\n");
+            return 0;
         }
+    }
+    if(!count && !frac){
+        return 0;
+    }
+    digits_end = start;
 
-        /* Float */
-        if((*raw < end)&& (**raw == 'f' || **raw == 'F')){
-            *raw = (*raw) + 1;
+    /* Exponent */
+    if((start < end) && ((*start == 'e') || (*start == 'E'))){
+        start++;
+        if((start < end) && ((*start == '+') || (*start == '-'))){
+            negative = (*start == '-');
+            start++;
         }
-    } else {
-        fprintf(stderr, "%s:%d>Null data\n",__func__, __LINE__);
+        if((start >= end) || (todigit(*start) < 0)){
+            fprintf(stderr,"Failed to parse, exponent missing\n");
+            return 0;
+        }
+        for(; (start < end) && ((val = todigit(*start)) >= 0); start++){
+            if(exponent < FLOAT_EXP_LIMIT)
+                exponent = exponent * 10 + val;
+        }
+        if(negative)
+            exponent = -exponent;
     }
+    dec.exponent += exponent;
 
+    /* Float */
+    if((start < end) && (*start == 'f' || *start == 'F')){
+        start++;
+    }
+    *raw = (char*)start;
+
+    if(!dec.mantissa){
+        number = 0;
+    } else if(!dec.truncated && (dec.exponent >= -22) && (dec.exponent <= 22) && (dec.mantissa <= FLOAT_EXACT_MAX)){
+        /* Both operands are exact, single rounding gives correct result */
+        number = (double)dec.mantissa;
+        number = (dec.exponent < 0) ? number / pow10_exact[-dec.exponent] : number * pow10_exact[dec.exponent];
+    } else {
+        bits = eisel_lemire(dec.exponent, dec.mantissa);
+        /* Dropped digits are between mantissa and mantissa + 1, result is exact if both round the same */
+        if(dec.truncated && (bits != eisel_lemire(dec.exponent, dec.mantissa + 1))){
+            number = parse_float_slow(begin, digits_end, exponent);
+        } else {
+            memcpy(&number, &bits, sizeof(number));
+        }
+    }
     return number;
 }
 
-
 /*
 * @brief Convert string to boolean
 * @param start start of buffer
@@ -290,14 +593,14 @@ double parse_float(char *start, char *end,  char **raw)
 * @param raw rest of data after parsing
 * @return boolean
 */
-bool parse_boolean(char *start, char *end, char** raw)
+bool parse_boolean(const char *start, const char *end, char** raw)
 {
     int len = end - start;
     int tlen = 4;
     int flen = 5;
     if(start && end && raw && (len > 0)){
         /* Nothing Parsed */
-        *raw = start;
+        *raw = (char*)start;
 
         if((len >= tlen) || (len >= flen)){
             if(strncmp(start, "true", 4) == 0){
@@ -315,17 +618,20 @@ bool parse_boolean(char *start, char *end, char** raw)
 
 /*
 * @brief parse quoted string
+* Input is not modified, escapes are skipped but not decoded, see unescape_str.
+* Runs of plain characters are skipped with scan_str, a vector at a time.
 * @param start start of buffer
 * @param end end of buffer
 * @param raw rest of data after parsing
-* @param len length of string
-* @return pointer to string 
+* @param len length of string, excluding quotes
+* @param escaped set if string has escape sequences, can be NULL
+* @return pointer to first character of string
 */
-char *parse_str(char *start, char *end, char** raw, int *len)
+char *parse_str(const char *start, const char *end, char** raw, int *len, bool *escaped)
 {
-    char *begin = start;
-    bool escape_on = false;
-    char *str_start = NULL;
+    char *begin = (char*)start;
+    const char *str_start = NULL;
+    bool has_escape = false;
 
     if(start && end && raw && (start < end)){
 
@@ -333,24 +639,25 @@ char *parse_str(char *start, char *end, char** raw, int *len)
         if(*start != '"')
             return NULL;
 
-        /* Set it to NULL */
         start++;
         str_start = start;
 
-        /* For now we allow line break */
-        for(*raw = begin;  *start && (start < end); *raw = ++start){
-            /* Escaped */
-            if(*start == '/'){
-                /* Esacpe Sign, can be used to embed double quotes */
-                escape_on = !escape_on;
-            } else if((*start == '"' ) &&( !escape_on )){
-                *raw = start + 1;
-                *start = '\0';
-                return str_start;
+        for(*raw = begin; (start = scan_str(start, end)) < end; start++){
+            if(*start == '"'){
+                *raw = (char*)start + 1;
+                if(len)
+                    *len = start - str_start;
+                if(escaped)
+                    *escaped = has_escape;
+                return (char*)str_start;
+            } else if(*start == '\\'){
+                /* Escape is applied to next character, it can be used to embed double quotes */
+                has_escape = true;
+                if(++start >= end)
+                    break;
+            } else if((*start != '\n') && (*start != '\r') && (*start != '\t')){
+                /* For now we allow line break, other control characters are invalid */
                 break;
-            } else {
-                /* Escape is only applied to next one character */
-                escape_on = false;
             }
         }
     } else {
@@ -358,77 +665,170 @@ char *parse_str(char *start, char *end, char** raw, int *len)
     }
 
     /* Nothing Parsed */
-    *raw = start;
+    *raw = begin;
     return NULL;
 }
 
 /*
-* @brief Convert string to long number
+* @brief Read 4 hex digits of unicode escape
+* @param str digits
+* @return code unit or -1 for invalid data
+*/
+static long parse_ucs(const char *str)
+{
+    long val = 0;
+    int i, digit;
+    for(i = 0; i < 4; i++){
+        if((digit = tohex(str[i])) < 0)
+            return -1;
+        val = (val << 4) | digit;
+    }
+    return val;
+}
+
+/*
+* @brief Encode unicode code point in utf-8
+* @param dst destination, needs space for 4 bytes
+* @param cp code point
+* @return number of bytes written
+*/
+static int utf8_encode(char *dst, unsigned long cp)
+{
+    if(cp < 0x80){
+        dst[0] = cp;
+        return 1;
+    } else if(cp < 0x800){
+        dst[0] = 0xC0 | (cp >> 6);
+        dst[1] = 0x80 | (cp & 0x3F);
+        return 2;
+    } else if(cp < 0x10000){
+        dst[0] = 0xE0 | (cp >> 12);
+        dst[1] = 0x80 | ((cp >> 6) & 0x3F);
+        dst[2] = 0x80 | (cp & 0x3F);
+        return 3;
+    }
+    dst[0] = 0xF0 | (cp >> 18);
+    dst[1] = 0x80 | ((cp >> 12) & 0x3F);
+    dst[2] = 0x80 | ((cp >> 6) & 0x3F);
+    dst[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+/*
+* @brief Decode escape sequences of string returned by parse_str
+* Decoded string is never longer than source, so dst can be same as src to decode in place.
+* Unicode escapes are converted to utf-8, surrogate pairs are combined.
+* Result is not null terminated.
+* @param dst destination buffer, at least len bytes
+* @param src string
+* @param len length of string
+* @return length of decoded string or -1 for invalid escape
+*/
+int unescape_str(char *dst, const char *src, int len)
+{
+    const char *end = src + len;
+    const char *esc = NULL;
+    char *out = dst;
+    long cp, lo;
+
+    if(!dst || !src || (len < 0))
+        return -1;
+
+    while((esc = memchr(src, '\\', end - src))){
+        /* Copy everything before escape as it is */
+        if(out != src)
+            memmove(out, src, esc - src);
+        out += esc - src;
+        src = esc + 1;
+        if(src >= end)
+            return -1;
+        switch(*src++){
+            case '"':  *out++ = '"';  break;
+            case '\\': *out++ = '\\'; break;
+            case '/':  *out++ = '/';  break;
+            case 'b':  *out++ = '\b'; break;
+            case 'f':  *out++ = '\f'; break;
+            case 'n':  *out++ = '\n'; break;
+            case 'r':  *out++ = '\r'; break;
+            case 't':  *out++ = '\t'; break;
+            case 'u':
+                if(((end - src) < 4) || ((cp = parse_ucs(src)) < 0))
+                    return -1;
+                src += 4;
+                if((cp >= 0xD800) && (cp <= 0xDBFF)){
+                    /* High surrogate must be followed by low surrogate */
+                    if(((end - src) < 6) || (src[0] != '\\') || (src[1] != 'u') ||
+                       ((lo = parse_ucs(src + 2)) < 0xDC00) || (lo > 0xDFFF))
+                        return -1;
+                    src += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                } else if((cp >= 0xDC00) && (cp <= 0xDFFF)){
+                    /* Lone low surrogate */
+                    return -1;
+                }
+                out += utf8_encode(out, cp);
+            break;
+            default:
+                return -1;
+        }
+    }
+    /* Rest of string has no escapes */
+    if(out != src)
+        memmove(out, src, end - src);
+    out += end - src;
+    return out - dst;
+}
+
+/*
+* @brief Convert string to integer
+* Digits are converted 8 at a time, value is exact up to 64 bits
 * @param start start of buffer
 * @param end end of buffer
 * @param raw rest of data after parsing
-* @param overflow overflow occured and data got trucnated
+* @param overflow set if value does not fit in 64 bits
 * @param unsigned_flag if number if unsigned
-* @return long number
+* @return magnitude of number, sign is handled by caller
 */
-long parse_int(char *start, char *end, char** raw, bool *overflow, bool *unsigned_flag)
+uint64_t parse_int(const char *start, const char *end, char** raw, bool *overflow, bool *unsigned_flag)
 {
-    long number = 0;
-    long old = 0;
-    long number_truncated = 0;
+    uint64_t number = 0;
+    char *begin = (char*)start;
     int count = 0;
-    bool is_overflow = false;
     int val = 0;
-    char *begin = start;
+
     /* Check data */
-    if(start && end && raw && (start < end)){
-        /* Traverse all data */
-        for(; *start && start < end; *raw = ++start){
-            if((*start == 'u') || (*start == 'U')){
-                if(unsigned_flag)
-                    *unsigned_flag = true;
-                /* check if found any digit*/
-                if(count == 0){
-                    fprintf(stderr,"%s:%d>Number missing", __func__, __LINE__);
-                    *raw = begin;
-                    return 0;
-                }
-                /* Rest of data to process*/
-                *raw = trim(start+1, end);
-                break;
-            }else if((*start == 'l') || (*start == 'L')){
-                /* check if found any digit*/
-                if(count == 0){
-                    fprintf(stderr,"%s:%d>Number missing", __func__, __LINE__);
-                    *raw = begin;
-                    return 0;
-                }
-                /* Rest of data to process*/
-                *raw = trim(start+1, end);
-                break;
-            } else if((val = todigit(*start)) >= 0) {
-                count++;
-                old = number; 
-                number = number * 10 + val;
-                if(( number < 0 ) && (is_overflow == false)){
-                    is_overflow = true;
-                    number_truncated = old;
-                    fprintf(stderr,"%s:%d>Overflow in integer max value:%lu", __func__, __LINE__, LONG_MAX);
-                    if(*overflow)
-                        *overflow = true;
-                } 
-            } else if (count == 0){
-                fprintf(stderr,"%s:%d>Number missing", __func__, __LINE__);
-                *raw = begin;
-                return 0;
-            } else {
-                /* Rest of data to process*/
-                *raw = trim(start, end);
-                break;
-            }
-        }
-    } else {
+    if(!start || !end || !raw || (start >= end)){
         fprintf(stderr,"%s:%d>Null data", __func__, __LINE__);
+        return 0;
     }
-    return (is_overflow == false) ? number : number_truncated;
+    *raw = begin;
+
+    /* First 16 digits can not overflow, 8 at a time */
+    for(; ((end - start) >= 8) && (count <= INT_DIGITS_SAFE - 8) && swar_is_digits(swar_load(start)); start += 8, count += 8){
+        number = number * 100000000 + swar_digits(swar_load(start));
+    }
+    for(; (start < end) && ((val = todigit(*start)) >= 0); start++, count++){
+        if((count >= INT_DIGITS_SAFE) &&
+           (__builtin_mul_overflow(number, 10, &number) || __builtin_add_overflow(number, val, &number))){
+            if(overflow)
+                *overflow = true;
+        } else if(count < INT_DIGITS_SAFE){
+            number = number * 10 + val;
+        }
+    }
+    if(count == 0){
+        fprintf(stderr,"%s:%d>Number missing", __func__, __LINE__);
+        return 0;
+    }
+
+    if((start < end) && ((*start == 'u') || (*start == 'U'))){
+        if(unsigned_flag)
+            *unsigned_flag = true;
+        start++;
+    } else if((start < end) && ((*start == 'l') || (*start == 'L'))){
+        start++;
+    }
+    /* Rest of data to process*/
+    *raw = trim(start, end);
+    return number;
 }
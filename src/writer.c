@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "json.h"
+#include "writer.h"
+
+#define MODULE "Writer"
+#include "trace.h"
+
+#define JsonErr(x)          (-(JSON_ERR_BEGIN + (x)))
+
+/* Indentation is copied from here */
+static const char spaces[] = "                                                                "
+                             "                                                                ";
+
+/*
+* @brief Write to caller's buffer, its last byte is kept for null termination
+* @param w writer
+* @param buffer buffer
+* @param size size of buffer
+*/
+void writer_mem(struct writer *w, char *buffer, size_t size)
+{
+    memset(w, 0, offsetof(struct writer, local));
+    w->sink = WRITER_MEM;
+    w->buffer = buffer;
+    w->size = size ? size - 1 : 0;
+}
+
+/*
+* @brief Write to buffer which grows as needed, buffer is taken by caller or released with writer_free
+* @param w writer
+* @param size initial size of buffer
+* @return JSON_ERR value
+*/
+int writer_alloc(struct writer *w, size_t size)
+{
+    memset(w, 0, offsetof(struct writer, local));
+    w->sink = WRITER_ALLOC;
+    /* Room for null termination is kept */
+    if(!(w->buffer = malloc(size + 1))){
+        TRACE(ERROR, "Failed to allocate buffer");
+        return (w->err = JsonErr(JSON_ERR_NO_MEM));
+    }
+    w->size = size;
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Write to file descriptor, output is buffered until writer_flush
+* @param w writer
+* @param fd file descriptor
+*/
+void writer_fd(struct writer *w, int fd)
+{
+    memset(w, 0, offsetof(struct writer, local));
+    w->sink = WRITER_FD;
+    w->fd = fd;
+    w->buffer = w->local;
+    w->size = sizeof(w->local);
+}
+
+/*
+* @brief Write to file descriptor with writev, long strings are not copied to buffer
+* Output is buffered until writer_flush, strings given to writer_ref must stay valid until then.
+* @param w writer
+* @param fd file descriptor
+*/
+void writer_fdv(struct writer *w, int fd)
+{
+    writer_fd(w, fd);
+    w->sink = WRITER_FDV;
+}
+
+/*
+* @brief Write to stream, output is buffered until writer_flush
+* @param w writer
+* @param fp stream
+*/
+void writer_file(struct writer *w, FILE *fp)
+{
+    memset(w, 0, offsetof(struct writer, local));
+    w->sink = WRITER_FILE;
+    w->fp = fp;
+    w->buffer = w->local;
+    w->size = sizeof(w->local);
+}
+
+/*
+* @brief Only count output, bytes are formatted into local buffer which is then dropped
+* Formatting into a small buffer which stays in cache is cheaper than checking
+* for this sink on every write.
+* @param w writer
+*/
+void writer_count(struct writer *w)
+{
+    memset(w, 0, offsetof(struct writer, local));
+    w->sink = WRITER_COUNT;
+    w->buffer = w->local;
+    w->size = sizeof(w->local);
+}
+
+/*
+* @brief Write bytes to fd or stream
+* @param w writer
+* @param data bytes
+* @param len number of bytes
+* @return JSON_ERR value
+*/
+static int writer_out(struct writer *w, const char *data, size_t len)
+{
+    ssize_t n;
+
+    if(w->err || (w->sink == WRITER_COUNT))
+        return w->err;
+    if(w->sink == WRITER_FILE){
+        if(fwrite(data, 1, len, w->fp) != len){
+            TRACE(ERROR, "Failed to write stream");
+            w->err = JsonErr(JSON_ERR_SYS);
+        }
+        return w->err;
+    }
+    while(len){
+        if((n = write(w->fd, data, len)) >= 0){
+            data += n;
+            len -= n;
+        } else if(errno != EINTR){
+            TRACE(ERROR, "Failed to write file");
+            return (w->err = JsonErr(JSON_ERR_SYS));
+        }
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Write collected parts of buffer and referenced strings to fd
+* @param w writer
+* @return JSON_ERR value
+*/
+static int writer_outv(struct writer *w)
+{
+    struct iovec *iov = w->iov;
+    int count = w->iovcnt;
+    ssize_t n;
+
+    w->iovcnt = 0;
+    if(w->err)
+        return w->err;
+    while(count){
+        if((n = writev(w->fd, iov, count)) < 0){
+            if(errno == EINTR)
+                continue;
+            TRACE(ERROR, "Failed to write file");
+            return (w->err = JsonErr(JSON_ERR_SYS));
+        }
+        /* Skip what was written, write can be partial */
+        for(; count && ((size_t)n >= iov->iov_len); count--, iov++)
+            n -= iov->iov_len;
+        if(count){
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return JsonErr(JSON_ERR_SUCCESS);
+}
+
+/*
+* @brief Reference bytes with iov instead of copying them, buffered bytes before them are referenced first
+* @param w writer with WRITER_FDV sink
+* @param data bytes, valid until writer_flush
+* @param len number of bytes
+*/
+void writer_iov(struct writer *w, const char *data, size_t len)
+{
+    if(w->iovcnt > (WRITER_IOV - 2))
+        writer_flush(w);
+    if(w->used > w->mark){
+        w->iov[w->iovcnt].iov_base = w->buffer + w->mark;
+        w->iov[w->iovcnt++].iov_len = w->used - w->mark;
+        w->mark = w->used;
+    }
+    w->iov[w->iovcnt].iov_base = (char*)data;
+    w->iov[w->iovcnt++].iov_len = len;
+    w->total += len;
+}
+
+/*
+* @brief Write buffered bytes to fd or stream, or drop them when only counting
+* @param w writer
+* @return JSON_ERR value
+*/
+int writer_flush(struct writer *w)
+{
+    if(w->sink == WRITER_FDV){
+        if(w->used > w->mark){
+            w->iov[w->iovcnt].iov_base = w->buffer + w->mark;
+            w->iov[w->iovcnt++].iov_len = w->used - w->mark;
+        }
+        writer_outv(w);
+        w->used = w->mark = 0;
+    } else if(((w->sink == WRITER_FD) || (w->sink == WRITER_FILE) || (w->sink == WRITER_COUNT)) && w->used){
+        writer_out(w, w->buffer, w->used);
+        w->used = 0;
+    }
+    return w->err;
+}
+
+/*
+* @brief Append bytes which do not fit in buffer
+* Buffer is flushed or grown, bytes which still do not fit in caller's buffer are only counted.
+* @param w writer
+* @param data bytes
+* @param len number of bytes
+* @return JSON_ERR value
+*/
+int writer_slow(struct writer *w, const char *data, size_t len)
+{
+    char *temp = NULL;
+    size_t size, n;
+
+    w->total += len;
+    switch(w->sink){
+        case WRITER_MEM:
+            n = ((w->size - w->used) < len) ? (w->size - w->used) : len;
+            memcpy(w->buffer + w->used, data, n);
+            w->used += n;
+            if(n < len)
+                w->err = JsonErr(JSON_ERR_OVERFLOW);
+            break;
+
+        case WRITER_ALLOC:
+            if(w->err)
+                break;
+            for(size = w->size ? w->size * 2 : 64; size < w->used + len; size *= 2);
+            if(!(temp = realloc(w->buffer, size + 1))){
+                TRACE(ERROR, "Failed to grow buffer");
+                w->err = JsonErr(JSON_ERR_NO_MEM);
+                break;
+            }
+            w->buffer = temp;
+            w->size = size;
+            memcpy(w->buffer + w->used, data, len);
+            w->used += len;
+            break;
+
+        default:
+            /* Large writes go out directly, or are only counted */
+            writer_flush(w);
+            if(len < w->size){
+                memcpy(w->buffer, data, len);
+                w->used = len;
+            } else {
+                writer_out(w, data, len);
+            }
+            break;
+    }
+    return w->err;
+}
+
+/*
+* @brief Append spaces for indentation
+* @param w writer
+* @param count number of spaces
+*/
+void writer_spaces(struct writer *w, size_t count)
+{
+    size_t n;
+
+    for(; count; count -= n){
+        n = (count < (sizeof(spaces) - 1)) ? count : (sizeof(spaces) - 1);
+        writer_write(w, spaces, n);
+    }
+}
+
+/*
+* @brief Take buffer of growing writer, it is null terminated and shrunk when most of it is unused
+* @param w writer
+* @return buffer, caller frees it
+*/
+char* writer_take(struct writer *w)
+{
+    char *buffer = w->buffer;
+
+    buffer[w->used] = 0;
+    /* Return unused part of buffer, it can be half of it */
+    if(((w->size - w->used) > WRITER_SLACK) && !(buffer = realloc(w->buffer, w->used + 1)))
+        buffer = w->buffer;
+    w->buffer = NULL;
+    w->size = w->used = 0;
+    return buffer;
+}
+
+/*
+* @brief Release buffer of growing writer
+* @param w writer
+*/
+void writer_free(struct writer *w)
+{
+    if(w->sink == WRITER_ALLOC)
+        free(w->buffer);
+    w->buffer = NULL;
+    w->size = w->used = 0;
+}
@@ -10,6 +10,7 @@
 
 #define TEST_LIST_SIZE 10
 #define TEST_STR_SIZE_MAX 15
+#define TEST_DICT_LARGE 5000
 
 char _dict_keys[TEST_LIST_SIZE][TEST_STR_SIZE_MAX];
 char _dict_vals[TEST_LIST_SIZE][TEST_STR_SIZE_MAX];
@@ -234,6 +235,58 @@ static int test_iter(void)
     return status;
 }
 
+static int test_large(void)
+{
+    int status = 1;
+    struct dict* dict = NULL;
+    struct iter* iter = NULL;
+    static char keys[TEST_DICT_LARGE][TEST_STR_SIZE_MAX];
+    char *key;
+    int i;
+    if(!(dict = dict_new(NULL, str_cmp, str_print))){
+        TRACE(ERROR, "Failed to allocate dict");
+        return 0;
+    }
+    for(i = 0; i < TEST_DICT_LARGE; i++){
+        snprintf(keys[i], TEST_STR_SIZE_MAX, "key%d", i);
+        if((dict_set(dict, keys[i], keys[i])) != i + 1){
+            TRACE(ERROR, "Dict set failed for %s", keys[i]);
+            status = 0;
+        }
+    }
+    /* Remove every odd key */
+    for(i = 1; i < TEST_DICT_LARGE; i += 2){
+        if((dict_set(dict, keys[i], NULL)) < 0){
+            TRACE(ERROR, "Dict delete failed for %s", keys[i]);
+            status = 0;
+        }
+    }
+    if(dict_size(dict) != TEST_DICT_LARGE / 2){
+        TRACE(ERROR, "Size mismatch %d", dict_size(dict));
+        status = 0;
+    }
+    for(i = 0; i < TEST_DICT_LARGE; i++){
+        if((dict_get(dict, keys[i]) != NULL) != !(i % 2)){
+            TRACE(ERROR, "Dict get failed for %s", keys[i]);
+            status = 0;
+        }
+    }
+    /* Insertion order is kept */
+    if((iter = dict_iter(dict))){
+        for(i = 0, key = iter_next(iter); key; key = iter_next(iter), i += 2){
+            if((i >= TEST_DICT_LARGE) || (strcmp(key, keys[i]) != 0)){
+                TRACE(ERROR, "Order mismatch %s", key);
+                status = 0;
+                break;
+            }
+        }
+        iter_del(iter);
+    } else {
+        status = 0;
+    }
+    dict_del(dict);
+    return status;
+}
 
 static void init()
 {
@@ -256,6 +309,7 @@ int test_dict_run(void)
     TEST_RUN(test_replace, "Replace");
     TEST_RUN(test_set_null, "Set Null");
     TEST_RUN(test_iter, "Iteration");
+    TEST_RUN(test_large, "Large dict");
     TEST_SUITE_RESULTS();
 
     return 1;
@@ -1,13 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "json.h"
 #include "iter.h"
+#include "scan.h"
 #include "test.h"
 
 #define MODULE "JsonTest"
 #include "trace.h"
 #define TEST_LIST_SIZE 10
+#define TEST_WIDE_SIZE 50000
 
 char* fname_success[]={"data/success_1.json", 
                        "data/success_2.json", 
@@ -288,6 +298,1734 @@ int test_list(void)
     return status;
 }
 
+static int test_dup_policy(void)
+{
+    int status = 1;
+    int err;
+    long n = 0;
+    struct json *json = NULL;
+    struct json_opts opts = {0};
+    char buffer[] = "{\"a\":1,\"b\":2,\"a\":3}";
+    char *end = buffer + sizeof(buffer) - 1;
+    int policy[] = {JSON_DUP_ERROR, JSON_DUP_LAST, JSON_DUP_FIRST};
+    long expected[] = {0, 3, 1};
+    int i;
+
+    for(i = 0; i < sizeof(policy)/sizeof(policy[0]); i++){
+        char temp[sizeof(buffer)];
+        memcpy(temp, buffer, sizeof(buffer));
+        opts.dup = policy[i];
+        json = json_loads_opts(temp, temp + (end - buffer), &opts, &err);
+        if(policy[i] == JSON_DUP_ERROR){
+            if(json || (err != -JSON_ERR_KEY_REPEAT)){
+                TRACE(ERROR, "Duplicate key accepted");
+                status = 0;
+            }
+        } else if(!json){
+            TRACE(ERROR, "Failed to parse with policy %d : %s", policy[i], json_sterror(err));
+            status = 0;
+        } else if(json_size(json) != 2 || (json_val(json_get(json, "a"), &n, sizeof(n))) < 0 || (n != expected[i])){
+            TRACE(ERROR, "Wrong value for policy %d", policy[i]);
+            status = 0;
+        }
+        if(json)
+            json_del(json);
+    }
+    return status;
+}
+
+static int test_wide_object(void)
+{
+    int status = 1;
+    int err, i, len = 0;
+    long n = 0;
+    char key[32];
+    char *buffer = NULL;
+    struct json *json = NULL;
+
+    if(!(buffer = malloc(TEST_WIDE_SIZE * 32))){
+        return 0;
+    }
+    len += sprintf(buffer + len, "{");
+    for(i = 0; i < TEST_WIDE_SIZE; i++){
+        len += sprintf(buffer + len, "%s\"key%d\":%d", i ? "," : "", i, i);
+    }
+    len += sprintf(buffer + len, "}");
+
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Failed to parse wide object : %s", json_sterror(err));
+        status = 0;
+    } else {
+        for(i = 0; i < TEST_WIDE_SIZE; i += 97){
+            snprintf(key, sizeof(key), "key%d", i);
+            if((json_val(json_get(json, key), &n, sizeof(n))) < 0 || (n != i)){
+                TRACE(ERROR, "Wrong value for %s", key);
+                status = 0;
+            }
+        }
+        json_del(json);
+    }
+    free(buffer);
+    return status;
+}
+
+static int test_arena(void)
+{
+    int status = 1;
+    int i, err;
+    long n = 0;
+    size_t used = 0, reserved = 0;
+    int file_count = sizeof(fname_success)/sizeof(char*);
+    struct json *json = NULL;
+    struct json *copy = NULL;
+    struct json_opts opts = {0};
+    char buffer[] = "{\"a\":[1,2,{\"b\":\"str\"}],\"c\":7}";
+
+    opts.flags = JSON_OPT_ARENA;
+    for(i = 0;i < file_count; i++){
+        if(!(json = json_load_opts(fname_success[i], &opts, &err))){
+            TRACE(ERROR, "Failed parse file : %s, err : %s",fname_success[i], json_sterror(err));
+            status = 0;
+        } else {
+            json_doc_del(json);
+        }
+    }
+
+    if(!(json = json_loads_arena(buffer, buffer + sizeof(buffer) - 1, &err))){
+        TRACE(ERROR, "Failed to parse in arena : %s", json_sterror(err));
+        return 0;
+    }
+    if((json_doc_stats(json, &used, &reserved)) < 0 || !used || (used > reserved)){
+        TRACE(ERROR, "Invalid arena stats %zu/%zu", used, reserved);
+        status = 0;
+    }
+    /* Clone is allocated from heap and outlives document */
+    if(!(copy = json_clone(json, &err)) || (json_doc_stats(copy, NULL, NULL) >= 0)){
+        TRACE(ERROR, "Failed to clone document");
+        status = 0;
+    }
+    n = 8;
+    if((json_set(json, JSON_TYPE_INT, "d", &n)) < 0){
+        TRACE(ERROR, "Failed to set value in document");
+        status = 0;
+    }
+    json_doc_del(json);
+
+    if(copy){
+        if((json_val(json_get(copy, "c"), &n, sizeof(n))) < 0 || (n != 7) || (json_size(copy) != 2)){
+            TRACE(ERROR, "Wrong value in clone");
+            status = 0;
+        }
+        json_del(copy);
+    }
+    return status;
+}
+
+static int test_insitu(void)
+{
+    int status = 1;
+    int err;
+    char str[32];
+    struct json *json = NULL;
+    struct json_opts opts = {0};
+    const char input[] = "{\"k\\\"ey\":\"a\\\\b\\n\\u00e9\\ud83d\\ude00\",\"plain\":\"xyz\",\"n\":[\"q\"]}";
+    const char decoded[] = "a\\b\n\xc3\xa9\xf0\x9f\x98\x80";
+    char buffer[sizeof(input)];
+    char *end = buffer + sizeof(input) - 1;
+    char bad[] = "{\"a\":\"\\x\"}";
+
+    /* Default mode copies strings and leaves input untouched */
+    memcpy(buffer, input, sizeof(input));
+    if(!(json = json_loads(buffer, end, &err)) || memcmp(buffer, input, sizeof(input))){
+        TRACE(ERROR, "Default parse modified input : %s", json_sterror(err));
+        status = 0;
+    } else if((json_val(json_get(json, "k\"ey"), str, sizeof(str)) != sizeof(decoded)) || memcmp(str, decoded, sizeof(decoded))){
+        TRACE(ERROR, "Wrong decoded value");
+        status = 0;
+    }
+    if(json)
+        json_del(json);
+
+    /* In situ mode decodes inside the buffer, closing quote becomes null */
+    opts.flags = JSON_OPT_INSITU;
+    if(!(json = json_loads_opts(buffer, end, &opts, &err))){
+        TRACE(ERROR, "Failed to parse in situ : %s", json_sterror(err));
+        return 0;
+    }
+    if((json_val(json_get(json, "k\"ey"), str, sizeof(str)) != sizeof(decoded)) || memcmp(str, decoded, sizeof(decoded))){
+        TRACE(ERROR, "Wrong decoded value in situ");
+        status = 0;
+    }
+    if((json_val(json_get(json, "plain"), str, sizeof(str)) != 4) || strcmp(str, "xyz") || buffer[strstr(input, "xyz") - input + 3]){
+        TRACE(ERROR, "Wrong plain value in situ");
+        status = 0;
+    }
+    json_del(json);
+
+    if((json = json_loads_opts(bad, bad + sizeof(bad) - 1, &opts, &err))){
+        TRACE(ERROR, "Invalid escape accepted");
+        json_del(json);
+        status = 0;
+    }
+    return status;
+}
+
+/* Read only input, writing it would fault */
+static int test_const(void)
+{
+    int status = 1;
+    int err, i;
+    char str[32];
+    char *page = NULL;
+    struct json *json = NULL;
+    struct json_opts opts = {0};
+    const char input[] = "{\"k\\\"ey\":\"a\\\\b\\n\\u00e9\\ud83d\\ude00\",\"plain\":\"xyz\",\"n\":[\"q\", 1.5]}";
+    const char decoded[] = "a\\b\n\xc3\xa9\xf0\x9f\x98\x80";
+    size_t size = sysconf(_SC_PAGESIZE);
+
+    if((page = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED){
+        TRACE(ERROR, "Failed to map page");
+        return 0;
+    }
+    /* Input ends at end of page, in situ flag is ignored */
+    memcpy(page + size - sizeof(input) + 1, input, sizeof(input) - 1);
+    mprotect(page, size, PROT_READ);
+    for(i = 0; i < 4; i++){
+        opts.flags = JSON_OPT_INSITU | ((i & 1) ? JSON_OPT_ARENA : 0);
+        if(!(json = json_loads_const((i & 2) ? input : page + size - sizeof(input) + 1,
+                                     (i & 2) ? input + sizeof(input) - 1 : page + size, &opts, &err))){
+            TRACE(ERROR, "Failed to parse read only buffer : %s", json_sterror(err));
+            status = 0;
+            continue;
+        }
+        if((json_val(json_get(json, "k\"ey"), str, sizeof(str)) != sizeof(decoded)) || memcmp(str, decoded, sizeof(decoded)) ||
+           (json_val(json_get(json, "plain"), str, sizeof(str)) != 4) || strcmp(str, "xyz")){
+            TRACE(ERROR, "Wrong value from read only buffer");
+            status = 0;
+        }
+        if(i & 1)
+            json_doc_del(json);
+        else
+            json_del(json);
+    }
+    munmap(page, size);
+    return status;
+}
+
+/* Escapes at every position around vector boundaries */
+static int test_long_str(void)
+{
+    int status = 1;
+    int err, pos, i, len;
+    char buffer[256];
+    char value[128];
+    char expected[128];
+    struct json *json = NULL;
+
+    for(pos = 0; pos < 80; pos++){
+        len = sprintf(buffer, "{\"s\":\"");
+        for(i = 0; i < 90; i++){
+            if(i == pos){
+                len += sprintf(buffer + len, "\\u00e9\\\"");
+                expected[i] = '@';
+            } else {
+                buffer[len++] = 'a' + (i % 26);
+                expected[i] = 'a' + (i % 26);
+            }
+        }
+        len += sprintf(buffer + len, "\"}");
+        memcpy(expected + pos, "\xc3\xa9\"", 3);
+        for(i = pos + 1; i < 90; i++){
+            expected[i + 2] = 'a' + (i % 26);
+        }
+        expected[92] = '\0';
+
+        if(!(json = json_loads(buffer, buffer + len, &err))){
+            TRACE(ERROR, "Failed to parse escape at %d : %s", pos, json_sterror(err));
+            return 0;
+        }
+        if((json_val(json_get(json, "s"), value, sizeof(value)) != 93) || strcmp(value, expected)){
+            TRACE(ERROR, "Wrong value for escape at %d", pos);
+            status = 0;
+        }
+        json_del(json);
+    }
+
+    /* Raw control characters are not allowed, line breaks are */
+    len = sprintf(buffer, "[\"a\x01b\"]");
+    if((json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Control character accepted");
+        json_del(json);
+        status = 0;
+    }
+    len = sprintf(buffer, "[\"a\nb\"]");
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Line break rejected");
+        status = 0;
+    } else {
+        json_del(json);
+    }
+    return status;
+}
+
+/*
+* @brief Random UTF-8 string with characters which need escaping
+* @param buffer Placeholder for string
+* @param size Size of buffer
+*/
+static void random_utf8(char *buffer, int size)
+{
+    static const char *pieces[] = {
+        "a", "Z", " ", "\"", "\\", "/", "\n", "\t", "\b", "\x01", "\x1f", "\x7f",
+        "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "plain run of text ",
+        "0123456789abcdef0123456789abcdef",
+    };
+    int len = 0, n, piece;
+
+    for(n = random() % size; ; len += strlen(pieces[piece])){
+        piece = random() % (sizeof(pieces)/sizeof(pieces[0]));
+        if(len + strlen(pieces[piece]) >= n)
+            break;
+        strcpy(buffer + len, pieces[piece]);
+    }
+    buffer[len] = 0;
+}
+
+static int test_print_escape(void)
+{
+    struct {
+        const char *str;
+        const char *ascii;
+    } cases[] = {
+        {"\"\\/\b\f\n\r\t\x01\x1f", "\"\\\"\\\\/\\b\\f\\n\\r\\t\\u0001\\u001f\""},
+        {"caf\xc3\xa9 \xe2\x82\xac", "\"caf\\u00e9 \\u20ac\""},
+        {"\xf0\x9f\x98\x80!", "\"\\ud83d\\ude00!\""},
+        /* Invalid byte, truncated sequence, overlong form and encoded surrogate */
+        {"\xff|\xe2\x82|\xc0\xaf|\xed\xa0\x80", "\"\\ufffd|\\ufffd\\ufffd|\\ufffd\\ufffd|\\ufffd\\ufffd\\ufffd\""},
+    };
+    char key[256], val[256], buffer[512];
+    char *str = NULL, *ref = NULL;
+    struct json *json = NULL, *back = NULL;
+    unsigned int flags;
+    int status = 1;
+    int len, i, k, err;
+
+    for(i = 0; i < sizeof(cases)/sizeof(cases[0]); i++){
+        json = json_new();
+        json_set(json, JSON_TYPE_STR, "k", (char*)cases[i].str);
+        snprintf(buffer, sizeof(buffer), "{\"k\":%s}", cases[i].ascii);
+        if(!(str = json_str(json, &len, JSON_PRINT_ASCII)) || strcmp(str, buffer)){
+            TRACE(ERROR, "Wrong ASCII output %s", str ? str : "");
+            status = 0;
+        }
+        free(str);
+        json_del(json);
+    }
+
+    for(i = 0; i < 2000; i++){
+        random_utf8(key, sizeof(key));
+        random_utf8(val, sizeof(val));
+        json = json_new();
+        json_set(json, JSON_TYPE_STR, key, val);
+        for(flags = 0; flags <= JSON_PRINT_ASCII; flags += JSON_PRINT_ASCII){
+            /* Every scan level gives same output */
+            scan_set_level(SCAN_SCALAR);
+            ref = json_str(json, &len, flags);
+            scan_set_level(-1);
+            str = json_str(json, &len, flags);
+            if(!ref || !str || strcmp(ref, str)){
+                TRACE(ERROR, "Output differs from scalar scan");
+                status = 0;
+            } else {
+                for(k = 0; k < len; k++){
+                    if(((unsigned char)str[k] < 0x20) || ((flags & JSON_PRINT_ASCII) && ((unsigned char)str[k] >= 0x80))){
+                        TRACE(ERROR, "Character %02x is not escaped", (unsigned char)str[k]);
+                        status = 0;
+                        break;
+                    }
+                }
+                /* Parses back to same key and value */
+                if(!(back = json_loads(str, str + len, &err)) ||
+                   (json_val(json_get(back, key), buffer, sizeof(buffer)) < 0) || strcmp(buffer, val)){
+                    TRACE(ERROR, "Escaped string does not parse back : %s", str);
+                    status = 0;
+                }
+                json_del(back);
+                back = NULL;
+            }
+            free(ref);
+            free(str);
+        }
+        json_del(json);
+    }
+    return status;
+}
+
+static int test_print_int(void)
+{
+    const char *hex[] = {"0x0", "0x7", "0xf", "0x10", "0xabcdef", "0x12345678", "0xffffffff"};
+    const char *octal[] = {"00", "07", "010", "0777", "012345670123", "037777777777"};
+    char buffer[128], expected[128];
+    char *str = NULL;
+    struct json *json = NULL;
+    long long val, p = 1;
+    int status = 1;
+    int err, len, i, k;
+
+    /* Around every number of digits, and LLONG_MAX at last */
+    for(i = 0; i < 20; i++){
+        for(k = -1; k <= 1; k++){
+            val = p + k;
+            len = snprintf(buffer, sizeof(buffer), "{\"a\":%lld,\"b\":%lld}", val, -val);
+            if(!(json = json_loads(buffer, buffer + len, &err)) || !(str = json_str(json, &len, 0)) || strcmp(str, buffer)){
+                TRACE(ERROR, "Wrong output for %s : %s", buffer, str ? str : "");
+                status = 0;
+            }
+            free(str);
+            str = NULL;
+            json_del(json);
+        }
+        p = (p < LLONG_MAX / 10) ? p * 10 : LLONG_MAX - 1;
+    }
+    len = snprintf(buffer, sizeof(buffer), "{\"a\":%lld}", LLONG_MIN);
+    if(!(json = json_loads(buffer, buffer + len, &err)) || !(str = json_str(json, &len, 0)) || strcmp(str, buffer)){
+        TRACE(ERROR, "Wrong output for %s : %s", buffer, str ? str : "");
+        status = 0;
+    }
+    free(str);
+    str = NULL;
+    json_del(json);
+
+    for(i = 0; i < sizeof(hex)/sizeof(hex[0]) + sizeof(octal)/sizeof(octal[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"a\":%s}", (i < sizeof(hex)/sizeof(hex[0])) ? hex[i] : octal[i - sizeof(hex)/sizeof(hex[0])]);
+        strcpy(expected, buffer);
+        if(!(json = json_loads(buffer, buffer + len, &err)) || !(str = json_str(json, &len, 0)) || strcmp(str, expected)){
+            TRACE(ERROR, "Wrong output for %s : %s", expected, str ? str : "");
+            status = 0;
+        }
+        free(str);
+        str = NULL;
+        json_del(json);
+    }
+    return status;
+}
+
+static int test_print_double(void)
+{
+    int status = 1;
+    int err, len, i;
+    double d = 0, back = 0;
+    char buffer[128], expected[128];
+    char *str = NULL;
+    struct json *json = NULL;
+    struct {
+        const char *str;
+        const char *printed;
+    } cases[] = {
+        {"0.1", "0.1"},
+        {"0.3", "0.3"},
+        {"2.5", "2.5"},
+        {"-0.0", "-0.0"},
+        {"100.0", "100.0"},
+        {"1e15", "1000000000000000.0"},
+        {"1e16", "1e+16"},
+        {"0.0001", "0.0001"},
+        {"0.00001", "1e-05"},
+        {"123456.789e3", "123456789.0"},
+        {"5e-324", "5e-324"},
+        {"2.2250738585072014e-308", "2.2250738585072014e-308"},
+        {"1.7976931348623157e308", "1.7976931348623157e+308"},
+        {"9007199254740993.0", "9007199254740992.0"},
+        {"0.1000000000000000055511151231257827021181583404541015625", "0.1"},
+        {"1.2345678901234568e-5", "1.2345678901234568e-05"},
+    };
+
+    for(i = 0; i < sizeof(cases)/sizeof(cases[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%s}", cases[i].str);
+        snprintf(expected, sizeof(expected), "{\"v\":%s}", cases[i].printed);
+        if(!(json = json_loads(buffer, buffer + len, &err)) || !(str = json_str(json, &len, 0)) || strcmp(str, expected)){
+            TRACE(ERROR, "Wrong output for %s : %s", cases[i].str, str ? str : "");
+            status = 0;
+        }
+        free(str);
+        str = NULL;
+        json_del(json);
+    }
+
+    /* Shortest output parses back to same double */
+    for(i = 0; i < 100000; i++){
+        uint64_t bits = ((uint64_t)random() << 33) ^ ((uint64_t)random() << 11) ^ random();
+        memcpy(&d, &bits, sizeof(d));
+        if(!isfinite(d))
+            continue;
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%.17e}", d);
+        if(!(json = json_loads(buffer, buffer + len, &err)) || !(str = json_str(json, &len, 0))){
+            TRACE(ERROR, "Failed to print %s", buffer);
+            status = 0;
+        } else {
+            json_del(json);
+            if(!(json = json_loads(str, str + len, &err)) || (json_type(json_get(json, "v")) != JSON_TYPE_DOUBLE) ||
+               (json_val(json_get(json, "v"), &back, sizeof(back)) < 0) || memcmp(&back, &d, sizeof(d)) || (len > 5 + 24 + 1)){
+                TRACE(ERROR, "%s does not parse back to %.17g", str, d);
+                status = 0;
+            }
+        }
+        free(str);
+        str = NULL;
+        json_del(json);
+        json = NULL;
+    }
+    return status;
+}
+
+static int test_float(void)
+{
+    int status = 1;
+    int err, len, i;
+    double d = 0;
+    char buffer[128];
+    struct json *json = NULL;
+    struct {
+        const char *str;
+        double val;
+    } valid[] = {
+        {"0.1", 0.1},
+        {"-1.5e3", -1500.0},
+        {"1e-7", 1e-7},
+        {"1E+22", 1e22},
+        {".5", 0.5},
+        {"2.5f", 2.5},
+        {"123456789012345678901234567890.0", 1.2345678901234568e29},
+        {"0.1000000000000000055511151231257827021181583404541015625", 0.1},
+        {"9007199254740993.0", 9007199254740992.0},
+        {"2.2250738585072014e-308", 2.2250738585072014e-308},
+        {"4.9406564584124654e-324", 4.9406564584124654e-324},
+        {"1.7976931348623157e308", 1.7976931348623157e308},
+        {"1e-400", 0.0},
+        {"0e5", 0.0},
+    };
+    const char *invalid[] = {"1.", "1e", "1e+", "-.e1"};
+
+    for(i = 0; i < sizeof(valid)/sizeof(valid[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%s}", valid[i].str);
+        if(!(json = json_loads(buffer, buffer + len, &err))){
+            TRACE(ERROR, "Failed to parse %s : %s", valid[i].str, json_sterror(err));
+            status = 0;
+            continue;
+        }
+        if((json_type(json_get(json, "v")) != JSON_TYPE_DOUBLE) ||
+           (json_val(json_get(json, "v"), &d, sizeof(d)) < 0) || (d != valid[i].val)){
+            TRACE(ERROR, "Wrong value for %s : %.17g", valid[i].str, d);
+            status = 0;
+        }
+        json_del(json);
+    }
+    for(i = 0; i < sizeof(invalid)/sizeof(invalid[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%s}", invalid[i]);
+        if((json = json_loads(buffer, buffer + len, &err))){
+            TRACE(ERROR, "Invalid number %s accepted", invalid[i]);
+            json_del(json);
+            status = 0;
+        }
+    }
+    return status;
+}
+
+static int test_int(void)
+{
+    int status = 1;
+    int err, len, i;
+    char buffer[128];
+    union {
+        long l;
+        unsigned int u;
+        double d;
+    } num;
+    struct json *json = NULL;
+    struct {
+        const char *str;
+        int type;
+        long l;
+        double d;
+    } valid[] = {
+        {"1700000000123", JSON_TYPE_INT, 1700000000123L, 0},
+        {"-12345678", JSON_TYPE_INT, -12345678L, 0},
+        {"9223372036854775807", JSON_TYPE_INT, 9223372036854775807L, 0},
+        {"-9223372036854775808", JSON_TYPE_INT, -9223372036854775807L - 1, 0},
+        {"9223372036854775808", JSON_TYPE_DOUBLE, 0, 9223372036854775808.0},
+        {"18446744073709551615u", JSON_TYPE_UINT, -1L, 0},
+        {"18446744073709551616u", JSON_TYPE_DOUBLE, 0, 18446744073709551616.0},
+        {"123456789012345678901234567890", JSON_TYPE_DOUBLE, 0, 1.2345678901234568e29},
+        {"0xFFFFFFFF", JSON_TYPE_HEX, 0xFFFFFFFF, 0},
+        {"0x0000000000aBc", JSON_TYPE_HEX, 0xABC, 0},
+        {"037777777777", JSON_TYPE_OCTAL, 037777777777, 0},
+    };
+    const char *overflow[] = {"0x100000000", "040000000000", "0x10000000000000000"};
+
+    for(i = 0; i < sizeof(valid)/sizeof(valid[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%s}", valid[i].str);
+        if(!(json = json_loads(buffer, buffer + len, &err))){
+            TRACE(ERROR, "Failed to parse %s : %s", valid[i].str, json_sterror(err));
+            status = 0;
+            continue;
+        }
+        num.l = 0;
+        if((json_type(json_get(json, "v")) != valid[i].type) || (json_val(json_get(json, "v"), &num, sizeof(num)) < 0) ||
+           ((valid[i].type == JSON_TYPE_DOUBLE) && (num.d != valid[i].d)) ||
+           (((valid[i].type == JSON_TYPE_INT) || (valid[i].type == JSON_TYPE_UINT)) && (num.l != valid[i].l)) ||
+           (((valid[i].type == JSON_TYPE_HEX) || (valid[i].type == JSON_TYPE_OCTAL)) && (num.u != valid[i].l))){
+            TRACE(ERROR, "Wrong value for %s", valid[i].str);
+            status = 0;
+        }
+        json_del(json);
+    }
+    for(i = 0; i < sizeof(overflow)/sizeof(overflow[0]); i++){
+        len = snprintf(buffer, sizeof(buffer), "{\"v\":%s}", overflow[i]);
+        if((json = json_loads(buffer, buffer + len, &err)) || (err != -JSON_ERR_OVERFLOW)){
+            TRACE(ERROR, "Overflow not detected for %s", overflow[i]);
+            if(json)
+                json_del(json);
+            status = 0;
+        }
+    }
+    return status;
+}
+
+/* Nested lists with json object at every other level */
+static char* nested(int depth, int *len)
+{
+    char *buffer = malloc(depth * 6 + 2);
+    int i, n = 0;
+    for(i = 0; i < depth; i++)
+        n += sprintf(buffer + n, (i & 1) ? "{\"a\":" : "[");
+    buffer[n++] = '1';
+    for(i = depth - 1; i >= 0; i--)
+        buffer[n++] = (i & 1) ? '}' : ']';
+    buffer[n] = '\0';
+    *len = n;
+    return buffer;
+}
+
+static int test_depth(void)
+{
+    int status = 1;
+    int err, len;
+    char *buffer = NULL;
+    struct json *json = NULL;
+    struct json_opts opts = {0};
+    char small[] = "{\"a\":{\"b\":1}}";
+    char deep[] = "{\"a\":{\"b\":[]}}";
+    char broken[] = "[[[{\"a\":[1,2}]]]";
+
+    /* Default limit */
+    buffer = nested(JSON_DEPTH_MAX, &len);
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Failed to parse %d levels : %s", JSON_DEPTH_MAX, json_sterror(err));
+        status = 0;
+    }
+    json_del(json);
+    free(buffer);
+    buffer = nested(JSON_DEPTH_MAX + 1, &len);
+    if((json = json_loads(buffer, buffer + len, &err)) || (err != -JSON_ERR_DEPTH)){
+        TRACE(ERROR, "Depth limit not detected");
+        json_del(json);
+        status = 0;
+    }
+    free(buffer);
+
+    /* Stack grows for configured limit, arena document is deleted without recursion */
+    opts.flags = JSON_OPT_ARENA;
+    opts.max_depth = 200000;
+    buffer = nested(100000, &len);
+    if(!(json = json_loads_opts(buffer, buffer + len, &opts, &err))){
+        TRACE(ERROR, "Failed to parse 100000 levels : %s", json_sterror(err));
+        status = 0;
+    }
+    json_doc_del(json);
+    free(buffer);
+
+    opts.max_depth = 2;
+    if(!(json = json_loads_opts(small, small + strlen(small), &opts, &err))){
+        TRACE(ERROR, "Failed to parse 2 levels");
+        status = 0;
+    }
+    json_doc_del(json);
+    if((json = json_loads_opts(deep, deep + strlen(deep), &opts, &err)) || (err != -JSON_ERR_DEPTH)){
+        TRACE(ERROR, "Depth limit 2 not detected");
+        json_doc_del(json);
+        status = 0;
+    }
+
+    /* Containers left open are released on failure */
+    if((json = json_loads(broken, broken + strlen(broken), &err)) || (err != -JSON_ERR_PARSE)){
+        TRACE(ERROR, "Broken nesting not detected");
+        json_del(json);
+        status = 0;
+    }
+    return status;
+}
+
+/* Compare values of two documents, including order of members */
+static int json_equal(struct json *j1, struct json *j2)
+{
+    struct iter *i1 = NULL, *i2 = NULL;
+    void *d1 = NULL, *d2 = NULL;
+    char *v1 = NULL, *v2 = NULL;
+    size_t size = 0;
+    int type = json_type(j1);
+    int equal = (type == json_type(j2));
+
+    if(equal && ((type == JSON_TYPE_DICT) || (type == JSON_TYPE_LIST))){
+        i1 = json_iter(j1);
+        i2 = json_iter(j2);
+        equal = i1 && i2 && (iter_size(i1) == iter_size(i2));
+        while(equal && (d1 = iter_next(i1))){
+            if(!(d2 = iter_next(i2)))
+                equal = 0;
+            else if(type == JSON_TYPE_DICT)
+                equal = !strcmp(d1, d2) && json_equal(json_get(j1, d1), json_get(j2, d2));
+            else
+                equal = json_equal(d1, d2);
+        }
+        if(i1)
+            iter_del(i1);
+        if(i2)
+            iter_del(i2);
+    } else if(equal && ((size = json_size(j1)) == json_size(j2)) && size){
+        v1 = malloc(size);
+        v2 = malloc(size);
+        equal = (json_val(j1, v1, size) == json_val(j2, v2, size)) && !memcmp(v1, v2, size);
+        free(v1);
+        free(v2);
+    }
+    return equal;
+}
+
+/* Parse buffer with both parsers, result and error must be same */
+/*
+* @brief Write data to a file
+* @param fname filename
+* @param data data to write
+* @param len length of data
+* @return 1 if all data is written
+*/
+static int write_file(const char *fname, const char *data, size_t len)
+{
+    int ok = 0;
+    int fd;
+
+    if((fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0){
+        ok = (write(fd, data, len) == (ssize_t)len);
+        close(fd);
+    }
+    return ok;
+}
+
+static int test_load_file(void)
+{
+    char fname[] = "/tmp/json_test_XXXXXX";
+    char fifo[sizeof(fname) + 5];
+    char *data = NULL;
+    struct json *json = NULL;
+    struct json *expect = NULL;
+    pid_t pid;
+    size_t len = 2 * 4096;
+    int status = 1;
+    int fd, err;
+
+    if((fd = mkstemp(fname)) < 0){
+        TRACE(ERROR, "Failed to create file");
+        return 0;
+    }
+    close(fd);
+    /* Document ends exactly at page boundary of mapping */
+    data = malloc(len);
+    memset(data, ' ', len);
+    memcpy(data, "{\"a\":[1,2.5,\"x\"],\"b\":", 21);
+    memcpy(data + len - 5, "true}", 5);
+    if(!write_file(fname, data, len) || !(json = json_load(fname, &err))){
+        TRACE(ERROR, "Failed to load page sized file");
+        status = 0;
+    } else if(!(expect = json_loads(data, data + len, &err)) || !json_equal(json, expect)){
+        TRACE(ERROR, "Page sized file loaded wrong");
+        status = 0;
+    }
+    json_del(json);
+
+    /* Document without closing bracket at page boundary */
+    data[len - 1] = ' ';
+    if(!write_file(fname, data, len) || (json = json_load(fname, &err))){
+        TRACE(ERROR, "Unterminated file was loaded");
+        json_del(json);
+        status = 0;
+    }
+
+    /* Empty file */
+    if(!write_file(fname, data, 0) || (json = json_load(fname, &err)) || (err != -JSON_ERR_SYS)){
+        TRACE(ERROR, "Empty file was loaded");
+        json_del(json);
+        status = 0;
+    }
+    unlink(fname);
+
+    /* Pipe can not be mapped, it is read instead */
+    snprintf(fifo, sizeof(fifo), "%s.fifo", fname);
+    data[len - 1] = '}';
+    if(mkfifo(fifo, 0600)){
+        TRACE(ERROR, "Failed to create fifo");
+        json_del(expect);
+        free(data);
+        return 0;
+    }
+    if(!(pid = fork())){
+        _exit(write_file(fifo, data, len) ? 0 : 1);
+    }
+    if((pid < 0) || !(json = json_load(fifo, &err))){
+        TRACE(ERROR, "Failed to load from fifo");
+        status = 0;
+    } else if(!json_equal(json, expect)){
+        TRACE(ERROR, "Fifo loaded wrong");
+        status = 0;
+    }
+    json_del(json);
+    if(pid > 0)
+        waitpid(pid, NULL, 0);
+    unlink(fifo);
+    json_del(expect);
+    free(data);
+    return status;
+}
+
+static int check_index(const char *data, int len, const struct json_opts *opts)
+{
+    char *b1 = malloc(len + 1);
+    char *b2 = malloc(len + 1);
+    struct json *j1 = NULL, *j2 = NULL;
+    int err1 = 0, err2 = 0, status = 1;
+
+    /* Separate copies, in situ parsing modifies buffer */
+    memcpy(b1, data, len);
+    memcpy(b2, data, len);
+    j1 = json_loads_opts(b1, b1 + len, opts, &err1);
+    j2 = json_loads_index(b2, b2 + len, opts, &err2);
+    if((!j1 != !j2) || (err1 != err2) || (j1 && !json_equal(j1, j2))){
+        TRACE(ERROR, "Indexed parsing differs for %.*s : %s, %s", len, data, json_sterror(err1), json_sterror(err2));
+        status = 0;
+    }
+    json_del(j1);
+    json_del(j2);
+    free(b1);
+    free(b2);
+    return status;
+}
+
+static unsigned long test_rand_state = 88172645463325252UL;
+static unsigned long test_rand(void)
+{
+    test_rand_state ^= test_rand_state << 13;
+    test_rand_state ^= test_rand_state >> 7;
+    test_rand_state ^= test_rand_state << 17;
+    return test_rand_state;
+}
+
+/* Random document with strings, escapes and whitespace crossing 64 byte blocks */
+static int random_doc(char *buffer, int depth)
+{
+    static const char *scalars[] = {"1", "-0.5e3", "true", "false", "null", "0x1F", "017", "12u", "\"\"", "\"\\\\\"",
+                                    "\"a\\\"b\"", "\"\\u00e9\\n\"", "\"line\nbreak\"", "\"\xc3\xa9t\xc3\xa9\""};
+    static const char *ws[] = {"", " ", "\n\t", "                                                                "};
+    int n = 0, i, count = test_rand() % 5;
+    int dict = test_rand() & 1;
+
+    n += sprintf(buffer + n, "%s%s", dict ? "{" : "[", ws[test_rand() % 4]);
+    for(i = 0; i < count; i++){
+        if(i)
+            n += sprintf(buffer + n, ",%s", ws[test_rand() % 4]);
+        if(dict)
+            n += sprintf(buffer + n, "\"k%d%.*s\"%s:%s", i, (int)(test_rand() % 35) * 2,
+                         "\\\\xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", ws[test_rand() % 4], ws[test_rand() % 4]);
+        if(depth && !(test_rand() % 3))
+            n += random_doc(buffer + n, depth - 1);
+        else
+            n += sprintf(buffer + n, "%s%s", scalars[test_rand() % (sizeof(scalars)/sizeof(scalars[0]))], ws[test_rand() % 4]);
+    }
+    n += sprintf(buffer + n, "%s", dict ? "}" : "]");
+    return n;
+}
+
+static int test_index(void)
+{
+    static const char *docs[] = {
+        "{}", "[]", " [ 1 , 2 ] ", "{\"a\":{\"b\":[1,{\"c\":null}]}}", "[\"\\\\\",\"x\"]",
+        "[1 2]", "[1,]", "{\"a\":1,}", "{\"a\" 1}", "[\"a\"x]", "[truex]", "[1]x", "[1", "{\"a\":", "[\"abc",
+        "x[]", "[\"\x01\"]", "{\"a\":1,\"a\":2}", "[nulll]", "[0x100000000]", "[\"\\ud800\"]", "[1,2]]",
+        "{\"a\\\"b\":1}", "{\"a\":\"b\"\"c\":1}", "[[[[[]]]]]", "[\"\\\\\\\"\"]", "[-]", "[+1,.5]",
+    };
+    struct json_opts opts[] = {{0}, {.flags = JSON_OPT_ARENA}, {.flags = JSON_OPT_INSITU}, {.dup = JSON_DUP_LAST, .max_depth = 3}};
+    char *buffer = malloc(1 << 20);
+    int status = 1;
+    int i, o, n, len;
+    FILE *fp = NULL;
+
+    for(o = 0; o < sizeof(opts)/sizeof(opts[0]); o++){
+        for(i = 0; i < sizeof(docs)/sizeof(docs[0]); i++)
+            status &= check_index(docs[i], strlen(docs[i]), &opts[o]);
+    }
+    for(i = 0; i < sizeof(fname_success)/sizeof(char*); i++){
+        if((fp = fopen(fname_success[i], "r"))){
+            len = fread(buffer, 1, (1 << 20), fp);
+            fclose(fp);
+            status &= check_index(buffer, len, &opts[0]);
+        }
+    }
+    /* Documents larger than index window, with strings crossing windows */
+    for(o = 0; o < 3; o++){
+        len = sprintf(buffer, "[");
+        for(i = 0; len < 200000; i++){
+            if(!(i % 50)){
+                buffer[len++] = '"';
+                for(n = 0; n < 40000; n++){
+                    /* Escaped backslash, escape may cross window */
+                    if((n % 997) == o)
+                        buffer[len++] = '\\';
+                    buffer[len++] = (n % 997 == o) ? '\\' : 'x';
+                }
+                len += sprintf(buffer + len, "\",");
+            }
+            len += random_doc(buffer + len, 3);
+            buffer[len++] = ',';
+        }
+        buffer[len - 1] = ']';
+        status &= check_index(buffer, len, &opts[o]);
+    }
+
+    /* Random documents, also with a byte changed */
+    for(i = 0; i < 300; i++){
+        len = random_doc(buffer, 4);
+        status &= check_index(buffer, len, &opts[i % 3]);
+        n = test_rand() % len;
+        buffer[n] = "{}[]:,\"\\ xa1"[test_rand() % 13];
+        status &= check_index(buffer, len, &opts[i % 3]);
+    }
+    free(buffer);
+    return status;
+}
+
+/* Value at cursor and each of its members must be same as parsed document */
+static int check_cursor(struct json_cursor *cur, struct json *json)
+{
+    struct json_cursor child;
+    struct json *value = NULL;
+    struct iter *iter = NULL;
+    void *data = NULL;
+    int err = 0, status = 1;
+
+    if(!(value = json_cursor_json(cur, NULL, &err)) || !json_equal(value, json)){
+        TRACE(ERROR, "Cursor value differs : %s", json_sterror(err));
+        status = 0;
+    }
+    json_del(value);
+    if(status && (json_type(json) == JSON_TYPE_DICT)){
+        iter = json_iter(json);
+        while(status && (data = iter_next(iter))){
+            status = (json_cursor_get(cur, data, &child) == JSON_ERR_SUCCESS) && check_cursor(&child, json_get(json, data));
+        }
+        iter_del(iter);
+    } else if(status && (json_type(json) == JSON_TYPE_LIST)){
+        iter = json_iter(json);
+        err = json_cursor_index(cur, 0, &child);
+        while(status && (data = iter_next(iter))){
+            status = (err == JSON_ERR_SUCCESS) && check_cursor(&child, data);
+            err = json_cursor_next(&child);
+        }
+        status = status && (err == -JSON_ERR_KEY_NOT_FOUND);
+        iter_del(iter);
+    }
+    return status;
+}
+
+static int test_cursor(void)
+{
+    char data[] = " {\"a\" : [1, {\"x\":\"}]\\\"{[\"}, [ ]], \"b\\\"c\":{\"d\":\"e\"}, \"f\":2.5 ,\"g\":\"s\",\"h\":null} ";
+    struct json_opts arena = {.flags = JSON_OPT_ARENA};
+    struct json_cursor root, cur, child;
+    struct json *json = NULL;
+    char *buffer = malloc(1 << 16);
+    char str[8] = {0};
+    double val = 0;
+    int status = 1;
+    int err, i, len;
+
+    if((json_cursor(&root, data, data + strlen(data)) != JSON_ERR_SUCCESS) || (json_cursor_type(&root) != JSON_TYPE_DICT)){
+        TRACE(ERROR, "Failed to set cursor");
+        free(buffer);
+        return 0;
+    }
+    /* Scalar after other members */
+    if((json_cursor_get(&root, "f", &cur) != JSON_ERR_SUCCESS) || (json_cursor_type(&cur) != JSON_TYPE_DOUBLE) ||
+       !(json = json_cursor_json(&cur, NULL, &err)) || (json_val(json, &val, sizeof(val)) < 0) || (val != 2.5)){
+        TRACE(ERROR, "Failed to get f");
+        status = 0;
+    }
+    json_del(json);
+
+    /* Brackets and escaped quote inside string are skipped */
+    if((json_cursor_get(&root, "a", &cur) != JSON_ERR_SUCCESS) || (json_cursor_index(&cur, 1, &child) != JSON_ERR_SUCCESS) ||
+       (json_cursor_get(&child, "x", &child) != JSON_ERR_SUCCESS) || !(json = json_cursor_json(&child, &arena, &err)) ||
+       (json_val(json, str, sizeof(str)) < 0) || strcmp(str, "}]\"{[")){
+        TRACE(ERROR, "Failed to get a[1].x");
+        status = 0;
+    }
+    json_doc_del(json);
+    if((json_cursor_index(&cur, 3, &child) != -JSON_ERR_KEY_NOT_FOUND) || (json_cursor_get(&cur, "x", &child) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Missing member found");
+        status = 0;
+    }
+
+    /* Escaped key */
+    if((json_cursor_get(&root, "b\"c", &cur) != JSON_ERR_SUCCESS) || (json_cursor_get(&cur, "d", &child) != JSON_ERR_SUCCESS) ||
+       (json_cursor_type(&child) != JSON_TYPE_STR) || (json_cursor_get(&root, "b", &cur) != -JSON_ERR_KEY_NOT_FOUND)){
+        TRACE(ERROR, "Failed to find escaped key");
+        status = 0;
+    }
+
+    /* Members in order */
+    for(i = 0, err = json_cursor_index(&root, 0, &cur); err == JSON_ERR_SUCCESS; i++, err = json_cursor_next(&cur)){
+        if((cur.key[0] != "abfgh"[i]) || (cur.parent != JSON_TYPE_DICT))
+            break;
+    }
+    if((i != 5) || (err != -JSON_ERR_KEY_NOT_FOUND) || (json_cursor_next(&root) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Iteration stopped at %d : %s", i, json_sterror(err));
+        status = 0;
+    }
+
+    /* Skipped values only need balanced brackets, errors are found in values that are visited */
+    strcpy(buffer, "{\"a\":[1,{]}, \"b\":1x, \"c\":{\"d\":[1,}], \"e\":tru, \"f\":[1");
+    len = strlen(buffer);
+    json_cursor(&root, buffer, buffer + len);
+    for(i = 0; i < 4; i++){
+        str[0] = "abce"[i];
+        str[1] = '\0';
+        if((json_cursor_get(&root, str, &cur) != JSON_ERR_SUCCESS) || (json = json_cursor_json(&cur, NULL, &err))){
+            TRACE(ERROR, "Invalid value of %s not detected", str);
+            json_del(json);
+            status = 0;
+        }
+    }
+    if((json_cursor_get(&root, "z", &cur) != -JSON_ERR_PARSE) || (json_cursor(&root, buffer, buffer) != -JSON_ERR_PARSE)){
+        TRACE(ERROR, "Unclosed container not detected");
+        status = 0;
+    }
+
+    /* Random documents walked with cursor */
+    for(i = 0; i < 200; i++){
+        len = random_doc(buffer, 4);
+        if(!(json = json_loads(buffer, buffer + len, &err)))
+            continue;
+        if((json_cursor(&root, buffer, buffer + len) != JSON_ERR_SUCCESS) || !check_cursor(&root, json)){
+            TRACE(ERROR, "Cursor differs for %.*s", len, buffer);
+            status = 0;
+        }
+        json_del(json);
+    }
+    free(buffer);
+    return status;
+}
+
+/* Events recorded as text */
+struct sax_log
+{
+    char text[512];
+    int len;
+    int stop;           /* Fail on this event, 0 for never */
+    int count;
+};
+
+static int sax_log(struct sax_log *log, const char *fmt, const char *str, size_t len, long val)
+{
+    if(++log->count == log->stop)
+        return -JSON_ERR_KEY_NOT_FOUND;
+    log->len += snprintf(log->text + log->len, sizeof(log->text) - log->len, fmt, str ? (int)len : 0, str ? str : "", val);
+    return 0;
+}
+
+static int sax_start_object(void *ctx) { return sax_log(ctx, "{%.*s", NULL, 0, 0); }
+static int sax_end_object(void *ctx) { return sax_log(ctx, "}%.*s", NULL, 0, 0); }
+static int sax_start_list(void *ctx) { return sax_log(ctx, "[%.*s", NULL, 0, 0); }
+static int sax_end_list(void *ctx) { return sax_log(ctx, "]%.*s", NULL, 0, 0); }
+static int sax_key(void *ctx, const char *key, size_t len) { return sax_log(ctx, "k<%.*s>", key, len, 0); }
+static int sax_string(void *ctx, const char *str, size_t len) { return sax_log(ctx, "s<%.*s>", str, len, 0); }
+static int sax_integer(void *ctx, int type, long val) { return sax_log(ctx, (type == JSON_TYPE_INT) ? "i%.*s%ld " : "u%.*s%lu ", NULL, 0, val); }
+static int sax_double(void *ctx, double val) { return sax_log(ctx, "d%.*s%ld ", NULL, 0, (long)(val * 10)); }
+static int sax_boolean(void *ctx, int val) { return sax_log(ctx, "b%.*s%ld ", NULL, 0, val); }
+static int sax_null(void *ctx) { return sax_log(ctx, "n%.*s", NULL, 0, 0); }
+
+static const struct json_handler sax_handler = {
+    .start_object = sax_start_object, .end_object = sax_end_object,
+    .start_list = sax_start_list, .end_list = sax_end_list,
+    .key = sax_key, .string = sax_string, .integer = sax_integer,
+    .double_number = sax_double, .boolean = sax_boolean, .null = sax_null,
+};
+static const char sax_doc[] = " {\"a\":[1, -2, 3u, 0x1F, 2.5, true, false, null], \"b\\\"c\" : {\"d\":\"e\\nf\", \"g\":[]}, \"a\":\"\"} ";
+static const char sax_events[] = "{k<a>[i1 i-2 u3 u31 d25 b1 b0 n]k<b\"c>{k<d>s<e\nf>k<g>[]}k<a>s<>}";
+
+static int test_sax(void)
+{
+    static const struct json_handler keys_only = {.key = sax_key};
+    char broken[] = "[1,]";
+    char data[sizeof(sax_doc)];
+    struct json_opts opts = {.max_depth = 2};
+    struct sax_log log = {.len = 0};
+    int status = 1;
+    int err;
+
+    strcpy(data, sax_doc);
+    /* Repeated key is reported, it is not an error without document */
+    if(((err = json_sax(data, data + strlen(data), &sax_handler, &log, NULL)) != JSON_ERR_SUCCESS) || strcmp(log.text, sax_events)){
+        TRACE(ERROR, "Events differ : %s, %s", json_sterror(err), log.text);
+        status = 0;
+    }
+    memset(&log, 0, sizeof(log));
+    if((json_sax(data, data + strlen(data), &keys_only, &log, NULL) != JSON_ERR_SUCCESS) || strcmp(log.text, "k<a>k<b\"c>k<d>k<g>k<a>")){
+        TRACE(ERROR, "Key events differ : %s", log.text);
+        status = 0;
+    }
+
+    /* Callback stops parsing with its own error */
+    memset(&log, 0, sizeof(log));
+    log.stop = 5;
+    if((json_sax(data, data + strlen(data), &sax_handler, &log, NULL) != -JSON_ERR_KEY_NOT_FOUND) || (log.count != 5)){
+        TRACE(ERROR, "Callback error not returned");
+        status = 0;
+    }
+
+    /* Errors of parser */
+    memset(&log, 0, sizeof(log));
+    if((json_sax(data, data + strlen(data), &sax_handler, &log, &opts) != -JSON_ERR_DEPTH) ||
+       (json_sax(broken, broken + strlen(broken), &sax_handler, &log, NULL) != -JSON_ERR_PARSE) ||
+       (json_sax(data, data, &sax_handler, &log, NULL) != -JSON_ERR_PARSE) ||
+       (json_sax(data, data + 1, NULL, &log, NULL) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Parser error not returned");
+        status = 0;
+    }
+    return status;
+}
+
+/* Parse buffer at once and in chunks of given size, result and error must be same */
+static int check_stream(const char *data, int len, const struct json_opts *opts, int size)
+{
+    struct json_stream *js = json_stream_new(NULL, NULL, opts);
+    char *buffer = malloc(len + 1);
+    char *chunk = NULL;
+    struct json *j1 = NULL, *j2 = NULL;
+    int err1 = 0, err2 = 0, status = 1;
+    int i, n, ret = 0;
+
+    memcpy(buffer, data, len);
+    j1 = json_loads_opts(buffer, buffer + len, opts, &err1);
+    for(i = 0; (i < len) && (ret >= 0); i += n){
+        /* Chunk is released right after it is parsed */
+        n = (len - i < size) ? (len - i) : size;
+        chunk = malloc(n);
+        memcpy(chunk, data + i, n);
+        ret = json_stream_feed(js, chunk, n);
+        free(chunk);
+    }
+    j2 = json_stream_end(js, &err2);
+    if((!j1 != !j2) || (err1 != err2) || (j1 && !json_equal(j1, j2)) || ((ret == 1) != !!j2)){
+        TRACE(ERROR, "Chunks of %d differ for %.*s : %s, %s", size, len, data, json_sterror(err1), json_sterror(err2));
+        status = 0;
+    }
+    json_del(j1);
+    json_del(j2);
+    json_stream_del(js);
+    free(buffer);
+    return status;
+}
+
+static int test_stream(void)
+{
+    static const char *docs[] = {
+        "{}", "[]", " [ 1 , 2 ] ", "{\"a\":{\"b\":[1,{\"c\":null}]}}", "[\"\\\\\",\"x\"]", "[-12.5e3,0x1F,017,7u,TRUE]",
+        "[1 2]", "[1,]", "{\"a\":1,}", "{\"a\" 1}", "[\"a\"x]", "[truex]", "[1]x", "[1", "{\"a\":", "[\"abc",
+        "x[]", "[\"\x01\"]", "{\"a\":1,\"a\":2}", "[nulll]", "[0x100000000]", "[\"\\ud800\"]", "[1,2]]", "",
+        "{\"a\\\"b\":1}", "{\"a\":\"b\"\"c\":1}", "[[[[[]]]]]", "[\"\\\\\\\"\"]", "[-]", "[+1,.5]", "[1]  \n",
+    };
+    struct json_opts opts[] = {{0}, {.flags = JSON_OPT_ARENA}, {.flags = JSON_OPT_INSITU}, {.dup = JSON_DUP_LAST, .max_depth = 3}};
+    static const int sizes[] = {1, 2, 3, 7, 64, 1 << 20};
+    char *buffer = malloc(1 << 20);
+    struct json_stream *js = NULL;
+    struct sax_log log;
+    int status = 1;
+    int i, o, n, len;
+    FILE *fp = NULL;
+
+    for(o = 0; o < sizeof(opts)/sizeof(opts[0]); o++){
+        for(i = 0; i < sizeof(docs)/sizeof(docs[0]); i++){
+            for(n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+                status &= check_stream(docs[i], strlen(docs[i]), &opts[o], sizes[n]);
+        }
+    }
+    for(i = 0; i < sizeof(fname_success)/sizeof(char*); i++){
+        if((fp = fopen(fname_success[i], "r"))){
+            len = fread(buffer, 1, (1 << 20), fp);
+            fclose(fp);
+            for(n = 0; n < sizeof(sizes)/sizeof(sizes[0]); n++)
+                status &= check_stream(buffer, len, &opts[n % 2], sizes[n]);
+        }
+    }
+    for(i = 0; i < 300; i++){
+        len = random_doc(buffer, 4);
+        status &= check_stream(buffer, len, &opts[i % 4], 1 + test_rand() % 40);
+        buffer[test_rand() % len] = "{}[]:,\"\\ xa1"[test_rand() % 13];
+        status &= check_stream(buffer, len, &opts[i % 4], 1 + test_rand() % 40);
+    }
+
+    /* Complete document, then anything but whitespace is an error */
+    js = json_stream_new(NULL, NULL, NULL);
+    if((json_stream_feed(js, "[1", 2) != 0) || (json_stream_feed(js, "] ", 2) != 1) || (json_stream_feed(js, "\n", 1) != 1) ||
+       (json_stream_feed(js, " x", 2) != -JSON_ERR_PARSE) || (json_stream_feed(js, " ", 1) != -JSON_ERR_PARSE) ||
+       json_stream_end(js, &n) || (n != -JSON_ERR_PARSE)){
+        TRACE(ERROR, "Completion not signalled");
+        status = 0;
+    }
+    json_stream_del(js);
+
+    /* Same events from a byte at a time */
+    js = json_stream_new(&sax_handler, &log, NULL);
+    memset(&log, 0, sizeof(log));
+    for(i = 0, n = 0; (i < sizeof(sax_doc) - 1) && (n >= 0); i++)
+        n = json_stream_feed(js, sax_doc + i, 1);
+    if((n != 1) || json_stream_end(js, &n) || (n != JSON_ERR_SUCCESS) || strcmp(log.text, sax_events)){
+        TRACE(ERROR, "Events differ : %s", log.text);
+        status = 0;
+    }
+    json_stream_del(js);
+    free(buffer);
+    return status;
+}
+
+/*
+* @brief Compare parallel parse with serial parse
+* @param data json buffer
+* @param len length of buffer
+* @param opts Parser options
+* @param threads number of threads
+* @return 1 if results are same
+*/
+static int check_parallel(const char *data, size_t len, const struct json_opts *opts, unsigned int threads)
+{
+    struct json *json = NULL;
+    struct json *expect = NULL;
+    int err = 0, err_expect = 0;
+    int status = 1;
+
+    json = json_loads_parallel(data, data + len, opts, threads, &err);
+    expect = json_loads_const(data, data + len, opts, &err_expect);
+    if((!json != !expect) || (err != err_expect) || (json && !json_equal(json, expect))){
+        TRACE(ERROR, "Parallel parse differs, %s / %s", json_sterror(err), json_sterror(err_expect));
+        status = 0;
+    }
+    if(json)
+        json_del(json);
+    if(expect)
+        json_del(expect);
+    return status;
+}
+
+static int test_parallel(void)
+{
+    struct json_opts opts[] = {{0}, {.flags = JSON_OPT_ARENA}, {.dup = JSON_DUP_LAST, .max_depth = 3}};
+    unsigned int threads[] = {2, 3, 8};
+    size_t size = 3 << 19, len = 0, pos;
+    char *buffer = malloc(size + 64);
+    char saved;
+    int status = 1;
+    int o, t, i;
+
+    /* List larger than threshold, members cross split points */
+    len = sprintf(buffer, " [");
+    for(i = 0; len < size - (64 << 10); i++){
+        if(i)
+            len += sprintf(buffer + len, ",%s", (i % 3) ? "" : "\n ");
+        if(i % 5)
+            len += random_doc(buffer + len, 3);
+        else
+            len += sprintf(buffer + len, "%s", (i % 2) ? "\"a,]\\\"[\"" : "-12.5");
+    }
+    len += sprintf(buffer + len, "] \n");
+    for(o = 0; o < sizeof(opts)/sizeof(opts[0]); o++){
+        for(t = 0; t < sizeof(threads)/sizeof(threads[0]); t++)
+            status &= check_parallel(buffer, len, &opts[o], threads[t]);
+    }
+
+    /* Broken documents report same error as serial parse */
+    for(i = 0; (i < 24) && status; i++){
+        pos = test_rand() % len;
+        saved = buffer[pos];
+        buffer[pos] = "[]{},:\"x1 \\"[test_rand() % 12];
+        status &= check_parallel(buffer, len, &opts[i % 2], 4);
+        buffer[pos] = saved;
+    }
+    buffer[len] = 'x';
+    status &= check_parallel(buffer, len + 1, &opts[0], 4);
+    status &= check_parallel(buffer, len - 3, &opts[0], 4);
+    memcpy(buffer + len - 3, ",]", 2);
+    status &= check_parallel(buffer, len - 1, &opts[1], 4);
+
+    /* Object and small list are parsed serially */
+    buffer[1] = '{';
+    status &= check_parallel(buffer, len, &opts[0], 4);
+    status &= check_parallel("[1,2,[3]]", 9, &opts[0], 4);
+    free(buffer);
+    return status;
+}
+
+/*
+* @brief Read whole file from start
+* @param fd file descriptor
+* @param len Placeholder for length
+* @return buffer, freed by caller
+*/
+static char* read_fd(int fd, int *len)
+{
+    char *buffer = NULL;
+    off_t size = lseek(fd, 0, SEEK_END);
+
+    *len = 0;
+    lseek(fd, 0, SEEK_SET);
+    if((size >= 0) && (buffer = malloc(size + 1)))
+        *len = read(fd, buffer, size);
+    return buffer;
+}
+
+/*
+* @brief Print json to every sink and compare outputs
+* @param json json document
+* @param indent indentation
+* @return 1 if all outputs are same
+*/
+static int check_print(struct json *json, unsigned int indent)
+{
+    char fname[] = "/tmp/json_print_XXXXXX";
+    char *str = NULL, *buffer = NULL, *file = NULL;
+    int len = 0, n = 0, status = 1, fd;
+    FILE *fp = NULL;
+
+    if(!(str = json_str(json, &len, indent)) || (len != strlen(str))){
+        TRACE(ERROR, "Failed to print to string");
+        free(str);
+        return 0;
+    }
+    if((json_serialized_size(json, indent) != len) || (json_prints(json, NULL, 0, indent) != len) ||
+       !(file = json_str(json, &n, indent | JSON_PRINT_ASCII)) || (json_serialized_size(json, indent | JSON_PRINT_ASCII) != n)){
+        TRACE(ERROR, "Serialized size differs from output");
+        status = 0;
+    }
+    free(file);
+    file = NULL;
+    /* Buffer which fits exactly, then one byte short */
+    buffer = malloc(len + 1);
+    if((json_prints(json, buffer, len + 1, indent) != len) || strcmp(buffer, str)){
+        TRACE(ERROR, "Buffer output differs");
+        status = 0;
+    }
+    if((json_prints(json, buffer, len, indent) != -JSON_ERR_OVERFLOW) || (strlen(buffer) != len - 1) || strncmp(buffer, str, len - 1)){
+        TRACE(ERROR, "Short buffer not reported");
+        status = 0;
+    }
+    free(buffer);
+
+    if((fd = mkstemp(fname)) >= 0){
+        if(json_printfd(json, fd, indent) != len){
+            TRACE(ERROR, "Failed to print to fd");
+            status = 0;
+        } else if(!(file = read_fd(fd, &n)) || (n != len) || memcmp(file, str, len)){
+            TRACE(ERROR, "Fd output differs");
+            status = 0;
+        }
+        free(file);
+        close(fd);
+        unlink(fname);
+    }
+    if((fp = tmpfile())){
+        if(json_printfp(json, fp, indent) != len){
+            TRACE(ERROR, "Failed to print to stream");
+            status = 0;
+        }
+        fflush(fp);
+        if(!(file = read_fd(fileno(fp), &n)) || (n != len) || memcmp(file, str, len)){
+            TRACE(ERROR, "Stream output differs");
+            status = 0;
+        }
+        free(file);
+        fclose(fp);
+    }
+    free(str);
+    return status;
+}
+
+static int test_print(void)
+{
+    const char doc[] = "{\"a\":[1,-2,3.25,-0.0,0x1F,017,9223372036854775807,-9223372036854775808],"
+                       "\"b\":{\"c\":{\"d\":[{},[],{\"e\":null}]},\"f\":\"x\\ty\\u0001\\\"\\\\\xc3\xa9\"},\"g\":true,\"h\":false,\"k\":{}}";
+    const char compact[] = "{\"a\":[1,-2,3.25,-0.0,0x1f,017,9223372036854775807,-9223372036854775808],"
+                           "\"b\":{\"c\":{\"d\":[{},[],{\"e\":null}]},\"f\":\"x\\ty\\u0001\\\"\\\\\xc3\xa9\"},\"g\":true,\"h\":false,\"k\":{}}";
+    char *buffer = malloc(1 << 20);
+    char *str = NULL;
+    struct json *json = NULL;
+    int status = 1;
+    int i, n, len, err;
+
+    if(!(json = json_loads_const(doc, doc + sizeof(doc) - 1, NULL, &err)) || !(str = json_str(json, &len, 0)) || strcmp(str, compact)){
+        TRACE(ERROR, "Wrong output %s", str ? str : "");
+        status = 0;
+    }
+    free(str);
+    for(i = 0; i < 4; i++)
+        status &= check_print(json, i);
+    json_del(json);
+
+    /* Output larger than writer buffer */
+    len = sprintf(buffer, "[");
+    for(i = 0; i < 400; i++)
+        len += sprintf(buffer + len, "%s", i ? "," : "") + random_doc(buffer + len + (i ? 1 : 0), 3);
+    len += sprintf(buffer + len, "]");
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Failed to parse large document");
+        status = 0;
+    } else {
+        status &= check_print(json, 0);
+        status &= check_print(json, 2);
+        json_del(json);
+    }
+
+    /* Long strings and keys, more of them than one writev takes */
+    len = sprintf(buffer, "{");
+    for(i = 0; i < 300; i++){
+        len += sprintf(buffer + len, "%s\"%d", i ? "," : "", i);
+        memset(buffer + len, 'k', i * 3);
+        len += i * 3;
+        len += sprintf(buffer + len, "\":[\"");
+        for(n = 0; n < (i % 7) * 700; n++)
+            buffer[len++] = (n % 1000 == 999) ? '\n' : 'a' + (n % 26);
+        len += sprintf(buffer + len, "\",%d]", i);
+    }
+    len += sprintf(buffer + len, "}");
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Failed to parse document with long strings");
+        status = 0;
+    } else {
+        status &= check_print(json, 0);
+        status &= check_print(json, 2 | JSON_PRINT_ASCII);
+        json_del(json);
+    }
+    free(buffer);
+    return status;
+}
+
+/* Events of parser replayed to streaming writer */
+static int replay_start_object(void *ctx) { return json_write_start_object(ctx); }
+static int replay_end_object(void *ctx) { return json_write_end_object(ctx); }
+static int replay_start_list(void *ctx) { return json_write_start_list(ctx); }
+static int replay_end_list(void *ctx) { return json_write_end_list(ctx); }
+static int replay_key(void *ctx, const char *key, size_t len) { return json_write_key(ctx, key, len); }
+static int replay_string(void *ctx, const char *str, size_t len) { return json_write_str(ctx, str, len); }
+static int replay_double(void *ctx, double val) { return json_write_double(ctx, val); }
+static int replay_boolean(void *ctx, int val) { return json_write_bool(ctx, val); }
+static int replay_null(void *ctx) { return json_write_null(ctx); }
+static int replay_integer(void *ctx, int type, long val)
+{
+    /* Writer has no hex or octal values */
+    if(type == JSON_TYPE_INT)
+        return json_write_int(ctx, val);
+    return (type == JSON_TYPE_UINT) ? json_write_uint(ctx, (unsigned long)val) : -JSON_ERR_PARSE;
+}
+
+static const struct json_handler replay_handler = {
+    .start_object = replay_start_object, .end_object = replay_end_object,
+    .start_list = replay_start_list, .end_list = replay_end_list,
+    .key = replay_key, .string = replay_string, .integer = replay_integer,
+    .double_number = replay_double, .boolean = replay_boolean, .null = replay_null,
+};
+
+/*
+* @brief Write document with streaming writer and compare with printed document
+* @param doc json document
+* @param len length of document
+* @param indent indentation
+* @return 1 if outputs are same or document has hex or octal values
+*/
+static int check_writer(const char *doc, int len, unsigned int indent)
+{
+    struct json_writer *jw = json_writer_new(NULL, 0, indent);
+    struct json *json = NULL;
+    char *buffer = malloc(len + 1);
+    char *str = NULL, *expect = NULL;
+    int n = 0, err, ret, status = 1;
+
+    memcpy(buffer, doc, len);
+    if(!(json = json_loads(buffer, buffer + len, &err))){
+        TRACE(ERROR, "Failed to parse %.*s", len, doc);
+        status = 0;
+    } else if(!(expect = json_str(json, &n, indent))){
+        status = 0;
+    } else if((ret = json_sax(buffer, buffer + len, &replay_handler, jw, NULL)) != -JSON_ERR_PARSE){
+        if((ret < 0) || !(str = json_writer_str(jw, &ret)) || (ret != n) || strcmp(str, expect)){
+            TRACE(ERROR, "Writer output differs for indent %x : %s, %s", indent, str ? str : json_sterror(ret), expect);
+            status = 0;
+        }
+    }
+    free(str);
+    free(expect);
+    free(buffer);
+    json_del(json);
+    json_writer_del(jw);
+    return status;
+}
+
+static int test_writer(void)
+{
+    static const char *docs[] = {
+        "{}", "[]", "[[],{}]", "{\"a\":{\"b\":[{\"c\":1},[{\"x\":{}}],{}],\"e\":[]},\"f\":2}", "[{\"a\":{\"b\":1}},[{\"c\":2}]]",
+        "{\"a\":[1,-2,3.25,-0.0,12u,9223372036854775807,-9223372036854775808,1e300,5e-324],\"b\":\"x\\ty\\u0001\\\"\\\\\xc3\xa9\"}",
+        "[true,false,null,\"\",{\"\":\"\"}]",
+    };
+    unsigned int indents[] = {0, 1, 2, 4, 2 | JSON_PRINT_ASCII};
+    char *buffer = malloc(1 << 16);
+    char small[8];
+    struct json_writer *jw = NULL;
+    int status = 1;
+    int i, j, fd, len, n = 0;
+    FILE *fp = NULL;
+
+    for(i = 0; i < sizeof(docs)/sizeof(docs[0]); i++){
+        for(j = 0; j < sizeof(indents)/sizeof(indents[0]); j++)
+            status &= check_writer(docs[i], strlen(docs[i]), indents[j]);
+    }
+    for(i = 0; i < 200; i++){
+        len = random_doc(buffer, 4);
+        status &= check_writer(buffer, len, indents[i % 5]);
+    }
+
+    /* Nesting is checked, first misuse is kept */
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_int(jw, 1) != -JSON_ERR_ARGS) || (json_write_start_list(jw) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Value outside of document not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_start_object(jw) != JSON_ERR_SUCCESS) || (json_write_int(jw, 1) != -JSON_ERR_ARGS) ||
+       (json_writer_end(jw) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Value without key not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_start_list(jw) != JSON_ERR_SUCCESS) || (json_write_key(jw, "a", 1) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Key in list not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_start_object(jw) != JSON_ERR_SUCCESS) || (json_write_key(jw, "a", 1) != JSON_ERR_SUCCESS) ||
+       (json_write_end_object(jw) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Key without value not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_start_list(jw) != JSON_ERR_SUCCESS) || (json_write_end_object(jw) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Unbalanced end not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    if((json_write_start_list(jw) != JSON_ERR_SUCCESS) || (json_write_end_list(jw) != JSON_ERR_SUCCESS) ||
+       (json_write_start_list(jw) != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Second document not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(NULL, 0, 0);
+    for(i = 0; (i < JSON_DEPTH_MAX) && (json_write_start_list(jw) == JSON_ERR_SUCCESS); i++);
+    if((i != JSON_DEPTH_MAX) || (json_write_start_list(jw) != -JSON_ERR_DEPTH) || (json_write_end_list(jw) != -JSON_ERR_DEPTH)){
+        TRACE(ERROR, "Depth limit not detected");
+        status = 0;
+    }
+    json_writer_del(jw);
+
+    /* Buffer of caller, fd and stream */
+    jw = json_writer_new(small, sizeof(small), 0);
+    json_write_start_list(jw);
+    json_write_int(jw, 12345);
+    json_write_end_list(jw);
+    if((json_writer_end(jw) != 7) || strcmp(small, "[12345]") || json_writer_str(jw, &n) || (n != -JSON_ERR_ARGS)){
+        TRACE(ERROR, "Buffer output differs : %s", small);
+        status = 0;
+    }
+    json_writer_del(jw);
+    jw = json_writer_new(small, sizeof(small), 0);
+    json_write_start_list(jw);
+    if((json_write_uint(jw, 1234567) != -JSON_ERR_OVERFLOW) || (json_write_end_list(jw) != -JSON_ERR_OVERFLOW) ||
+       (json_writer_end(jw) != -JSON_ERR_OVERFLOW) || strcmp(small, "[123456")){
+        TRACE(ERROR, "Short buffer not reported : %s", small);
+        status = 0;
+    }
+    json_writer_del(jw);
+    if((fp = tmpfile())){
+        fd = dup(fileno(fp));
+        jw = json_writer_fd(fd, 2);
+        json_write_start_object(jw);
+        json_write_key(jw, "a", 1);
+        json_write_double(jw, 0.1);
+        json_write_end_object(jw);
+        len = json_writer_end(jw);
+        json_writer_del(jw);
+        jw = json_writer_fp(fp, 0);
+        json_write_start_list(jw);
+        json_write_str(jw, "\xc3\xa9", 2);
+        json_write_end_list(jw);
+        len += json_writer_end(jw);
+        json_writer_del(jw);
+        fflush(fp);
+        free(buffer);
+        if(!(buffer = read_fd(fd, &n)) || (n != len) || memcmp(buffer, "{\n  \"a\":0.1\n}[\"\xc3\xa9\"]", n)){
+            TRACE(ERROR, "File output differs");
+            status = 0;
+        }
+        close(fd);
+        fclose(fp);
+    }
+    if(json_writer_new(NULL, 1, 0) || json_writer_fd(-1, 0) || json_writer_fp(NULL, 0)){
+        TRACE(ERROR, "Invalid arguments not detected");
+        status = 0;
+    }
+    free(buffer);
+    return status;
+}
+
+/* Records seen by JSON Lines callback */
+struct lines_log
+{
+    const char *start;
+    size_t records;         /* Updated by several threads */
+    size_t failed;
+    size_t stop;            /* Offset of record which stops parsing */
+    int status;
+};
+
+static int lines_cb(void *ctx, size_t offset, struct json *json, int err)
+{
+    struct lines_log *log = ctx;
+    struct json *expect = NULL;
+    const char *end = strchr(log->start + offset, '\n');
+    int status = 0;
+
+    expect = json_loads((char*)log->start + offset, (char*)end, &status);
+    if((!json != !expect) || (json && !json_equal(json, expect)) || (!json && (err != status)))
+        __atomic_store_n(&log->status, 0, __ATOMIC_RELAXED);
+    __atomic_fetch_add(json ? &log->records : &log->failed, 1, __ATOMIC_RELAXED);
+    json_del(json);
+    json_del(expect);
+    return (offset == log->stop) ? -JSON_ERR_ARGS : 0;
+}
+
+static int test_lines(void)
+{
+    static const char *seps[] = {"\n", "\r\n", "\n\n", "\n  \t\n"};
+    struct json_opts opts[] = {{0}, {.flags = JSON_OPT_ARENA | JSON_OPT_INSITU}};
+    struct lines_log log;
+    struct json **json = NULL;
+    struct json *expect = NULL;
+    unsigned int threads[] = {1, 3, 0};
+    size_t size = 3 << 20, len = 0, count = 0, records = 0, i;
+    char *buffer = malloc(size);
+    char *line = NULL;
+    int status = 1;
+    int t, o, err;
+
+    /* Records on a single line each, some cross batches */
+    while(len < (size - (64 << 10))){
+        line = buffer + len;
+        len += random_doc(line, 3);
+        for(; line < buffer + len; line++){
+            if(*line == '\n')
+                *line = ' ';
+        }
+        len += sprintf(buffer + len, "%s", seps[test_rand() % 4]);
+        records++;
+    }
+    for(o = 0; o < 2; o++){
+        for(t = 0; t < 3; t++){
+            if(!(json = json_loads_lines(buffer, buffer + len, &opts[o], threads[t], &count, &err)) || (count != records)){
+                TRACE(ERROR, "Failed to parse lines : %s", json_sterror(err));
+                status = 0;
+                json_lines_del(json, count);
+                continue;
+            }
+            /* Records are in input order */
+            for(line = buffer, i = 0; (i < count) && status; line = strchr(line, '\n') + 1){
+                if((*line == '\n') || (*line == ' ') || (*line == '\r'))
+                    continue;
+                if(!(expect = json_loads(line, strchr(line, '\n'), &err)) || !json_equal(json[i], expect)){
+                    TRACE(ERROR, "Record %zu differs", i);
+                    status = 0;
+                }
+                json_del(expect);
+                i++;
+            }
+            json_lines_del(json, count);
+        }
+    }
+
+    /* Callback sees every record, invalid one is reported and fails ordered parse */
+    line = buffer + len / 2;
+    line = strchr(line, '\n') + 1;
+    for(; (*line == '\n') || (*line == ' ') || (*line == '\r') || (*line == '\t'); line++);
+    line[0] = (line[0] == '{') ? '[' : '{';
+    for(t = 0; t < 3; t++){
+        memset(&log, 0, sizeof(log));
+        log.start = buffer;
+        log.stop = len;
+        log.status = 1;
+        if((json_lines(buffer, buffer + len, NULL, threads[t], lines_cb, &log) < 0) || !log.status ||
+           (log.records != records - 1) || (log.failed != 1)){
+            TRACE(ERROR, "Callback missed records");
+            status = 0;
+        }
+    }
+    if((json = json_loads_lines(buffer, buffer + len, NULL, 0, &count, &err)) || (err != -JSON_ERR_PARSE)){
+        TRACE(ERROR, "Invalid record accepted");
+        json_lines_del(json, count);
+        status = 0;
+    }
+
+    /* Callback error stops parsing and is returned */
+    memset(&log, 0, sizeof(log));
+    log.start = buffer;
+    log.stop = 0;
+    log.status = 1;
+    if((json_lines(buffer, buffer + len, NULL, 1, lines_cb, &log) != -JSON_ERR_ARGS) || (log.records != 1)){
+        TRACE(ERROR, "Callback error did not stop parsing");
+        status = 0;
+    }
+
+    /* Empty and blank buffers have no records */
+    if(!(json = json_loads_lines(buffer, buffer, NULL, 0, &count, &err)) || count){
+        TRACE(ERROR, "Empty buffer failed");
+        status = 0;
+    }
+    json_lines_del(json, count);
+    if(!(json = json_loads_lines(" \n\n \r\n", strchr(" \n\n \r\n", 0), NULL, 0, &count, &err)) || count){
+        TRACE(ERROR, "Blank buffer failed");
+        status = 0;
+    }
+    json_lines_del(json, count);
+    free(buffer);
+    return status;
+}
 
 int test_json_run(void)
 {
@@ -295,14 +2033,35 @@ int test_json_run(void)
     TEST_SUITE_BEGIN();
     TEST_RUN(test_file_success, "Test Files for success");
     TEST_RUN(test_file_fail, "Test Files for failures");
+    TEST_RUN(test_load_file, "Load mapped and piped files");
     TEST_RUN(test_empty, "Test Empty Json object");
     TEST_RUN(test_set, "Set Json fields");
     TEST_RUN(test_set_obj,"Set JSON Object");
     TEST_RUN(test_buffer, "Print Json to Buffer");
     TEST_RUN(test_to_str, "Convert Json to string representation");
+    TEST_RUN(test_print, "Print to buffer, fd and stream");
+    TEST_RUN(test_writer, "Streaming writer");
     TEST_RUN(test_get, "Test Json Get Value");
     TEST_RUN(test_iter, "Iterator");
     TEST_RUN(test_list, "List Iterator");
+    TEST_RUN(test_dup_policy, "Duplicate key policy");
+    TEST_RUN(test_wide_object, "Wide object");
+    TEST_RUN(test_arena, "Arena document");
+    TEST_RUN(test_insitu, "In situ strings");
+    TEST_RUN(test_const, "Read only input");
+    TEST_RUN(test_long_str, "Long strings");
+    TEST_RUN(test_float, "Float parsing");
+    TEST_RUN(test_print_escape, "Escape strings, also to ASCII");
+    TEST_RUN(test_print_int, "Print integers, hex and octal");
+    TEST_RUN(test_print_double, "Print doubles with shortest round trip digits");
+    TEST_RUN(test_int, "Integer parsing");
+    TEST_RUN(test_depth, "Nesting depth");
+    TEST_RUN(test_index, "Indexed parsing");
+    TEST_RUN(test_cursor, "Lazy cursor");
+    TEST_RUN(test_sax, "Event parser");
+    TEST_RUN(test_stream, "Push parser");
+    TEST_RUN(test_lines, "JSON Lines");
+    TEST_RUN(test_parallel, "Parallel list parsing");
     TEST_SUITE_RESULTS();
     return 1;
 }
\ No newline at end of file
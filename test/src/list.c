@@ -248,6 +248,60 @@ static int test_index(void)
     return status;
 }
 
+static int test_remove(void)
+{
+    int status = 0;
+    int i;
+    struct list* list = NULL;
+    if((list = list_create(0))){
+        status = 1;
+        /* Remove first, last and middle */
+        if((list_remove(list, 0) != TEST_LIST_SIZE - 1) ||
+           (list_remove(list, TEST_LIST_SIZE - 2) != TEST_LIST_SIZE - 2) ||
+           (list_remove(list, TEST_LIST_SIZE / 2) != TEST_LIST_SIZE - 3)){
+            TRACE(ERROR, "Remove failed");
+            status = 0;
+        }
+        for(i = 0; i < list_size(list); i++){
+            if(list_get(list, i) != &arr[(i < TEST_LIST_SIZE / 2) ? i + 1 : i + 2]){
+                TRACE(ERROR, "Mismatch at %d", i);
+                status = 0;
+            }
+        }
+        if(list_remove(list, list_size(list)) >= 0){
+            TRACE(ERROR, "Removed past end");
+            status = 0;
+        }
+        list_del(list);
+    }
+    return status;
+}
+
+static int test_reserve(void)
+{
+    int status = 0;
+    int i;
+    struct list* list = NULL;
+    if((list = list_new(NULL, int_cmp, int_print))){
+        status = (list_reserve(list, TEST_LIST_SIZE * 100) == 0);
+        for(i = 0; i < TEST_LIST_SIZE * 100; i++){
+            if((list_add(list, &arr[i % TEST_LIST_SIZE])) != i + 1){
+                TRACE(ERROR, "List insertion failed");
+                status = 0;
+            }
+        }
+        for(i = 0; i < TEST_LIST_SIZE * 100; i++){
+            if(list_get(list, i) != &arr[i % TEST_LIST_SIZE]){
+                TRACE(ERROR, "Mismatch at %d", i);
+                status = 0;
+                break;
+            }
+        }
+        list_del(list);
+    }
+    return status;
+}
+
 static void init()
 {
     int i, r;
@@ -271,6 +325,8 @@ int test_list_run(void)
     TEST_RUN(test_iter, "Iter");
     TEST_RUN(test_sort, "Sort");
     TEST_RUN(test_sorted, "Sorted List");
+    TEST_RUN(test_remove, "Remove");
+    TEST_RUN(test_reserve, "Reserve");
     TEST_SUITE_RESULTS();
     return 1;
 }
@@ -18,6 +18,7 @@ int main(int argc, char *argv[])
     test_dict_run();
     test_json_run();
     test_iter_run();
+    test_scan_run();
 }
 
 
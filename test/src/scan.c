@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+#include "test.h"
+
+#define MODULE "ScanTest"
+#include "trace.h"
+#define TEST_SCAN_SIZE 160
+
+static const char ws_chars[] = {' ', '\t', '\n', '\v', '\f', '\r', '\0'};
+
+/* Compare kernel with scalar version for all run lengths and alignments */
+static int test_ws_level(int level)
+{
+    char buffer[TEST_SCAN_SIZE + 1];
+    const char *found = NULL;
+    int run, offset, i;
+
+    if(scan_set_level(level) != level){
+        TRACE(INFO, "Level %d not supported", level);
+        return 1;
+    }
+    for(offset = 0; offset < 32; offset++){
+        for(run = 0; run + offset < TEST_SCAN_SIZE; run++){
+            for(i = 0; i < TEST_SCAN_SIZE; i++){
+                buffer[i] = ws_chars[(i * 7 + run) % sizeof(ws_chars)];
+            }
+            buffer[offset + run] = (run & 1) ? '{' : (char)0x89;
+            found = scan_ws(buffer + offset, buffer + TEST_SCAN_SIZE);
+            if(found != buffer + offset + run){
+                TRACE(ERROR, "Level %d, offset %d, run %d : found at %ld", level, offset, run, (long)(found - buffer));
+                return 0;
+            }
+            /* All whitespace till end */
+            buffer[offset + run] = ' ';
+            if(scan_ws(buffer + offset, buffer + offset + run + 1) != buffer + offset + run + 1){
+                TRACE(ERROR, "Level %d, offset %d, run %d : overrun", level, offset, run);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int test_ws(void)
+{
+    int status = test_ws_level(SCAN_SCALAR) && test_ws_level(SCAN_SSE2) && test_ws_level(SCAN_AVX2);
+    /* Restore best level */
+    scan_set_level(SCAN_AVX2);
+    return status;
+}
+
+/* String scan must stop at quote, backslash and every control character */
+static int test_str_level(int level)
+{
+    static const char stops[] = {'"', '\\', '\0', '\n', 0x1F, 0x01};
+    char buffer[TEST_SCAN_SIZE];
+    const char *found = NULL;
+    int run, offset, i;
+
+    if(scan_set_level(level) != level){
+        return 1;
+    }
+    for(offset = 0; offset < 32; offset++){
+        for(run = 0; run + offset < TEST_SCAN_SIZE; run++){
+            for(i = 0; i < TEST_SCAN_SIZE; i++){
+                /* Plain characters, including utf-8 bytes and characters next to stop characters */
+                buffer[i] = (i & 1) ? (char)0xE9 : (char)(0x20 + (i % 0x5E));
+                if((buffer[i] == '"') || (buffer[i] == '\\'))
+                    buffer[i] = '!';
+            }
+            buffer[offset + run] = stops[run % sizeof(stops)];
+            found = scan_str(buffer + offset, buffer + TEST_SCAN_SIZE);
+            if(found != buffer + offset + run){
+                TRACE(ERROR, "Level %d, offset %d, run %d : found at %ld", level, offset, run, (long)(found - buffer));
+                return 0;
+            }
+            if(scan_str(buffer + offset, buffer + offset + run) != buffer + offset + run){
+                TRACE(ERROR, "Level %d, offset %d, run %d : overrun", level, offset, run);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int test_str(void)
+{
+    int status = test_str_level(SCAN_SCALAR) && test_str_level(SCAN_SSE2) && test_str_level(SCAN_AVX2);
+    scan_set_level(SCAN_AVX2);
+    return status;
+}
+
+/* Block masks must match scalar version */
+static int test_block_level(int level)
+{
+    static const char chars[] = "{}[]:,\"\\ \t\n\v\f\r\0\x01\x1F\x7F\x80\xFF" "azZ09;{";
+    char buffer[SCAN_BLOCK_SIZE];
+    struct scan_block ref, masks;
+    int round, i;
+
+    if(scan_set_level(level) != level){
+        return 1;
+    }
+    for(round = 0; round < 2000; round++){
+        for(i = 0; i < SCAN_BLOCK_SIZE; i++){
+            buffer[i] = (round < 256) ? (char)(round + i) : chars[(round * 31 + i * i * 7 + (i >> 3)) % (sizeof(chars) - 1)];
+        }
+        scan_block_scalar(buffer, 1, &ref);
+        scan_block(buffer, 1, &masks);
+        if(memcmp(&ref, &masks, sizeof(ref))){
+            TRACE(ERROR, "Level %d, round %d : masks differ", level, round);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int test_block(void)
+{
+    int status = test_block_level(SCAN_SCALAR) && test_block_level(SCAN_SSE2) && test_block_level(SCAN_AVX2);
+    scan_set_level(SCAN_AVX2);
+    return status;
+}
+
+static int test_class(void)
+{
+    int ch;
+    for(ch = 0; ch < 256; ch++){
+        if((!!scan_is_ws(ch)) != ((ch == 0) || (ch == ' ') || ((ch >= '\t') && (ch <= '\r')))){
+            TRACE(ERROR, "Wrong class for %d", ch);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_scan_run(void)
+{
+    TEST_SUITE_INIT("Scan Test");
+    TEST_SUITE_BEGIN();
+    TEST_RUN(test_class, "Character class");
+    TEST_RUN(test_ws, "Whitespace");
+    TEST_RUN(test_str, "String");
+    TEST_RUN(test_block, "Block masks");
+    TEST_SUITE_RESULTS();
+    return 1;
+}
@@ -26,4 +26,5 @@ extern int test_list_run(void);
 extern int test_dict_run(void);
 extern int test_json_run(void);
 extern int test_iter_run(void);
+extern int test_scan_run(void);
 #endif
\ No newline at end of file